@@ -7,6 +7,7 @@
 #include "config.h"
 #endif
 
+#include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <limits.h>
@@ -28,7 +29,7 @@
 #include "lirc/input_map.h"
 
 #include "lirc_private.h"
-#include "line_buffer.h"
+#include "lirc_client.h"
 
 
 static const logchannel_t logchannel = LOG_APP;
@@ -76,6 +77,9 @@ static const char* const optstring = "ad:D::hO:r:R:u:L:v";
 /** Max for --repeat period and delay parts (ms). */
 static const int MAX_INTERVAL = 20000;
 
+/** Max number of lines processed after each read from input. */
+static const int LINE_BATCH = 32;
+
 /** Keys in lirc_options db and thus in lirc_options.conf config file. */
 static const char* const DEBUG_OPT    =	"lircd:debug";
 static const char* const LOGFILE_OPT  =	"lircd-uinput:logfile";
@@ -436,16 +440,17 @@ static void send_message(const struct options* opts, const char* button, int rep
 
 
 /** Process a single line of input from the socket (or test file). */
-static void process_line(const struct options* opts, std::string line)
+static void process_line(const struct options* opts, const char* line)
 {
 	int r;
 	char button[PACKET_SIZE + 1];
 	char remote[PACKET_SIZE + 1];
 	int reps;
 
-	r = sscanf(line.c_str(), "%*x %x %s %s\n", &reps, button, remote);
+	log_trace("Input: %s", line);
+	r = sscanf(line, "%*x %x %256s %256s", &reps, button, remote);
 	if (r != 3) {
-		log_warn("Cannot parse line: %s", line.c_str());
+		log_warn("Cannot parse line: %s", line);
 		return;
 	}
 	if (opts->disabled_path && opts->disabled_buttons.count(button) == 1)
@@ -455,16 +460,28 @@ static void process_line(const struct options* opts, std::string line)
 }
 
 
-/** Process all available lines in line_buffer. */
-static void process_lines(const struct options* opts, LineBuffer* line_buffer)
+/**
+ * Process all lines available in reader.
+ * @return 0 on EOF, else 1.
+ */
+static int process_lines(const struct options* opts, lirc_reader* reader)
 {
-	std::string line;
-
-	while (line_buffer->has_lines()) {
-		line = line_buffer->get_next_line();
-		log_trace("Input: %s", line.c_str());
-		process_line(opts, line);
-	}
+	const char* lines[LINE_BATCH];
+	int count;
+	int i;
+
+	do {
+		errno = 0;
+		count = lirc_reader_read(reader, lines, LINE_BATCH);
+		if (count == -1) {
+			if (errno == 0)
+				return 0;
+			log_perror_warn("lircd_uinput(): read() error");
+		}
+		for (i = 0; i < count; i += 1)
+			process_line(opts, lines[i]);
+	} while (count == LINE_BATCH);
+	return 1;
 }
 
 
@@ -488,11 +505,19 @@ static void send_release_event(const struct options* opts)
 static void lircd_uinput(const struct options* opts)
 {
 	int r;
-        char buffer[PACKET_SIZE + 1];
-	LineBuffer line_buffer;
+	lirc_reader* reader;
 	struct pollfd fds;
 	int timeout = opts->add_release_events ? opts->release_timeout : -1;
 
+	/* Non-blocking, so process_lines() can drain the reader. */
+	r = fcntl(opts->inputfd, F_GETFL);
+	if (r == -1 || fcntl(opts->inputfd, F_SETFL, r | O_NONBLOCK) == -1)
+		log_perror_warn("Cannot set O_NONBLOCK on input");
+	reader = lirc_reader_new(opts->inputfd);
+	if (reader == NULL) {
+		log_error("Out of memory");
+		exit(EXIT_FAILURE);
+	}
 	while (true) {
 		fds.fd = opts->inputfd;
 		fds.events = POLLIN;
@@ -506,15 +531,8 @@ static void lircd_uinput(const struct options* opts)
 			log_notice("POLLERR or curl_poll() error, exiting.");
 			exit(EXIT_FAILURE);
 		}
-		r = read(opts->inputfd, buffer, PACKET_SIZE);
-		if (r > 0) {
-			line_buffer.append(buffer, static_cast<size_t>(r));
-			process_lines(opts, &line_buffer);
-		} else if (r == -1) {
-			log_perror_warn("lircd_uinput(): read() error");
-		} else  {
+		if (!process_lines(opts, reader))
 			fds.revents |= POLLHUP;
-		}
 		if ((fds.revents & POLLHUP) != 0) {
 			log_debug("POLLHUP or no data: exiting .");
 			exit(0);
@@ -149,7 +149,9 @@ static const char* const help =
 	"\t -A --driver-options=key:value[|key:value...]\n"
 	"\t\t\t\t\tSet driver options\n"
 	"\t -e --effective-user=uid\tRun as uid after init as root\n"
-	"\t -R --repeat-max=limit\t\tAllow at most this many repeats\n";
+	"\t -R --repeat-max=limit\t\tAllow at most this many repeats\n"
+	"\t -E --early-emit\t\tDon't wait for trailing gap when decoding\n"
+	"\t -Q --async-log\t\t\tWrite log messages in a separate thread\n";
 
 
 static const struct option lircd_options[] = {
@@ -175,6 +177,8 @@ static const struct option lircd_options[] = {
 	{ "effective-user", required_argument, NULL, 'e' },
 	{ "uinput",         no_argument,       NULL, 'u' },
 	{ "repeat-max",	    required_argument, NULL, 'R' },
+	{ "early-emit",	    no_argument,       NULL, 'E' },
+	{ "async-log",	    no_argument,       NULL, 'Q' },
 	{ 0,		    0,		       0,    0	 }
 };
 
@@ -184,6 +188,10 @@ static const struct option lircd_options[] = {
 static int list(int fd, char* message, char* arguments);
 static int set_transmitters(int fd, char* message, char* arguments);
 static int set_inputlog(int fd, char* message, char* arguments);
+static int set_trace(int fd, char* message, char* arguments);
+static int set_timestamps(int fd, char* message, char* arguments);
+static int latency(int fd, char* message, char* arguments);
+static int drv_stats(int fd, char* message, char* arguments);
 static int simulate(int fd, char* message, char* arguments);
 static int send_once(int fd, char* message, char* arguments);
 static int drv_option(int fd, char* message, char* arguments);
@@ -229,7 +237,11 @@ static const struct protocol_directive directives[] = {
 	{ "SEND_START",	      send_start       },
 	{ "SEND_STOP",	      send_stop	       },
 	{ "SET_INPUTLOG",     set_inputlog     },
+	{ "SET_TRACE",	      set_trace	       },
+	{ "SET_TIMESTAMPS",   set_timestamps   },
+	{ "LATENCY",	      latency	       },
 	{ "DRV_OPTION",	      drv_option       },
+	{ "DRV_STATS",	      drv_stats	       },
 	{ "VERSION",	      version	       },
 	{ "SET_TRANSMITTERS", set_transmitters },
 	{ "SIMULATE",	      simulate	       },
@@ -274,8 +286,32 @@ static loglevel_t loglevel_opt = LIRC_NOLOG;
 #define CT_REMOTE 2
 
 static int cli_type[MAX_CLIENTS];
+static int cli_timestamps[MAX_CLIENTS]; /* Add capture time to messages? */
 static int clin = 0; /* Number of clients */
 
+/** Latency statistics for one stage of the input path. */
+struct latency_stats {
+	const char*	name;
+	unsigned long	count;
+	uint64_t	sum;    /**< Total latency, ns. */
+	uint64_t	max;    /**< Max latency, ns. */
+};
+
+enum latency_stage {
+	LAT_CAPTURE_DECODE = 0, /**< First sample until code matched. */
+	LAT_DECODE_DISPATCH,    /**< Code matched until broadcast starts. */
+	LAT_DISPATCH_WRITTEN,   /**< Writing to all clients. */
+	LAT_DECODE_WRITTEN,     /**< Code matched until written to all. */
+	LAT_STAGES
+};
+
+static struct latency_stats latency_stats[LAT_STAGES] = {
+	{ "capture-decode",   0, 0, 0 },
+	{ "decode-dispatch",  0, 0, 0 },
+	{ "dispatch-written", 0, 0, 0 },
+	{ "decode-written",   0, 0, 0 },
+};
+
 static int listen_tcpip = 0;
 static unsigned short int port = LIRC_INET_PORT;
 static struct in_addr address;
@@ -581,8 +617,11 @@ void remove_client(int fd)
 			clin--;
 			if (!use_hw() && curr_driver->deinit_func)
 				curr_driver->deinit_func();
-			for (; i < clin; i++)
+			for (; i < clin; i++) {
 				clis[i] = clis[i + 1];
+				cli_type[i] = cli_type[i + 1];
+				cli_timestamps[i] = cli_timestamps[i + 1];
+			}
 			return;
 		}
 	}
@@ -625,6 +664,8 @@ void dosigterm(int sig)
 	}
 	fclose(pidf);
 	(void)unlink(pidfile);
+	rec_buffer_set_logfile(NULL);
+	rec_buffer_set_capture(NULL);
 	if (curr_driver->close_func)
 		curr_driver->close_func();
 	if (use_hw() && curr_driver->deinit_func)
@@ -773,6 +814,7 @@ void add_client(int sock)
 		cli_type[clin] = 0;     /* what? */
 	}
 	clis[clin] = fd;
+	cli_timestamps[clin] = 0;
 	if (!use_hw()) {
 		if (curr_driver->init_func) {
 			if (!curr_driver->init_func()) {
@@ -992,6 +1034,7 @@ void start_server(mode_t permission, int nodaemon, loglevel_t loglevel)
 	if (ftruncate(fileno(pidf), ftell(pidf)) != 0)
 		log_perror_warn("lircd: ftruncate()");
 	ir_remote_init(options_getboolean("lircd:dynamic-codes"));
+	rec_set_early_emit(options_getboolean("lircd:early-emit"));
 
 	/* create socket */
 	sockfd = -1;
@@ -1503,15 +1546,38 @@ string_error:
 }
 
 
-void broadcast_message(const char* message)
+/**
+ * Write message to all clients. Clients which have enabled timestamps
+ * gets the captured time added as a last field.
+ */
+void broadcast_message(const char* message, uint64_t captured)
 {
-	int len, i;
-
-	len = strlen(message);
+	char stamped[PACKET_SIZE + 32];
+	const char* msg;
+	int message_len, len, i;
+	int stamped_len = 0;    /* 0: not built yet, -1: doesn't fit. */
 
+	message_len = strlen(message);
 	for (i = 0; i < clin; i++) {
-		log_trace("writing to client %d: %s", i, message);
-		if (write_socket(clis[i], message, len) < len) {
+		if (cli_timestamps[i] && stamped_len == 0) {
+			stamped_len = snprintf(stamped, sizeof(stamped),
+					       "%.*s %llu\n",
+					       message_len > 0 ?
+							message_len - 1 : 0,
+					       message,
+					       (unsigned long long)captured);
+			if (stamped_len >= (int)sizeof(stamped))
+				stamped_len = -1;
+		}
+		if (cli_timestamps[i] && stamped_len > 0) {
+			msg = stamped;
+			len = stamped_len;
+		} else {
+			msg = message;
+			len = message_len;
+		}
+		log_trace("writing to client %d: %s", i, msg);
+		if (write_socket(clis[i], msg, len) < len) {
 			remove_client(clis[i]);
 			i--;
 		}
@@ -1560,7 +1626,7 @@ static int simulate(int fd, char* message, char* arguments)
 		return send_error(fd, message, "out of memory\n");
 	strcpy(sim, arguments);
 	strcat(sim, "\n");
-	broadcast_message(sim);
+	broadcast_message(sim, time_now_ns());
 	free(sim);
 
 	return send_success(fd, message);
@@ -1617,7 +1683,7 @@ static int send_core(int fd, char* message, char* arguments, int once)
 	clock_gettime (CLOCK_MONOTONIC, &before_send);
 	if (!send_ir_ncode(remote, code, 1))
 		return send_error(fd, message, "transmission failed\n");
-	gettimeofday(&remote->last_send, NULL);
+	remote->last_send = time_now_ns();
 	remote->last_code = code;
 	if (once)
 		remote->repeat_countdown = max(remote->repeat_countdown, reps);
@@ -1739,12 +1805,14 @@ static int drv_option(int fd, char* message, char* arguments)
 static int set_inputlog(int fd, char* message, char* arguments)
 {
 	char buff[128];
+	char format[8] = "text";
 	FILE* f;
 	int r;
 
 	if (arguments) {
-		r = sscanf(arguments, "%128s", buff);
-		if (r != 1) {
+		r = sscanf(arguments, "%127s %7s", buff, format);
+		if (r < 1 || (strcasecmp(format, "text") != 0
+			      && strcasecmp(format, "binary") != 0)) {
 			return send_error(
 				fd, message,
 				"Illegal argument (protocol error): %s",
@@ -1754,6 +1822,16 @@ static int set_inputlog(int fd, char* message, char* arguments)
 	}
 	if (!arguments || strcasecmp(buff, "null") == 0) {
 		rec_buffer_set_logfile(NULL);
+		rec_buffer_set_capture(NULL);
+		return send_success(fd, message);
+	}
+	if (strcasecmp(format, "binary") == 0) {
+		if (!rec_buffer_set_capture(buff)) {
+			log_warn("Cannot open input capture: %s", buff);
+			return send_error(fd, message,
+					  "Cannot open input capture: %s (errno: %d)",
+					  buff, errno);
+		}
 		return send_success(fd, message);
 	}
 	f = fopen(buff, "w");
@@ -1768,6 +1846,145 @@ static int set_inputlog(int fd, char* message, char* arguments)
 }
 
 
+static int set_trace(int fd, char* message, char* arguments)
+{
+	char buff[128];
+	unsigned int records = 0;
+	int r = 0;
+
+	if (arguments) {
+		r = sscanf(arguments, "%127s %u", buff, &records);
+		if (r < 1) {
+			return send_error(
+				fd, message,
+				"Illegal argument (protocol error): %s",
+				arguments
+			);
+		}
+	}
+	if (!arguments || strcasecmp(buff, "null") == 0) {
+		lirc_trace_stop();
+		return send_success(fd, message);
+	}
+	lirc_trace_stop();
+	if (lirc_trace_start(buff, records) != 0) {
+		log_perror_warn("Cannot start tracing in %s", buff);
+		return send_error(fd, message,
+				  "Cannot start tracing in %s (errno: %d)",
+				  buff, errno);
+	}
+	return send_success(fd, message);
+}
+
+
+static int set_timestamps(int fd, char* message, char* arguments)
+{
+	char buff[8];
+	int i;
+
+	if (arguments == NULL || sscanf(arguments, "%7s", buff) != 1)
+		return send_error(fd, message, "no arguments given\n");
+	for (i = 0; i < clin; i++)
+		if (clis[i] == fd)
+			break;
+	if (i == clin)
+		return send_error(fd, message, "no such client\n");
+	if (strcasecmp(buff, "on") == 0)
+		cli_timestamps[i] = 1;
+	else if (strcasecmp(buff, "off") == 0)
+		cli_timestamps[i] = 0;
+	else
+		return send_error(fd, message,
+				  "Illegal argument (protocol error): %s\n",
+				  arguments);
+	return send_success(fd, message);
+}
+
+
+static void latency_add(enum latency_stage stage, uint64_t from, uint64_t to)
+{
+	struct latency_stats* stats = &latency_stats[stage];
+	uint64_t diff;
+
+	if (from == 0 || to < from)
+		return;
+	diff = to - from;
+	stats->count += 1;
+	stats->sum += diff;
+	if (diff > stats->max)
+		stats->max = diff;
+}
+
+
+static int latency(int fd, char* message, char* arguments)
+{
+	char buffer[PACKET_SIZE + 1];
+	struct latency_stats* stats;
+	int i;
+
+	if (arguments != NULL && strcasecmp(arguments, "reset") == 0) {
+		for (i = 0; i < LAT_STAGES; i++) {
+			latency_stats[i].count = 0;
+			latency_stats[i].sum = 0;
+			latency_stats[i].max = 0;
+		}
+		return send_success(fd, message);
+	}
+	if (!(write_socket_len(fd, protocol_string[P_BEGIN])
+	      && write_socket_len(fd, message)
+	      && write_socket_len(fd, protocol_string[P_SUCCESS])
+	      && write_socket_len(fd, protocol_string[P_DATA]))
+	) {
+		return 0;
+	}
+	sprintf(buffer, "%d\n", LAT_STAGES);
+	if (!write_socket_len(fd, buffer))
+		return 0;
+	for (i = 0; i < LAT_STAGES; i++) {
+		stats = &latency_stats[i];
+		snprintf(buffer, sizeof(buffer),
+			 "%s count: %lu avg: %llu max: %llu\n",
+			 stats->name, stats->count,
+			 stats->count > 0 ?
+				(unsigned long long)(stats->sum / stats->count / 1000) : 0ULL,
+			 (unsigned long long)(stats->max / 1000));
+		if (!write_socket_len(fd, buffer))
+			return 0;
+	}
+	return write_socket_len(fd, protocol_string[P_END]);
+}
+
+
+static int drv_stats(int fd, char* message, char* arguments)
+{
+	char buffer[PACKET_SIZE + 1];
+	glob_t glob;
+	size_t i;
+	int r;
+
+	if (curr_driver->drvctl_func == NULL)
+		return send_error(fd, message, "Driver has no statistics\n");
+	r = curr_driver->drvctl_func(DRVCTL_GET_STATS, &glob);
+	if (r != 0)
+		return send_error(fd, message,
+				  "Driver has no statistics, code: %d\n", r);
+	r = write_socket_len(fd, protocol_string[P_BEGIN])
+	    && write_socket_len(fd, message)
+	    && write_socket_len(fd, protocol_string[P_SUCCESS])
+	    && write_socket_len(fd, protocol_string[P_DATA]);
+	if (r) {
+		sprintf(buffer, "%d\n", (int)glob.gl_pathc);
+		r = write_socket_len(fd, buffer);
+	}
+	for (i = 0; r && i < glob.gl_pathc; i++) {
+		snprintf(buffer, sizeof(buffer), "%s\n", glob.gl_pathv[i]);
+		r = write_socket_len(fd, buffer);
+	}
+	curr_driver->drvctl_func(DRVCTL_FREE_DEVICES, &glob);
+	return r && write_socket_len(fd, protocol_string[P_END]);
+}
+
+
 int get_command(int fd)
 {
 	int length;
@@ -1854,9 +2071,20 @@ skip:
 
 static void input_message(const char* message,
 			  const char* remote_name,
-			  const char* button_name, int reps)
+			  const char* button_name,
+			  int reps,
+			  uint64_t captured,
+			  uint64_t decoded)
 {
-	broadcast_message(message);
+	uint64_t dispatched = time_now_ns();
+	uint64_t written;
+
+	broadcast_message(message, captured);
+	written = time_now_ns();
+	latency_add(LAT_CAPTURE_DECODE, captured, decoded);
+	latency_add(LAT_DECODE_DISPATCH, decoded, dispatched);
+	latency_add(LAT_DISPATCH_WRITTEN, dispatched, written);
+	latency_add(LAT_DECODE_WRITTEN, decoded, written);
 }
 
 
@@ -1973,7 +2201,9 @@ static int mywaitfordata(uint32_t maxusec)
 {
 	int i;
 	int ret, reconnect;
-	struct timeval tv, start, now, timeout, release_time;
+	struct timeval tv, start, now, timeout;
+	uint64_t release_time;
+	uint64_t flush_time;
 	loglevel_t oldlevel;
 
 	while (1) {
@@ -2063,21 +2293,43 @@ static int mywaitfordata(uint32_t maxusec)
 				    || (!reconnect && !timerisset(&tv)))
 					tv = timeout;
 			}
-			get_release_time(&release_time);
-			if (timerisset(&release_time)) {
-				gettimeofday(&now, NULL);
-				if (timercmp(&now, &release_time, >)) {
+			release_time = get_release_time();
+			if (release_time != 0) {
+				uint64_t now_ns = time_now_ns();
+
+				if (now_ns > release_time) {
 					timerclear(&tv);
 				} else {
 					struct timeval gap;
 
-					timersub(&release_time, &now, &gap);
+					gap.tv_sec = (release_time - now_ns)
+						     / 1000000000;
+					gap.tv_usec = (release_time - now_ns)
+						      % 1000000000 / 1000;
 					if (!(timerisset(&tv)
 					      || reconnect)
 					    || timercmp(&tv, &gap, >))
 						tv = gap;
 				}
 			}
+			/* Write input logs when idle, unless timing a frame. */
+			flush_time = maxusec == 0 ? rec_buffer_log_deadline() : 0;
+			if (flush_time != 0) {
+				uint64_t now_ns = time_now_ns();
+				struct timeval gap;
+
+				if (now_ns >= flush_time) {
+					rec_buffer_flush_log();
+				} else {
+					gap.tv_sec = (flush_time - now_ns)
+						     / 1000000000;
+					gap.tv_usec = (flush_time - now_ns)
+						      % 1000000000 / 1000;
+					if (!(timerisset(&tv) || reconnect)
+					    || timercmp(&tv, &gap, >))
+						tv = gap;
+				}
+			}
 			if (timerisset(&tv) || reconnect) {
 				ret = curl_poll((
 					struct pollfd *) &poll_fds.byindex,
@@ -2167,7 +2419,9 @@ void loop(void)
 
 	log_notice("lircd(%s) ready, using %s", curr_driver->name, lircdfile);
 	while (1) {
-		(void)mywaitfordata(0);
+		/* Buffered samples won't make driver fd readable. */
+		if (drv_pending() == 0)
+			(void)mywaitfordata(0);
 		if (!curr_driver->rec_func)
 			continue;
 		message = curr_driver->rec_func(remotes);
@@ -2179,7 +2433,8 @@ void loop(void)
 
 			get_release_data(&remote_name, &button_name, &reps);
 
-			input_message(message, remote_name, button_name, reps);
+			input_message(message, remote_name, button_name, reps,
+				      get_capture_time(), get_decode_time());
 		}
 	}
 }
@@ -2236,7 +2491,10 @@ static void lircd_add_defaults(void)
 		"lircd:debug",		level,
 		"lircd:allow-simulate",	"False",
 		"lircd:dynamic-codes",	"False",
+		"lircd:early-emit",	"False",
+		"lircd:async-log",	"False",
 		"lircd:plugindir",	PLUGINDIR,
+		"lircd:update-plugin-index", "False",
 		"lircd:repeat-max",	DEFAULT_REPEAT_MAX,
 		"lircd:configfile",	LIRCDCFGFILE,
 		"lircd:driver-options",	"",
@@ -2268,7 +2526,7 @@ int parse_peer_connections(const char* opt)
 static void lircd_parse_options(int argc, char** const argv)
 {
 	int c;
-	const char* optstring = "A:e:O:hvnp:iH:d:o:U:P:l::L:c:aR:D::Yu";
+	const char* optstring = "A:e:O:hvnp:iH:d:o:U:P:l::L:c:aR:D::YuEQ";
 
 	strncpy(progname, "lircd", sizeof(progname));
 	optind = 1;
@@ -2345,6 +2603,12 @@ static void lircd_parse_options(int argc, char** const argv)
 		case 'Y':
 			options_set_opt("lircd:dynamic-codes", "True");
 			break;
+		case 'E':
+			options_set_opt("lircd:early-emit", "True");
+			break;
+		case 'Q':
+			options_set_opt("lircd:async-log", "True");
+			break;
 		case 'A':
 			options_set_opt("lircd:driver-options", optarg);
 			break;
@@ -2418,6 +2682,10 @@ static void log_options(void)
 	log_notice("Options: configfile: %s", optvalue("lircd:configfile"));
 	log_notice("Options: dynamic_codes: %s",
 		   optvalue("lircd:dynamic_codes"));
+	log_notice("Options: early_emit: %s",
+		   optvalue("lircd:early-emit"));
+	log_notice("Options: async_log: %s",
+		   optvalue("lircd:async-log"));
 }
 
 
@@ -2577,6 +2845,9 @@ int main(int argc, char** argv)
 	/* ready to accept connections */
 	if (!nodaemon)
 		daemonize();
+	/* After fork() in daemonize(), threads are not inherited. */
+	if (options_getboolean("lircd:async-log"))
+		lirc_log_async_start();
 
 #ifdef HAVE_SYSTEMD
 	/* Tell systemd that we started up correctly */
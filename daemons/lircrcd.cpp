@@ -56,9 +56,10 @@ struct event_info {
 struct client_data {
 	int			fd;
 	char*			ident_string;
-	std::deque<std::string> pending_codes;
-	std::deque<std::string> pending_strings;
+	std::deque<const char*> pending_strings;       /**< Owned by config. */
 	std::string             last_code;
+	bool			subscribed;     /**< Strings are pushed. */
+	std::string		push_buffer;    /**< Unsent pushed strings. */
 };
 
 struct protocol_directive {
@@ -68,6 +69,7 @@ struct protocol_directive {
 
 struct pfd_byname{
 	struct pollfd sockfd;
+	struct pollfd lircd;
 	struct pollfd clis[MAX_CLIENTS];
 };
 
@@ -76,6 +78,7 @@ static int code_func(int fd, char* message, char* arguments);
 static int ident_func(int fd, char* message, char* arguments);
 static int getmode_func(int fd, char* message, char* arguments);
 static int setmode_func(int fd, char* message, char* arguments);
+static int subscribe_func(int fd, char* message, char* arguments);
 static int send_result(int fd, char* message, const char* result);
 static int send_success(int fd, char* message);
 
@@ -84,6 +87,7 @@ const struct protocol_directive directives[] = {
 	{ "IDENT",   ident_func	  },
 	{ "GETMODE", getmode_func },
 	{ "SETMODE", setmode_func },
+	{ "SUBSCRIBE", subscribe_func },
 	{ NULL,	     NULL	  }
 	/*
 	 * {"DEBUG",debug},
@@ -119,6 +123,15 @@ static int daemonized = 0;
 
 static struct lirc_config* config;
 
+/** Connection to lircd while there are subscribed clients, else -1. */
+static int lircd_fd = -1;
+
+/** Max number of lircd events translated after each read. */
+#define EVENT_BATCH 32
+
+/** Max unsent pushed bytes per client before it is disconnected. */
+#define PUSH_BUFFER_MAX 16384
+
 static int send_error(int fd, char* message, const char* format_str, ...);
 
 
@@ -233,6 +246,8 @@ static void nolinger(int sock)
 
 static void remove_client(int i)
 {
+	bool subscribed = clis[i].subscribed;
+
 	shutdown(clis[i].fd, 2);
 	close(clis[i].fd);
 	if (clis[i].ident_string)
@@ -243,6 +258,30 @@ static void remove_client(int i)
 	clin--;
 	for (; i < clin; i++)
 		clis[i] = clis[i + 1];
+	if (!subscribed || lircd_fd == -1)
+		return;
+	for (i = 0; i < clin; i++)
+		if (clis[i].subscribed)
+			return;
+	log_debug("No subscribed clients, closing lircd connection");
+	lirc_deinit();
+	lircd_fd = -1;
+}
+
+
+/** Close lircd connection and all subscribed clients. */
+static void lircd_disconnect(void)
+{
+	int i;
+
+	lirc_deinit();
+	lircd_fd = -1;
+	for (i = 0; i < clin; i++) {
+		if (clis[i].subscribed) {
+			remove_client(i);
+			i--;
+		}
+	}
 }
 
 void add_client(int sock)
@@ -273,6 +312,10 @@ void add_client(int sock)
         log_trace2( "accepted new client");
 	clis[clin].fd = fd;
 	clis[clin].ident_string = NULL;
+	clis[clin].pending_strings.clear();
+	clis[clin].last_code.clear();
+	clis[clin].subscribed = false;
+	clis[clin].push_buffer.clear();
 	clin++;
 }
 
@@ -362,43 +405,154 @@ static int code_func(int fd, char* message, char* arguments)
 	if (clis[index].last_code == arguments) {
 		// client checking for more strings
 		if (!clis[index].pending_strings.empty()) {
-			std::string s = clis[index].pending_strings.front();
+			const char* s = clis[index].pending_strings.front();
+
 			clis[index].pending_strings.pop_front();
-			return send_result(fd, message, s.c_str());
+			return send_result(fd, message, s);
 		} else {
 			clis[index].last_code = "A never used code";
 			return send_success(fd, message);
 		}
 	}
 	clis[index].last_code = arguments;
-	clis[index].pending_codes.push_back(arguments);
 
-	const char* const_code = clis[index].pending_codes.front().c_str();
-	char* var_code = strdup(const_code);
 	char* prog = clis[index].ident_string;
 	char* s;
 	int r;
 
-	clis[index].pending_codes.pop_front();
+	/* lirc_code2charprog() resolves the names without copying code. */
 	while (true) {
-		r = lirc_code2charprog(config, var_code, &s, &prog);
+		r = lirc_code2charprog(config, arguments, &s, &prog);
 		if ( r != 0 || s == NULL || *s == '\0')
 			break;
 		clis[index].pending_strings.push_back(s);
 	}
-	free(var_code);
 	if ( r != 0 ) {
 		return send_error(fd, message, "Cannor decode: %s", arguments);
 	} else if (clis[index].pending_strings.size() == 0) {
 		return send_success(fd, message);
 	} else {
-		std::string s = clis[index].pending_strings.front();
+		const char* result = clis[index].pending_strings.front();
+
 		clis[index].pending_strings.pop_front();
-		return send_result(fd, message, s.c_str());
+		return send_result(fd, message, result);
 	}
 }
 
 
+static int subscribe_func(int fd, char* message, char* arguments)
+{
+	int index;
+	int flags;
+
+	if (arguments != NULL)
+		return send_error(fd, message, "protocol error\n");
+	index = get_client_index(fd);
+	if (index == -1 || clis[index].ident_string == NULL)
+		return send_error(fd, message, "identify yourself first!\n");
+	if (lircd_fd == -1) {
+		lircd_fd = lirc_init(progname, 0);
+		if (lircd_fd == -1)
+			return send_error(fd, message,
+					  "cannot connect to lircd\n");
+		flags = fcntl(lircd_fd, F_GETFL, 0);
+		if (flags != -1)
+			fcntl(lircd_fd, F_SETFL, flags | O_NONBLOCK);
+		log_debug("Connected to lircd");
+	}
+	log_trace("%s subscribed", clis[index].ident_string);
+	clis[index].subscribed = true;
+	return send_success(fd, message);
+}
+
+
+/**
+ * Write as much as possible of a client's push_buffer without blocking.
+ * Unsent data is kept until the socket is writable again, a client
+ * which lets it grow beyond PUSH_BUFFER_MAX is considered dead.
+ * @return 0 if the client should be removed, else 1.
+ */
+static int flush_push_buffer(int i)
+{
+	std::string& buf = clis[i].push_buffer;
+	ssize_t done;
+
+	while (!buf.empty()) {
+		done = write(clis[i].fd, buf.data(), buf.size());
+		if (done > 0) {
+			buf.erase(0, done);
+			continue;
+		}
+		if (done == -1 && errno == EINTR)
+			continue;
+		if (done == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		log_perror_warn("Cannot push to %s", clis[i].ident_string);
+		return 0;
+	}
+	if (buf.size() > PUSH_BUFFER_MAX) {
+		log_warn("%s does not read pushed data, disconnecting",
+			 clis[i].ident_string);
+		return 0;
+	}
+	return 1;
+}
+
+
+/**
+ * Translate all available events from lircd once, and push the strings
+ * to the subscribed clients with matching ident.
+ * @return 0 if lircd connection is lost, else 1.
+ */
+static int push_events(void)
+{
+	const char* codes[EVENT_BATCH];
+	char* prog;
+	char* s;
+	int count;
+	int i;
+	int j;
+	int r;
+
+	do {
+		count = lirc_nextcodes(codes, EVENT_BATCH);
+		for (i = 0; i < count; i++) {
+			log_trace2("pushing code -%s-", codes[i]);
+			while (true) {
+				prog = NULL;
+				r = lirc_code2charprog(config, (char*)codes[i],
+						       &s, &prog);
+				if (r != 0 || s == NULL || *s == '\0')
+					break;
+				for (j = 0; j < clin; j++) {
+					if (!clis[j].subscribed || prog == NULL
+					    || strcasecmp(clis[j].ident_string,
+							  prog) != 0)
+						continue;
+					clis[j].push_buffer += s;
+					clis[j].push_buffer += '\n';
+				}
+			}
+		}
+	} while (count == EVENT_BATCH);
+
+	/* One write per client and read from lircd, rest is sent on POLLOUT. */
+	for (i = 0; i < clin; i++) {
+		if (clis[i].push_buffer.empty())
+			continue;
+		if (!flush_push_buffer(i)) {
+			remove_client(i);
+			i--;
+		}
+	}
+	if (count == -1) {
+		log_notice("lircd connection lost");
+		return 0;
+	}
+	return 1;
+}
+
+
 static int ident_func(int fd, char* message, char* arguments)
 {
 	int index;
@@ -600,15 +754,19 @@ static void loop(int sockfd)
 				poll_fds.byindex[i].fd = -1;
 			poll_fds.byname.sockfd.fd = sockfd;
 			poll_fds.byname.sockfd.events = POLLIN;
+			poll_fds.byname.lircd.fd = lircd_fd;
+			poll_fds.byname.lircd.events = POLLIN;
 
 			for (i = 0; i < clin; i++) {
 				poll_fds.byname.clis[i].fd = clis[i].fd;
 				poll_fds.byname.clis[i].events = POLLIN;
+				if (!clis[i].push_buffer.empty())
+					poll_fds.byname.clis[i].events |= POLLOUT;
 			}
 			log_trace2("poll");
 			ret = curl_poll((struct pollfd*) &poll_fds.byindex,
 				         POLLFDS_SIZE,
-				         0);
+				         -1);
 			if (ret == -1 && errno != EINTR) {
 				log_perror_err("loop: curl_poll() failed");
 				raise(SIGTERM);
@@ -617,6 +775,19 @@ static void loop(int sockfd)
 		} while (ret == -1 && errno == EINTR);
 
 		for (i = 0; i < clin; i++) {
+			if (poll_fds.byname.clis[i].revents & POLLOUT) {
+				poll_fds.byname.clis[i].revents &= ~POLLOUT;
+				if (!flush_push_buffer(i)) {
+					poll_fds.byname.clis[i].revents = 0;
+					remove_client(i);
+					i--;
+					if (clin == 0) {
+						log_info("last client disconnected, shutting down");
+						return;
+					}
+					continue;
+				}
+			}
 			if (poll_fds.byname.clis[i].revents & POLLIN) {
 				poll_fds.byname.clis[i].revents	= 0;
 				if (get_command(clis[i].fd) == 0) {
@@ -629,6 +800,14 @@ static void loop(int sockfd)
 				}
 			}
 		}
+		if (poll_fds.byname.lircd.revents != 0 && lircd_fd != -1) {
+			if (push_events() == 0)
+				lircd_disconnect();
+			if (clin == 0) {
+				log_info("last client disconnected, shutting down");
+				return;
+			}
+		}
 		if (poll_fds.byname.sockfd.revents & POLLIN) {
 			log_trace("registering local client");
 			add_client(sockfd);
@@ -0,0 +1,159 @@
+/****************************************************************************
+** capture.c ***************************************************************
+****************************************************************************
+*
+* Binary input capture files.
+*
+*/
+
+/**
+ * @file capture.c
+ * @brief Implements capture.h
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lirc/lirc_log.h"
+#include "lirc/capture.h"
+
+static const logchannel_t logchannel = LOG_LIB;
+
+
+static uint64_t clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/** Write all of buf, retrying on EINTR and partial writes. */
+static int write_all(int fd, const void* buf, size_t size)
+{
+	const char* p = (const char*)buf;
+	ssize_t r;
+
+	while (size > 0) {
+		r = write(fd, p, size);
+		if (r == -1 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return 0;
+		p += r;
+		size -= r;
+	}
+	return 1;
+}
+
+
+struct capture_writer* capture_open(const char* path,
+				    const struct driver* drv)
+{
+	struct capture_header header;
+	struct capture_writer* w;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1)
+		return NULL;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+	header.header_size = sizeof(struct capture_header);
+	header.record_size = sizeof(struct capture_record);
+	header.start = clock_ns(CLOCK_MONOTONIC);
+	header.realtime = clock_ns(CLOCK_REALTIME);
+	if (drv != NULL) {
+		header.rec_mode = drv->rec_mode;
+		header.resolution = drv->resolution;
+		strncpy(header.driver, drv->name, sizeof(header.driver) - 1);
+		if (drv->device != NULL)
+			strncpy(header.device, drv->device,
+				sizeof(header.device) - 1);
+	}
+	if (!write_all(fd, &header, sizeof(header))) {
+		close(fd);
+		return NULL;
+	}
+	w = (struct capture_writer*)calloc(1, sizeof(struct capture_writer));
+	if (w == NULL) {
+		close(fd);
+		errno = ENOMEM;
+		return NULL;
+	}
+	w->fd = fd;
+	w->flushed = header.start;
+	return w;
+}
+
+
+int capture_flush(struct capture_writer* w)
+{
+	int r = 1;
+
+	if (w->count > 0) {
+		r = write_all(w->fd, w->buf,
+			      w->count * sizeof(struct capture_record));
+		if (!r)
+			log_perror_warn("Cannot write input capture");
+	}
+	w->count = 0;
+	w->flushed = clock_ns(CLOCK_MONOTONIC);
+	return r;
+}
+
+
+int capture_put(struct capture_writer* w, lirc_t data, uint64_t ns)
+{
+	struct capture_record* record = &w->buf[w->count++];
+
+	record->ns = ns;
+	record->data = data;
+	record->reserved = 0;
+	if (w->count >= CAPTURE_BATCH || ns - w->flushed > CAPTURE_MAX_DELAY)
+		return capture_flush(w);
+	return 1;
+}
+
+
+void capture_close(struct capture_writer* w)
+{
+	if (w == NULL)
+		return;
+	capture_flush(w);
+	close(w->fd);
+	free(w);
+}
+
+
+int capture_read_header(FILE* f, struct capture_header* header)
+{
+	if (fread(header, sizeof(struct capture_header), 1, f) == 1
+	    && memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) == 0) {
+		if (header->record_size != sizeof(struct capture_record)
+		    || header->header_size < sizeof(struct capture_header)) {
+			log_warn("Unsupported capture file format");
+			rewind(f);
+			return 0;
+		}
+		fseek(f, header->header_size, SEEK_SET);
+		return 1;
+	}
+	rewind(f);
+	return 0;
+}
+
+
+int capture_read(FILE* f, struct capture_record* record)
+{
+	return fread(record, sizeof(struct capture_record), 1, f) == 1;
+}
@@ -0,0 +1,114 @@
+/****************************************************************************
+** capture.h ***************************************************************
+****************************************************************************/
+
+/**
+ * @file capture.h
+ * @brief Binary input capture files.
+ * @ingroup private_api
+ *
+ * A capture file holds the raw pulse/space data received from a driver,
+ * each sample with a CLOCK_MONOTONIC timestamp. It starts with a
+ * capture_header describing the driver, followed by capture_record
+ * items in host byte order.
+ *
+ * Unlike the textual input log the records are buffered and written in
+ * large batches, see capture_put() and capture_flush(). The files can be
+ * replayed by the file driver (and thus irsimreceive) and printed by
+ * mode2 --infile.
+ *
+ * @addtogroup private_api
+ * @{
+ */
+
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "lirc/driver.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Magic bytes starting each capture file. */
+#define CAPTURE_MAGIC           "LIRCCAP1"
+
+/** Number of records buffered before writing. */
+#define CAPTURE_BATCH           512
+
+/** Max time data is buffered by capture_put() (ns). */
+#define CAPTURE_MAX_DELAY       1000000000ULL
+
+/** Capture file header. */
+struct capture_header {
+	char		magic[8];       /**< CAPTURE_MAGIC */
+	uint32_t	header_size;    /**< sizeof(capture_header) */
+	uint32_t	record_size;    /**< sizeof(capture_record) */
+	uint32_t	rec_mode;       /**< Driver rec_mode. */
+	uint32_t	resolution;     /**< Driver resolution (us), or 0. */
+	uint64_t	start;          /**< CLOCK_MONOTONIC ns at start. */
+	uint64_t	realtime;       /**< CLOCK_REALTIME ns at start. */
+	char		driver[32];     /**< Driver name. */
+	char		device[64];     /**< Driver device. */
+};
+
+/** A captured sample. */
+struct capture_record {
+	uint64_t	ns;             /**< CLOCK_MONOTONIC timestamp. */
+	uint32_t	data;           /**< lirc_t as returned by readdata(). */
+	uint32_t	reserved;
+};
+
+/** An open capture file being written. */
+struct capture_writer {
+	int			fd;
+	int			count;  /**< Records in buf. */
+	uint64_t		flushed;        /**< Last flush time. */
+	struct capture_record	buf[CAPTURE_BATCH];
+};
+
+/**
+ * Create a capture file with a header describing drv.
+ * @return New writer, or NULL on errors with errno set.
+ */
+struct capture_writer* capture_open(const char* path,
+				    const struct driver* drv);
+
+/**
+ * Add a sample to the capture. Data is written when the buffer is full
+ * or when it has been buffered more than CAPTURE_MAX_DELAY.
+ * @return 1 on success, 0 on write errors.
+ */
+int capture_put(struct capture_writer* w, lirc_t data, uint64_t ns);
+
+/** Write all buffered data. @return 1 on success, 0 on errors. */
+int capture_flush(struct capture_writer* w);
+
+/** Flush and close capture file, free w. */
+void capture_close(struct capture_writer* w);
+
+/**
+ * Check if f is a capture file.
+ * @param f File positioned at start.
+ * @param header If f is a capture file, updated with the header.
+ * @return 1 if f is a capture file positioned at first record, 0 if
+ *      not, in which case f is rewound to start.
+ */
+int capture_read_header(FILE* f, struct capture_header* header);
+
+/**
+ * Read next record from a capture file.
+ * @return 1 if record was read, 0 on EOF or errors.
+ */
+int capture_read(FILE* f, struct capture_record* record);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif
@@ -34,6 +34,8 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include "media/lirc.h"
 
@@ -66,18 +68,319 @@ struct void_array {
 /** foreach_void_array argument. */
 typedef void* (*array_guest_func)(void* item, void* arg);
 
+/** An included file parsed by read_all_included(). */
+struct include_job {
+	char			path[256];      /**< Quoted path. */
+	struct ir_remote*	remotes;        /**< Parse result. */
+	int			parsed;
+};
+
+/** Included files, shared by the include_worker() threads. */
+struct include_pool {
+	struct include_job*	jobs;
+	size_t			count;
+	size_t			next;           /**< Next job to parse. */
+	const char*		name;           /**< Including file. */
+	int			depth;
+	int			line;           /**< Line of include directive. */
+	int			dyncodes;       /**< lircd:dynamic-codes. */
+};
+
+/**
+ * Hash sets of the names and values of the codes in a codes_list,
+ * used to find duplicates. Slots holds item index + 1, 0 is free.
+ */
+struct ncode_index {
+	size_t*	names;
+	size_t*	values;
+	size_t	size;   /**< Slots in each table, a power of 2. */
+	size_t	count;  /**< Number of codes_list items indexed. */
+};
+
 
 #define LINE_LEN 4096
 #define MAX_INCLUDES 10
 
+/** Max number of threads parsing included files. */
+#define MAX_INCLUDE_THREADS 8
+
+/** Size of keyword_table, a power of 2. */
+#define KEYWORD_HASH_SIZE 128
+
 const char* whitespace = " \t";
 
-static int line;
-static int parse_error;
+/** State of file being parsed by current thread. */
+static __thread int line;
+static __thread int parse_error;
+
+/** Keywords recognized by the parser, see keyword_lookup(). */
+enum keyword {
+	KW_NONE = 0,
+	KW_INCLUDE,
+	KW_BEGIN,
+	KW_END,
+	KW_NAME,
+	KW_DYNCODES_NAME,
+	KW_DRIVER,
+	KW_BITS,
+	KW_FLAGS,
+	KW_EPS,
+	KW_AEPS,
+	KW_PLEAD,
+	KW_PTRAIL,
+	KW_PRE_DATA_BITS,
+	KW_PRE_DATA,
+	KW_POST_DATA_BITS,
+	KW_POST_DATA,
+	KW_GAP,
+	KW_REPEAT_GAP,
+	KW_REPEAT_MASK,
+	KW_TOGGLE_BIT,
+	KW_TOGGLE_BIT_MASK,
+	KW_TOGGLE_MASK,
+	KW_RC6_MASK,
+	KW_IGNORE_MASK,
+	KW_MANUAL_SORT,
+	KW_REPEAT_BIT,
+	KW_SUPPRESS_REPEAT,
+	KW_MIN_REPEAT,
+	KW_MIN_CODE_REPEAT,
+	KW_FREQUENCY,
+	KW_DUTY_CYCLE,
+	KW_BAUD,
+	KW_SERIAL_MODE,
+	KW_HEADER,
+	KW_THREE,
+	KW_TWO,
+	KW_ONE,
+	KW_ZERO,
+	KW_FOOT,
+	KW_REPEAT,
+	KW_PRE,
+	KW_POST,
+	KW_LAST
+};
 
-static struct ir_remote* read_config_recursive(FILE* f, const char* name, int depth);
+static const char* const keyword_names[KW_LAST] = {
+	[KW_NONE]		= NULL,
+	[KW_INCLUDE]		= "include",
+	[KW_BEGIN]		= "begin",
+	[KW_END]		= "end",
+	[KW_NAME]		= "name",
+	[KW_DYNCODES_NAME]	= "dyncodes_name",
+	[KW_DRIVER]		= "driver",
+	[KW_BITS]		= "bits",
+	[KW_FLAGS]		= "flags",
+	[KW_EPS]		= "eps",
+	[KW_AEPS]		= "aeps",
+	[KW_PLEAD]		= "plead",
+	[KW_PTRAIL]		= "ptrail",
+	[KW_PRE_DATA_BITS]	= "pre_data_bits",
+	[KW_PRE_DATA]		= "pre_data",
+	[KW_POST_DATA_BITS]	= "post_data_bits",
+	[KW_POST_DATA]		= "post_data",
+	[KW_GAP]		= "gap",
+	[KW_REPEAT_GAP]		= "repeat_gap",
+	[KW_REPEAT_MASK]	= "repeat_mask",
+	[KW_TOGGLE_BIT]		= "toggle_bit",
+	[KW_TOGGLE_BIT_MASK]	= "toggle_bit_mask",
+	[KW_TOGGLE_MASK]	= "toggle_mask",
+	[KW_RC6_MASK]		= "rc6_mask",
+	[KW_IGNORE_MASK]	= "ignore_mask",
+	[KW_MANUAL_SORT]	= "manual_sort",
+	[KW_REPEAT_BIT]		= "repeat_bit",
+	[KW_SUPPRESS_REPEAT]	= "suppress_repeat",
+	[KW_MIN_REPEAT]		= "min_repeat",
+	[KW_MIN_CODE_REPEAT]	= "min_code_repeat",
+	[KW_FREQUENCY]		= "frequency",
+	[KW_DUTY_CYCLE]		= "duty_cycle",
+	[KW_BAUD]		= "baud",
+	[KW_SERIAL_MODE]	= "serial_mode",
+	[KW_HEADER]		= "header",
+	[KW_THREE]		= "three",
+	[KW_TWO]		= "two",
+	[KW_ONE]		= "one",
+	[KW_ZERO]		= "zero",
+	[KW_FOOT]		= "foot",
+	[KW_REPEAT]		= "repeat",
+	[KW_PRE]		= "pre",
+	[KW_POST]		= "post",
+};
+
+/** keyword_hash() -> keyword, without collisions for keyword_names. */
+static unsigned char keyword_table[KEYWORD_HASH_SIZE];
+static pthread_once_t keyword_once = PTHREAD_ONCE_INIT;
+
+/** A config file read into memory, split into lines in place. */
+struct config_text {
+	char*	data;
+	size_t	size;
+	size_t	pos;            /**< Start of next line. */
+	int	is_mapped;      /**< data is mmap'ed, else malloc'ed. */
+};
+
+static struct ir_remote* read_config_recursive(FILE* f, const char* name,
+					       int depth, int dyncodes);
 static void calculate_signal_lengths(struct ir_remote* remote);
 
+/**
+ * Case insensitive hash of a token. The multipliers are chosen so
+ * that all keyword_names hashes to different slots, see keyword_init().
+ */
+static unsigned int keyword_hash(const char* s)
+{
+	size_t len = strlen(s);
+
+	if (len == 0)
+		return 0;
+	return (tolower(s[0]) + 37 * tolower(s[len - 1])
+		+ 12 * tolower(s[1]) + len) % KEYWORD_HASH_SIZE;
+}
+
+
+static void keyword_init(void)
+{
+	unsigned int h;
+	int kw;
+
+	for (kw = KW_NONE + 1; kw < KW_LAST; kw += 1) {
+		h = keyword_hash(keyword_names[kw]);
+		if (keyword_table[h] != KW_NONE)
+			log_error("Keyword hash collision: %s",
+				  keyword_names[kw]);
+		keyword_table[h] = kw;
+	}
+}
+
+
+/** Return keyword for a token, or KW_NONE if it isn't a keyword. */
+static enum keyword keyword_lookup(const char* token)
+{
+	enum keyword kw;
+
+	pthread_once(&keyword_once, keyword_init);
+	kw = (enum keyword)keyword_table[keyword_hash(token)];
+	if (kw != KW_NONE && strcasecmp(keyword_names[kw], token) == 0)
+		return kw;
+	return KW_NONE;
+}
+
+
+/**
+ * Load all of f into text. Regular files are mapped private and
+ * writable, else (and for files not ending with a newline) read into
+ * a buffer.
+ * @return 1 on success, else 0.
+ */
+static int text_open(struct config_text* text, FILE* f)
+{
+	struct stat st;
+	size_t allocated;
+	size_t r;
+	char* p;
+
+	memset(text, 0, sizeof(struct config_text));
+	if (fstat(fileno(f), &st) == 0
+	    && S_ISREG(st.st_mode)
+	    && st.st_size > 0
+	    && ftell(f) == 0) {
+		p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE, fileno(f), 0);
+		if (p != MAP_FAILED && p[st.st_size - 1] == '\n') {
+			madvise(p, st.st_size, MADV_SEQUENTIAL);
+			text->data = p;
+			text->size = st.st_size;
+			text->is_mapped = 1;
+			return 1;
+		}
+		if (p != MAP_FAILED)
+			munmap(p, st.st_size);
+	}
+	allocated = 0;
+	do {
+		if (text->size + 1 >= allocated) {
+			allocated = allocated == 0 ? 8192 : 2 * allocated;
+			p = realloc(text->data, allocated);
+			if (p == NULL) {
+				log_error("out of memory");
+				free(text->data);
+				text->data = NULL;
+				return 0;
+			}
+			text->data = p;
+		}
+		r = fread(text->data + text->size, 1,
+			  allocated - text->size - 1, f);
+		text->size += r;
+	} while (r > 0);
+	text->data[text->size] = '\0';
+	return 1;
+}
+
+
+/**
+ * Return next line in text with the line ending replaced by '\0',
+ * or NULL at end of text. Length is updated with the line length.
+ */
+static char* text_getline(struct config_text* text, size_t* length)
+{
+	char* start;
+	char* end;
+	size_t len;
+
+	if (text->pos >= text->size)
+		return NULL;
+	start = text->data + text->pos;
+	end = memchr(start, '\n', text->size - text->pos);
+	if (end == NULL)
+		/* Last line, not mapped: there is a '\0' after it. */
+		end = text->data + text->size;
+	len = end - start;
+	text->pos += len + 1;
+	*end = '\0';
+	if (len > 0 && start[len - 1] == '\r')
+		start[len - 1] = '\0';
+	*length = len;
+	return start;
+}
+
+
+static void text_close(struct config_text* text)
+{
+	if (text->is_mapped)
+		munmap(text->data, text->size);
+	else
+		free(text->data);
+	text->data = NULL;
+}
+
+
+/**
+ * Return next token separated by whitespace starting at *cursor,
+ * terminated in place, or NULL if there is none. Like strtok(),
+ * but reentrant.
+ */
+static char* next_token(char** cursor)
+{
+	char* s = *cursor;
+	char* token;
+
+	while (*s == ' ' || *s == '\t')
+		s++;
+	if (*s == '\0') {
+		*cursor = s;
+		return NULL;
+	}
+	token = s;
+	while (*s != '\0' && *s != ' ' && *s != '\t')
+		s++;
+	if (*s != '\0')
+		*s++ = '\0';
+	*cursor = s;
+	return token;
+}
+
+
 void** init_void_array(struct void_array* ar, size_t chunk_size, size_t item_size)
 {
 	ar->chunk_size = chunk_size;
@@ -246,11 +549,37 @@ char* s_strdup(char* string)
 	return ptr;
 }
 
+static inline int hex_value(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+
 ir_code s_strtocode(const char* val)
 {
 	ir_code code = 0;
 	char* endptr;
-
+	const char* s;
+	int digit;
+
+	/* Fast path for the common 0x... form, at most 16 digits. */
+	if (val[0] == '0' && (val[1] == 'x' || val[1] == 'X')) {
+		for (s = val + 2; s - val < 18; s++) {
+			digit = hex_value(*s);
+			if (digit < 0)
+				break;
+			code = (code << 4) | digit;
+		}
+		if (*s == '\0' && s > val + 2)
+			return code;
+		code = 0;
+	}
 	errno = 0;
 	code = strtoull(val, &endptr, 0);
 	if ((code == (uint64_t) -1 && errno == ERANGE) || strlen(endptr) != 0 || strlen(val) == 0) {
@@ -434,112 +763,124 @@ int parseFlags(char* val)
 	return flags;
 }
 
-int defineRemote(char* key, char* val, char* val2, struct ir_remote* rem)
+/**
+ * Define a remote attribute from a key [val [val2]] line.
+ * @param kw keyword_lookup(key).
+ * @param dyncodes Value of the lircd:dynamic-codes option.
+ * @return Number of values used, 0 on errors.
+ */
+static int define_remote(enum keyword		kw,
+			 char*			key,
+			 char*			val,
+			 char*			val2,
+			 struct ir_remote*	rem,
+			 int			dyncodes)
 {
-	if ((strcasecmp("name", key)) == 0) {
+	if (kw == KW_NAME) {
 		if (rem->name != NULL)
 			free((void*)(rem->name));
 		rem->name = s_strdup(val);
 		log_info("Using remote: %s.", val);
 		return 1;
 	}
-	if (options_getboolean("lircd:dynamic-codes")) {
-		if ((strcasecmp("dyncodes_name", key)) == 0) {
+	if (dyncodes) {
+		if (kw == KW_DYNCODES_NAME) {
 			if (rem->dyncodes_name != NULL)
 				free(rem->dyncodes_name);
 			rem->dyncodes_name = s_strdup(val);
 			return 1;
 		}
-	} else if (strcasecmp("driver", key) == 0) {
+		kw = KW_NONE;
+	}
+	switch (kw) {
+	case KW_DRIVER:
 		if (rem->driver != NULL)
 			free((void*)(rem->driver));
 		rem->driver = s_strdup(val);
 		return 1;
-	} else if ((strcasecmp("bits", key)) == 0) {
+	case KW_BITS:
 		rem->bits = s_strtoi(val);
 		return 1;
-	} else if (strcasecmp("flags", key) == 0) {
+	case KW_FLAGS:
 		rem->flags |= parseFlags(val);
 		return 1;
-	} else if (strcasecmp("eps", key) == 0) {
+	case KW_EPS:
 		rem->eps = s_strtoi(val);
 		return 1;
-	} else if (strcasecmp("aeps", key) == 0) {
+	case KW_AEPS:
 		rem->aeps = s_strtoi(val);
 		return 1;
-	} else if (strcasecmp("plead", key) == 0) {
+	case KW_PLEAD:
 		rem->plead = s_strtolirc_t(val);
 		return 1;
-	} else if (strcasecmp("ptrail", key) == 0) {
+	case KW_PTRAIL:
 		rem->ptrail = s_strtolirc_t(val);
 		return 1;
-	} else if (strcasecmp("pre_data_bits", key) == 0) {
+	case KW_PRE_DATA_BITS:
 		rem->pre_data_bits = s_strtoi(val);
 		return 1;
-	} else if (strcasecmp("pre_data", key) == 0) {
+	case KW_PRE_DATA:
 		rem->pre_data = s_strtocode(val);
 		return 1;
-	} else if (strcasecmp("post_data_bits", key) == 0) {
+	case KW_POST_DATA_BITS:
 		rem->post_data_bits = s_strtoi(val);
 		return 1;
-	} else if (strcasecmp("post_data", key) == 0) {
+	case KW_POST_DATA:
 		rem->post_data = s_strtocode(val);
 		return 1;
-	} else if (strcasecmp("gap", key) == 0) {
+	case KW_GAP:
 		if (val2 != NULL)
 			rem->gap2 = s_strtou32(val2);
 		rem->gap = s_strtou32(val);
 		return val2 != NULL ? 2 : 1;
-	} else if (strcasecmp("repeat_gap", key) == 0) {
+	case KW_REPEAT_GAP:
 		rem->repeat_gap = s_strtou32(val);
 		return 1;
-	} else if (strcasecmp("repeat_mask", key) == 0) {
+	case KW_REPEAT_MASK:
 		rem->repeat_mask = s_strtocode(val);
 		return 1;
-	}
-	/* obsolete: use toggle_bit_mask instead */
-	else if (strcasecmp("toggle_bit", key) == 0) {
+	case KW_TOGGLE_BIT:
+		/* obsolete: use toggle_bit_mask instead */
 		rem->toggle_bit = s_strtoi(val);
 		return 1;
-	} else if (strcasecmp("toggle_bit_mask", key) == 0) {
+	case KW_TOGGLE_BIT_MASK:
 		rem->toggle_bit_mask = s_strtocode(val);
 		return 1;
-	} else if (strcasecmp("toggle_mask", key) == 0) {
+	case KW_TOGGLE_MASK:
 		rem->toggle_mask = s_strtocode(val);
 		return 1;
-	} else if (strcasecmp("rc6_mask", key) == 0) {
+	case KW_RC6_MASK:
 		rem->rc6_mask = s_strtocode(val);
 		return 1;
-	} else if (strcasecmp("ignore_mask", key) == 0) {
+	case KW_IGNORE_MASK:
 		rem->ignore_mask = s_strtocode(val);
 		return 1;
-	} else if (strcasecmp("manual_sort", key) == 0) {
+	case KW_MANUAL_SORT:
 		rem->manual_sort = s_strtoi(val);
 		return 1;
-	}
-	/* obsolete name */
-	else if (strcasecmp("repeat_bit", key) == 0) {
+	case KW_REPEAT_BIT:
+		/* obsolete name */
 		rem->toggle_bit = s_strtoi(val);
 		return 1;
-	} else if (strcasecmp("suppress_repeat", key) == 0) {
+	case KW_SUPPRESS_REPEAT:
 		rem->suppress_repeat = s_strtoi(val);
 		return 1;
-	} else if (strcasecmp("min_repeat", key) == 0) {
+	case KW_MIN_REPEAT:
 		rem->min_repeat = s_strtoi(val);
 		return 1;
-	} else if (strcasecmp("min_code_repeat", key) == 0) {
+	case KW_MIN_CODE_REPEAT:
 		rem->min_code_repeat = s_strtoi(val);
 		return 1;
-	} else if (strcasecmp("frequency", key) == 0) {
+	case KW_FREQUENCY:
 		rem->freq = s_strtoui(val);
 		return 1;
-	} else if (strcasecmp("duty_cycle", key) == 0) {
+	case KW_DUTY_CYCLE:
 		rem->duty_cycle = s_strtoui(val);
 		return 1;
-	} else if (strcasecmp("baud", key) == 0) {
+	case KW_BAUD:
 		rem->baud = s_strtoui(val);
 		return 1;
-	} else if (strcasecmp("serial_mode", key) == 0) {
+	case KW_SERIAL_MODE:
 		if (val[0] < '5' || val[0] > '9') {
 			log_error("error in configfile line %d:", line);
 			log_error("bad bit count");
@@ -568,43 +909,49 @@ int defineRemote(char* key, char* val, char* val2, struct ir_remote* rem)
 		else
 			rem->stop_bits = s_strtoui(val + 2) * 2;
 		return 1;
-	} else if (val2 != NULL) {
-		if (strcasecmp("header", key) == 0) {
+	default:
+		break;
+	}
+	if (val2 != NULL) {
+		switch (kw) {
+		case KW_HEADER:
 			rem->phead = s_strtolirc_t(val);
 			rem->shead = s_strtolirc_t(val2);
 			return 2;
-		} else if (strcasecmp("three", key) == 0) {
+		case KW_THREE:
 			rem->pthree = s_strtolirc_t(val);
 			rem->sthree = s_strtolirc_t(val2);
 			return 2;
-		} else if (strcasecmp("two", key) == 0) {
+		case KW_TWO:
 			rem->ptwo = s_strtolirc_t(val);
 			rem->stwo = s_strtolirc_t(val2);
 			return 2;
-		} else if (strcasecmp("one", key) == 0) {
+		case KW_ONE:
 			rem->pone = s_strtolirc_t(val);
 			rem->sone = s_strtolirc_t(val2);
 			return 2;
-		} else if (strcasecmp("zero", key) == 0) {
+		case KW_ZERO:
 			rem->pzero = s_strtolirc_t(val);
 			rem->szero = s_strtolirc_t(val2);
 			return 2;
-		} else if (strcasecmp("foot", key) == 0) {
+		case KW_FOOT:
 			rem->pfoot = s_strtolirc_t(val);
 			rem->sfoot = s_strtolirc_t(val2);
 			return 2;
-		} else if (strcasecmp("repeat", key) == 0) {
+		case KW_REPEAT:
 			rem->prepeat = s_strtolirc_t(val);
 			rem->srepeat = s_strtolirc_t(val2);
 			return 2;
-		} else if (strcasecmp("pre", key) == 0) {
+		case KW_PRE:
 			rem->pre_p = s_strtolirc_t(val);
 			rem->pre_s = s_strtolirc_t(val2);
 			return 2;
-		} else if (strcasecmp("post", key) == 0) {
+		case KW_POST:
 			rem->post_p = s_strtolirc_t(val);
 			rem->post_s = s_strtolirc_t(val2);
 			return 2;
+		default:
+			break;
 		}
 	}
 	if (val2) {
@@ -618,6 +965,13 @@ int defineRemote(char* key, char* val, char* val2, struct ir_remote* rem)
 	return 0;
 }
 
+
+int defineRemote(char* key, char* val, char* val2, struct ir_remote* rem)
+{
+	return define_remote(keyword_lookup(key), key, val, val2, rem,
+			     options_getboolean("lircd:dynamic-codes"));
+}
+
 static int sanityChecks(struct ir_remote* rem, const char* path)
 {
 	struct ir_ncode* codes;
@@ -833,40 +1187,51 @@ ir_remotes_append(struct ir_remote* root, struct ir_remote* what)
 struct ir_remote* read_config(FILE* f, const char* name)
 {
 	struct ir_remote* head;
+	struct ir_remote* rem;
 
-	head = read_config_recursive(f, name, 0);
+	/* ciniparser is not thread safe, workers get the value. */
+	head = read_config_recursive(f, name, 0,
+				     options_getboolean("lircd:dynamic-codes"));
+	/* Uses the global send buffer, thus not done by include workers. */
+	if (head != (void*)-1) {
+		for (rem = head; rem != NULL; rem = rem->next)
+			calculate_signal_lengths(rem);
+	}
 	head = sort_by_bit_count(head);
 	return head;
 }
 
 
 /**
- * Parse a single config file.
+ * Parse a single included config file.
  *
  * @param name Including file path.
  * @paran depth Include depth, increased for each recursive inclusion.
  * @param val include file absolute path, quoted.
- * @param top_rem root of ir_remotes list.
- * @return root of new list, with possibly added remotes.
+ * @param dyncodes Value of the lircd:dynamic-codes option.
+ * @param parsed Set to 1 if the file was parsed, else 0.
+ * @return Remotes in file, NULL or (void*)-1 if the file is broken.
  *
  */
 static struct ir_remote*
-read_included(const char* name, int depth, char* val, struct ir_remote* top_rem)
+read_included(const char* name, int depth, char* val, int dyncodes,
+	      int* parsed)
 {
 	FILE* childFile;
 	const char* childName;
 	struct ir_remote* rem = NULL;
 
+	*parsed = 0;
 	if (depth > MAX_INCLUDES) {
 		log_error("error opening child file defined at %s:%d", name, line);
 		log_error("too many files included");
-		return top_rem;
+		return NULL;
 	}
 	childName = lirc_parse_include(val);
 	if (!childName) {
 		log_error("error parsing child file value defined at line %d:", line);
 		log_error("invalid quoting");
-		return top_rem;
+		return NULL;
 	}
 	childFile = fopen(childName, "r");
 	if (childFile == NULL) {
@@ -875,19 +1240,72 @@ read_included(const char* name, int depth, char* val, struct ir_remote* top_rem)
 		log_error("ignoring this child file for now.");
 		return NULL;
 	}
-	rem = read_config_recursive(childFile, childName, depth + 1);
-	top_rem = ir_remotes_append(top_rem, rem);
+	rem = read_config_recursive(childFile, childName, depth + 1, dyncodes);
+	*parsed = 1;
 	fclose(childFile);
-	return top_rem;
+	return rem;
+}
+
+
+/** Run by each include worker: parse jobs until none is left. */
+static void* include_worker(void* arg)
+{
+	struct include_pool* pool = (struct include_pool*)arg;
+	struct include_job* job;
+	size_t i;
+
+	line = pool->line;
+	while (1) {
+		i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+		if (i >= pool->count)
+			break;
+		job = &pool->jobs[i];
+		job->remotes = read_included(pool->name, pool->depth,
+					     job->path, pool->dyncodes,
+					     &job->parsed);
+	}
+	return NULL;
+}
+
+
+/** Parse all jobs in pool using up to MAX_INCLUDE_THREADS threads. */
+static void run_include_pool(struct include_pool* pool)
+{
+	pthread_t threads[MAX_INCLUDE_THREADS];
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t wanted;
+	size_t started = 0;
+	size_t i;
+
+	wanted = cpus > 0 ? (size_t)cpus : 1;
+	if (wanted > MAX_INCLUDE_THREADS)
+		wanted = MAX_INCLUDE_THREADS;
+	if (wanted > pool->count)
+		wanted = pool->count;
+	/* Current thread is one of the workers. */
+	for (i = 1; i < wanted; i += 1) {
+		if (pthread_create(&threads[started], NULL,
+				   include_worker, pool) != 0) {
+			log_perror_warn("Cannot create include worker");
+			break;
+		}
+		started += 1;
+	}
+	include_worker(pool);
+	for (i = 0; i < started; i += 1)
+		pthread_join(threads[i], NULL);
 }
 
 
 /**
- * Parse all include files matched by glob pattern
+ * Parse all include files matched by glob pattern. Files included
+ * from the top level config file are parsed in parallel, nested
+ * includes sequentially. The results are merged in glob(3) order.
  *
  * @param name Including file path.
  * @paran depth Include depth, increased for each recursive inclusion.
  * @param val path in include parameter, quoted.
+ * @param dyncodes Value of the lircd:dynamic-codes option.
  * @param top_rem root of existing ir_remotes list.
  * @return root of new list, with possibly added remotes.
  *
@@ -895,8 +1313,10 @@ read_included(const char* name, int depth, char* val, struct ir_remote* top_rem)
 static struct ir_remote* read_all_included(const char*		name,
 					   int			depth,
 					   char*		val,
+					   int			dyncodes,
 					   struct ir_remote*	top_rem)
 {
+	struct include_pool pool;
 	int i;
 	glob_t globbuf;
 	char buff[256] = { '\0' };
@@ -906,25 +1326,197 @@ static struct ir_remote* read_all_included(const char*		name,
 	val[strlen(val) - 1] = '\0';
 	lirc_parse_relative(buff, sizeof(buff), val, name);
 	glob(buff, 0, NULL, &globbuf);
+	if (globbuf.gl_pathc == 0) {
+		globfree(&globbuf);
+		return top_rem;
+	}
+	memset(&pool, 0, sizeof(pool));
+	pool.jobs = calloc(globbuf.gl_pathc, sizeof(struct include_job));
+	if (pool.jobs == NULL) {
+		log_error("out of memory");
+		parse_error = 1;
+		globfree(&globbuf);
+		return top_rem;
+	}
+	pool.count = globbuf.gl_pathc;
+	pool.name = name;
+	pool.depth = depth;
+	pool.line = line;
+	pool.dyncodes = dyncodes;
 	for (i = 0; i < globbuf.gl_pathc; i += 1) {
-		snprintf(buff, sizeof(buff), "\"%s\"", globbuf.gl_pathv[i]);
-		top_rem = read_included(name, depth, buff, top_rem);
+		snprintf(pool.jobs[i].path, sizeof(pool.jobs[i].path),
+			 "\"%s\"", globbuf.gl_pathv[i]);
 	}
 	globfree(&globbuf);
+	if (depth == 0 && pool.count > 1)
+		run_include_pool(&pool);
+	else
+		include_worker(&pool);
+	for (i = 0; i < pool.count; i += 1) {
+		/* As when parsed one by one, last parsed file decides. */
+		if (pool.jobs[i].parsed)
+			parse_error = pool.jobs[i].remotes == (void*)-1;
+		top_rem = ir_remotes_append(top_rem, pool.jobs[i].remotes);
+	}
+	free(pool.jobs);
 	return top_rem;
 }
 
 
+static size_t ncode_name_hash(const struct ir_ncode* code)
+{
+	const unsigned char* s = (const unsigned char*)code->name;
+	size_t h = 2166136261u;
+
+	while (*s != '\0')
+		h = (h ^ *s++) * 16777619u;
+	return h;
+}
+
+
+static size_t ncode_value_hash(const struct ir_ncode* code)
+{
+	const struct ir_code_node* node;
+	uint64_t h = code->code;
+
+	for (node = code->next; node != NULL; node = node->next)
+		h = h * 0x100000001b3ULL ^ node->code;
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	return (size_t)(h ^ (h >> 32));
+}
+
+
+/** Return item in ar matching code according to func, or NULL. */
+static void* ncode_index_find(const size_t* table,
+			      size_t size,
+			      size_t hash,
+			      struct void_array* ar,
+			      array_guest_func func,
+			      struct ir_ncode* code)
+{
+	size_t i;
+
+	for (i = hash & (size - 1); table[i] != 0; i = (i + 1) & (size - 1)) {
+		if (func(ar->ptr + (table[i] - 1) * ar->item_size, code))
+			return code;
+	}
+	return NULL;
+}
+
+
+static void ncode_index_insert(size_t* table,
+			       size_t size,
+			       size_t hash,
+			       size_t item)
+{
+	size_t i;
+
+	for (i = hash & (size - 1); table[i] != 0; i = (i + 1) & (size - 1))
+		;
+	table[i] = item + 1;
+}
+
+
+static void ncode_index_free(struct ncode_index* index)
+{
+	free(index->names);
+	free(index->values);
+	memset(index, 0, sizeof(*index));
+}
+
+
+/** Empty index, keeping the tables. */
+static void ncode_index_clear(struct ncode_index* index)
+{
+	index->count = 0;
+	if (index->size > 0) {
+		memset(index->names, 0, index->size * sizeof(size_t));
+		memset(index->values, 0, index->size * sizeof(size_t));
+	}
+}
+
+
+/** Rebuild index with room for at least items, return 0 on errors. */
+static int ncode_index_grow(struct ncode_index* index,
+			    struct void_array* ar,
+			    size_t items)
+{
+	struct ir_ncode* code;
+	size_t size = index->size > 0 ? index->size : 64;
+	size_t i;
+
+	while (size < items * 2)
+		size *= 2;
+	free(index->names);
+	free(index->values);
+	index->size = size;
+	index->names = calloc(size, sizeof(size_t));
+	index->values = calloc(size, sizeof(size_t));
+	if (index->names == NULL || index->values == NULL) {
+		ncode_index_free(index);
+		return 0;
+	}
+	for (i = 0; i < index->count; i += 1) {
+		code = (struct ir_ncode*)(ar->ptr + i * ar->item_size);
+		ncode_index_insert(index->names, size,
+				   ncode_name_hash(code), i);
+		ncode_index_insert(index->values, size,
+				   ncode_value_hash(code), i);
+	}
+	return 1;
+}
+
+
+/**
+ * Add all items in ar not yet indexed. Returns 0 on errors, in which
+ * case index is empty.
+ */
+static int ncode_index_update(struct ncode_index* index, struct void_array* ar)
+{
+	struct ir_ncode* code;
+
+	if ((ar->nr_items + 1) * 2 > index->size) {
+		if (!ncode_index_grow(index, ar, ar->nr_items + 1))
+			return 0;
+	}
+	for (; index->count < ar->nr_items; index->count += 1) {
+		code = (struct ir_ncode*)(ar->ptr + index->count * ar->item_size);
+		ncode_index_insert(index->names, index->size,
+				   ncode_name_hash(code), index->count);
+		ncode_index_insert(index->values, index->size,
+				   ncode_value_hash(code), index->count);
+	}
+	return 1;
+}
+
+
 static void check_ncode_dups(const char* path,
 			     const char* name,
 			     struct void_array* ar,
+			     struct ncode_index* index,
 			     struct ir_ncode* code)
 {
-	if (foreach_void_array(ar, array_guest_ncode_cmp, code) != NULL) {
+	void* name_dup;
+	void* value_dup;
+
+	if (ncode_index_update(index, ar)) {
+		name_dup = ncode_index_find(index->names, index->size,
+					    ncode_name_hash(code), ar,
+					    array_guest_ncode_cmp, code);
+		value_dup = ncode_index_find(index->values, index->size,
+					     ncode_value_hash(code), ar,
+					     array_guest_code_equals, code);
+	} else {
+		name_dup = foreach_void_array(ar, array_guest_ncode_cmp, code);
+		value_dup = foreach_void_array(ar, array_guest_code_equals,
+					       code);
+	}
+	if (name_dup != NULL) {
 		log_notice("%s: %s: Multiple definitions of: %s",
 			   path, name, code->name);
 	}
-	if (foreach_void_array(ar, array_guest_code_equals, code) != NULL) {
+	if (value_dup != NULL) {
 		log_notice("%s: %s: Multiple values for same code: %s",
 			   path, name, code->name);
 	}
@@ -932,64 +1524,64 @@ static void check_ncode_dups(const char* path,
 
 
 static struct ir_remote*
-read_config_recursive(FILE* f, const char* name, int depth)
+read_config_recursive(FILE* f, const char* name, int depth, int dyncodes)
 {
-	char buf[LINE_LEN + 1];
+	struct config_text text;
+	char* buf;
+	char* cursor;
 	char* key;
 	char* val;
 	char* val2;
-	int len, argc;
+	size_t len;
+	int argc;
+	enum keyword kw;
 	struct ir_remote* top_rem = NULL;
 	struct ir_remote* rem = NULL;
+	struct ir_remote* last_rem;
 	struct void_array codes_list, raw_codes, signals;
+	struct ncode_index codes_index = { NULL, NULL, 0, 0 };
 	struct ir_ncode raw_code = { NULL, 0, 0, NULL };
 	struct ir_ncode name_code = { NULL, 0, 0, NULL };
 	struct ir_ncode* code;
 	int mode = ID_none;
+	int include_error = 0;
+	int save_line = line;
+	int save_error = parse_error;
 
 	line = 0;
 	parse_error = 0;
 	log_trace1("parsing '%s'", name);
 
-	while (fgets(buf, LINE_LEN, f) != NULL) {
+	if (!text_open(&text, f))
+		parse_error = 1;
+	while (!parse_error && (buf = text_getline(&text, &len)) != NULL) {
 		line++;
-		len = strlen(buf);
-		if (len == LINE_LEN && buf[len - 1] != '\n') {
+		if (len >= LINE_LEN) {
 			log_error("line %d too long in config file", line);
 			parse_error = 1;
 			break;
 		}
-
-		if (len > 0) {
-			len--;
-			if (buf[len] == '\n')
-				buf[len] = 0;
-		}
-		if (len > 0) {
-			len--;
-			if (buf[len] == '\r')
-				buf[len] = 0;
-		}
 		/* ignore comments */
 		if (buf[0] == '#')
 			continue;
-		key = strtok(buf, whitespace);
+		cursor = buf;
+		key = next_token(&cursor);
 		/* ignore empty lines */
 		if (key == NULL)
 			continue;
-		val = strtok(NULL, whitespace);
+		val = next_token(&cursor);
 		if (val != NULL) {
-			val2 = strtok(NULL, whitespace);
+			val2 = next_token(&cursor);
 			log_trace2("Tokens: \"%s\" \"%s\" \"%s\"", key, val, (val2 == NULL ? "(null)" : val));
-			if (strcasecmp("include", key) == 0) {
-				int save_line = line;
-
+			kw = keyword_lookup(key);
+			if (kw == KW_INCLUDE) {
 				top_rem = read_all_included(name,
 							    depth,
 							    val,
+							    dyncodes,
 							    top_rem);
-				line = save_line;
-			} else if (strcasecmp("begin", key) == 0) {
+				include_error = parse_error;
+			} else if (kw == KW_BEGIN) {
 				if (strcasecmp("codes", val) == 0) {
 					/* init codes mode */
 					log_trace1("    begin codes");
@@ -1003,6 +1595,7 @@ read_config_recursive(FILE* f, const char* name, int depth)
 					}
 
 					init_void_array(&codes_list, 30, sizeof(struct ir_ncode));
+					ncode_index_clear(&codes_index);
 					mode = ID_codes;
 				} else if (strcasecmp("raw_codes", val) == 0) {
 					/* init raw_codes mode */
@@ -1033,9 +1626,11 @@ read_config_recursive(FILE* f, const char* name, int depth)
 					} else {
 						/* create new remote */
 						log_trace1("creating next remote");
+						/* Append after last remote, not from top. */
+						last_rem = rem != NULL ? rem : top_rem;
 						rem = s_malloc(sizeof(struct ir_remote));
 						rem->freq = DEFAULT_FREQ;
-						ir_remotes_append(top_rem, rem);
+						ir_remotes_append(last_rem, rem);
 					}
 				} else if (mode == ID_codes) {
 					code = defineCode(key, val, &name_code);
@@ -1043,10 +1638,11 @@ read_config_recursive(FILE* f, const char* name, int depth)
 						if (val2[0] == '#')
 							break;  /* comment */
 						defineNode(code, val2);
-						val2 = strtok(NULL, whitespace);
+						val2 = next_token(&cursor);
 					}
 					code->current = NULL;
-					check_ncode_dups(name, rem->name, &codes_list, code);
+					check_ncode_dups(name, rem->name, &codes_list,
+							 &codes_index, code);
 					add_void_array(&codes_list, code);
 				} else {
 					log_error("error in configfile line %d:", line);
@@ -1058,7 +1654,7 @@ read_config_recursive(FILE* f, const char* name, int depth)
 						  "in line %d ignored",
 						  rem->name, val, line);
 				}
-			} else if (strcasecmp("end", key) == 0) {
+			} else if (kw == KW_END) {
 				if (strcasecmp("codes", val) == 0) {
 					/* end Codes mode */
 					log_trace1("    end codes");
@@ -1096,7 +1692,7 @@ read_config_recursive(FILE* f, const char* name, int depth)
 						parse_error = 1;
 						break;
 					}
-					if (options_getboolean("lircd:dynamic-codes")) {
+					if (dyncodes) {
 						if (rem->dyncodes_name == NULL)
 							rem->dyncodes_name = s_strdup("unknown");
 						rem->dyncodes[0].name = rem->dyncodes_name;
@@ -1113,7 +1709,7 @@ read_config_recursive(FILE* f, const char* name, int depth)
 						if (val2[0] == '#')
 							break;  /* comment */
 						defineNode(code, val2);
-						val2 = strtok(NULL, whitespace);
+						val2 = next_token(&cursor);
 					}
 					code->current = NULL;
 					add_void_array(&codes_list, code);
@@ -1131,10 +1727,11 @@ read_config_recursive(FILE* f, const char* name, int depth)
 			} else {
 				switch (mode) {
 				case ID_remote:
-					argc = defineRemote(key, val, val2, rem);
+					argc = define_remote(kw, key, val, val2, rem,
+							     dyncodes);
 					if (!parse_error
 					    && ((argc == 1 && val2 != NULL)
-						|| (argc == 2 && val2 != NULL && strtok(NULL, whitespace) != NULL))) {
+						|| (argc == 2 && val2 != NULL && next_token(&cursor) != NULL))) {
 						log_warn("%s: garbage after '%s'"
 							  " token in line %d ignored",
 							  rem->name, key, line);
@@ -1146,18 +1743,19 @@ read_config_recursive(FILE* f, const char* name, int depth)
 						if (val2[0] == '#')
 							break;  /* comment */
 						defineNode(code, val2);
-						val2 = strtok(NULL, whitespace);
+						val2 = next_token(&cursor);
 					}
 					code->current = NULL;
 					check_ncode_dups(name,
 							 rem->name,
 							 &codes_list,
+							 &codes_index,
 							 code);
 					add_void_array(&codes_list, code);
 					break;
 				case ID_raw_codes:
 				case ID_raw_name:
-					if (strcasecmp("name", key) == 0) {
+					if (kw == KW_NAME) {
 						log_trace2("Button: \"%s\"", val);
 						if (mode == ID_raw_name) {
 							raw_code.signals = get_void_array(&signals);
@@ -1196,7 +1794,7 @@ read_config_recursive(FILE* f, const char* name, int depth)
 						if (val2)
 							if (!addSignal(&signals, val2))
 								break;
-						while ((val = strtok(NULL, whitespace)))
+						while ((val = next_token(&cursor)))
 							if (!addSignal(&signals, val))
 								break;
 					}
@@ -1214,6 +1812,8 @@ read_config_recursive(FILE* f, const char* name, int depth)
 		if (parse_error)
 			break;
 	}
+	text_close(&text);
+	ncode_index_free(&codes_index);
 	if (mode != ID_none) {
 		switch (mode) {
 		case ID_raw_name:
@@ -1235,15 +1835,12 @@ read_config_recursive(FILE* f, const char* name, int depth)
 		}
 	}
 	if (parse_error) {
-		static int print_error = 1;
-
-		if (print_error) {
+		/* Failing included file has already logged. */
+		if (!include_error)
 			log_error("reading of file '%s' failed", name);
-			print_error = 0;
-		}
 		free_config(top_rem);
-		if (depth == 0)
-			print_error = 1;
+		line = save_line;
+		parse_error = save_error;
 		return (void*)-1;
 	}
 	/* kick reverse flag */
@@ -1311,10 +1908,10 @@ read_config_recursive(FILE* f, const char* name, int depth)
 				rem->min_code_repeat = 0;
 			}
 		}
-		calculate_signal_lengths(rem);
 		rem = rem->next;
 	}
-
+	line = save_line;
+	parse_error = save_error;
 	return top_rem;
 }
 
@@ -1332,6 +1929,8 @@ void calculate_signal_lengths(struct ir_remote* remote)
 	lirc_t max_pulse = 0, max_space = 0;
 	int first_sum = 1;
 	struct ir_ncode* c = remote->codes;
+	const lirc_t* data;
+	int length;
 	int i;
 
 	while (c->name) {
@@ -1358,13 +1957,15 @@ void calculate_signal_lengths(struct ir_remote* remote)
 							max_signal_length = sum;
 						first_sum = 0;
 					}
-					for (i = 0; i < send_buffer_length(); i++) {
+					length = send_buffer_length();
+					data = send_buffer_data();
+					for (i = 0; i < length; i++) {
 						if (i & 1) {    /* space */
-							if (send_buffer_data()[i] > max_space)
-								max_space = send_buffer_data()[i];
+							if (data[i] > max_space)
+								max_space = data[i];
 						} else {        /* pulse */
-							if (send_buffer_data()[i] > max_pulse)
-								max_pulse = send_buffer_data()[i];
+							if (data[i] > max_pulse)
+								max_pulse = data[i];
 						}
 					}
 				}
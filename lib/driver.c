@@ -13,12 +13,24 @@
 #endif
 
 #include	<stdio.h>
+#include	<time.h>
 #include	"driver.h"
 #include	"config.h"
 #include	"lirc_log.h"
 
 static const logchannel_t logchannel = LOG_LIB;
 
+/** Max number of samples read by each drv_readdata() refill. */
+#define PENDING_SIZE    256
+
+/** Samples read by drv_readdata(), not yet returned. */
+static struct {
+	lirc_t		data[PENDING_SIZE];
+	uint64_t	ts[PENDING_SIZE];
+	int		head;           /**< Next sample to return. */
+	int		tail;           /**< First free slot. */
+} pending;
+
 int get_server_version(void) { return VERSION_NODOTS; }
 
 /**
@@ -89,3 +101,96 @@ int drv_handle_options(const char* options)
 	}
 	return 0;
 }
+
+
+/** Pending samples in driver, not counting the ones in pending. */
+static int driver_pending(void)
+{
+	int count = 0;
+
+	if (drv.drvctl_func == NULL
+	    || drv.drvctl_func(DRVCTL_GET_PENDING, &count) != 0)
+		return 0;
+	return count;
+}
+
+
+int drv_pending(void)
+{
+	return pending.tail - pending.head + driver_pending();
+}
+
+
+void drv_clear_pending(void)
+{
+	pending.head = 0;
+	pending.tail = 0;
+}
+
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/** readdata_bulk() adapter for drivers only providing readdata(). */
+static int readdata_bulk_compat(lirc_t* buf, size_t n, uint64_t* ts,
+				lirc_t timeout)
+{
+	size_t count = 0;
+	lirc_t data;
+
+	if (drv.readdata == NULL)
+		return 0;
+	do {
+		data = drv.readdata(count == 0 ? timeout : 0);
+		if (data == 0)
+			break;
+		buf[count] = data;
+		if (ts != NULL)
+			ts[count] = now_ns();
+		count += 1;
+	} while (count < n && !(data & LIRC_EOF) && driver_pending() > 0);
+	return count;
+}
+
+
+int drv_readdata_bulk(lirc_t* buf, size_t n, uint64_t* ts, lirc_t timeout)
+{
+	size_t count = 0;
+
+	if (n == 0)
+		return 0;
+	if (pending.head < pending.tail) {
+		while (count < n && pending.head < pending.tail) {
+			buf[count] = pending.data[pending.head];
+			if (ts != NULL)
+				ts[count] = pending.ts[pending.head];
+			pending.head += 1;
+			count += 1;
+		}
+		return count;
+	}
+	if (drv.readdata_bulk != NULL)
+		return drv.readdata_bulk(buf, n, ts, timeout);
+	return readdata_bulk_compat(buf, n, ts, timeout);
+}
+
+
+lirc_t drv_readdata(lirc_t timeout, uint64_t* ts)
+{
+	if (pending.head >= pending.tail) {
+		drv_clear_pending();
+		pending.tail = drv_readdata_bulk(pending.data, PENDING_SIZE,
+						 pending.ts, timeout);
+		if (pending.tail == 0)
+			return 0;
+	}
+	if (ts != NULL)
+		*ts = pending.ts[pending.head];
+	return pending.data[pending.head++];
+}
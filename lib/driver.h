@@ -67,6 +67,40 @@ struct option_t {
  */
 int drv_handle_options(const char* options);
 
+/**
+ * Return number of samples buffered by the current driver, see
+ * DRVCTL_GET_PENDING. If > 0, readdata() returns without waiting for
+ * driver fd to become readable.
+ */
+int drv_pending(void);
+
+/**
+ * Read up to n samples from the current driver, using readdata_bulk()
+ * if available, else readdata(). Waits at most timeout (us) for the
+ * first sample, further ones are only returned if available without
+ * waiting. Samples buffered by drv_readdata() are returned first.
+ * @param buf Updated with the samples.
+ * @param n Size of buf and ts.
+ * @param ts If non-NULL, updated with a CLOCK_MONOTONIC timestamp (ns)
+ *     for each sample, see readdata_bulk().
+ * @param timeout Max time to wait (us), 0 waits forever.
+ * @return Number of samples in buf, 0 on timeout and errors.
+ */
+int drv_readdata_bulk(lirc_t* buf, size_t n, uint64_t* ts, lirc_t timeout);
+
+/**
+ * Like readdata(), but reads the driver in batches using
+ * drv_readdata_bulk(). The remaining samples are buffered, and counted
+ * by drv_pending().
+ * @param timeout Max time to wait (us), 0 waits forever.
+ * @param ts If non-NULL, updated with the sample's timestamp.
+ * @return Sample as returned by readdata(), 0 on timeout and errors.
+ */
+lirc_t drv_readdata(lirc_t timeout, uint64_t* ts);
+
+/** Discard samples buffered by drv_readdata() e. g., on driver change. */
+void drv_clear_pending(void);
+
 
 /** Drvctl cmd:  return current state as an int in *arg. */
 #define DRVCTL_GET_STATE                1
@@ -104,6 +138,23 @@ int drv_handle_options(const char* options);
 
 #define DRVCTL_NOTIFY_DECODE            7
 
+/**
+ * Drvctl cmd: get number of samples buffered by driver, which readdata()
+ * will return without reading from fd. Arg is an int* updated on
+ * successful return. Drivers reading more than one sample at a time
+ * should implement this, lircd won't wait for fd to become readable
+ * while there is pending data.
+ */
+#define DRVCTL_GET_PENDING              8
+
+/**
+ * Drvctl cmd: get driver statistics e. g., drop counters. Argument is a
+ * *glob_t as for DRVCTL_GET_DEVICES, updated with one line per counter,
+ * formatted as "name value...". The returned memory is owned by driver
+ * and should be free()'d using DRVCTL_FREE_DEVICES.
+ */
+#define DRVCTL_GET_STATS                9
+
 /** Last well-known command. Remaining is used in driver-specific controls.*/
 #define  DRVCTL_MAX                     128
 
@@ -253,6 +304,23 @@ struct driver {
 	 *    - None          No device is silently configured.
 	 */
 	const char* const  device_hint;
+
+/* API version 4 addons: */
+	/**
+	 * Optional bulk version of readdata(), applications should use
+	 * drv_readdata_bulk() which falls back to readdata() if this is
+	 * NULL. Waits at most timeout (us, 0 waits forever) for the first
+	 * sample; the remaining ones are only returned if available
+	 * without waiting.
+	 * @param buf Updated with up to n samples as returned by readdata().
+	 * @param n Size of buf and ts, > 0.
+	 * @param ts If non-NULL, updated with the CLOCK_MONOTONIC time (ns)
+	 *     when each sample ended. Drivers reading several samples
+	 *     at once might need to estimate it.
+	 * @return Number of samples in buf, 0 on timeout and errors.
+	 */
+	int (*const readdata_bulk)(lirc_t* buf, size_t n, uint64_t* ts,
+				   lirc_t timeout);
 };
 
 /** @} */
@@ -11,9 +11,16 @@
 # include <config.h>
 #endif
 
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <utime.h>
 #include <dirent.h>
 #include <dlfcn.h>
+#include <sys/stat.h>
 
 #ifdef HAVE_TERMIOS_H
 # include <termios.h>
@@ -35,6 +42,12 @@ static const logchannel_t logchannel = LOG_LIB;
 
 static const char* const PLUGIN_FILE_EXTENSION  = "so";
 
+/** Plugin index file in each plugin directory, see plugin_index_update(). */
+static const char* const PLUGIN_INDEX = "plugins.index";
+
+/** First line in a plugin index, identifies the format. */
+static const char* const PLUGIN_INDEX_MAGIC = "# lirc plugin index 1";
+
 
 /** Max number if plugins handled. No point to malloc() this. */
 #define MAX_PLUGINS  256
@@ -50,6 +63,12 @@ typedef struct {
 /** Plugin currently in use, if non-NULL */
 static void* last_plugin = NULL;
 
+/** Argument to index_plugin() and index_driver(). */
+struct index_ctx {
+	FILE*		f;
+	const char*	file;   /**< Basename of current plugin. */
+};
+
 /** Default driver, a placeholder. */
 const struct driver drv_null = {
 	.name		= "null",
@@ -151,6 +170,20 @@ visit_plugin(const char* path, drv_guest_func func, void* arg)
 }
 
 
+/** Store dirpath/file in path, dropping a trailing '/' in dirpath. */
+static void make_path(char* path, size_t size,
+		      const char* dirpath, const char* file)
+{
+	char buff[1024];
+
+	strncpy(buff, dirpath, sizeof(buff) - 1);
+	buff[sizeof(buff) - 1] = '\0';
+	if (buff[0] != '\0' && buff[strlen(buff) - 1] == '/')
+		buff[strlen(buff) - 1] = '\0';
+	snprintf(path, size, "%s/%s", buff, file);
+}
+
+
 /* Apply plugin_guest(path, drv_guest, arg) to all so-files in dir. */
 static struct driver* for_each_plugin_in_dir(const char*	dirpath,
 					     plugin_guest_func	plugin_guest,
@@ -161,7 +194,6 @@ static struct driver* for_each_plugin_in_dir(const char*	dirpath,
 	struct dirent* ent;
 	struct driver* result = (struct driver*)NULL;
 	char path[1024];
-	char buff[1024];
 
 	dir = opendir(dirpath);
 	if (dir == NULL) {
@@ -171,11 +203,7 @@ static struct driver* for_each_plugin_in_dir(const char*	dirpath,
 	while ((ent = readdir(dir)) != NULL) {
 		if (!ends_with_so(ent->d_name))
 			continue;
-		strncpy(buff, dirpath, sizeof(buff) - 1);
-		if (buff[strlen(buff) - 1] == '/')
-			buff[strlen(buff) - 1] = '\0';
-		snprintf(path, sizeof(path),
-			 "%s/%s", buff, ent->d_name);
+		make_path(path, sizeof(path), dirpath, ent->d_name);
 		result = plugin_guest(path, drv_guest, arg);
 		if (result != (struct driver*)NULL)
 			break;
@@ -185,25 +213,28 @@ static struct driver* for_each_plugin_in_dir(const char*	dirpath,
 }
 
 
+/** Return pluginpath, or the default path if it is NULL. */
+static const char* get_pluginpath(const char* pluginpath)
+{
+	if (pluginpath != NULL)
+		return pluginpath;
+	pluginpath = ciniparser_getstring(lirc_options,
+					  "lircd:plugindir",
+					  getenv(PLUGINDIR_VAR));
+	return pluginpath != NULL ? pluginpath : PLUGINDIR;
+}
+
+
 static struct driver* for_each_path(plugin_guest_func	plg_guest,
 				    drv_guest_func	drv_guest,
 				    void*		arg,
 				    const char*		pluginpath_arg)
 {
-	const char* pluginpath;
+	const char* pluginpath = get_pluginpath(pluginpath_arg);
 	char* tmp_path;
 	char* s;
 	struct driver* result = (struct driver*)NULL;
 
-	if (pluginpath_arg == NULL) {
-		pluginpath = ciniparser_getstring(lirc_options,
-						  "lircd:plugindir",
-						  getenv(PLUGINDIR_VAR));
-		if (pluginpath == NULL)
-			pluginpath = PLUGINDIR;
-	} else {
-		pluginpath = pluginpath_arg;
-	}
 	if (strchr(pluginpath, ':') == (char*)NULL) {
 		return for_each_plugin_in_dir(pluginpath,
 					      plg_guest,
@@ -240,6 +271,208 @@ void for_each_plugin(plugin_guest_func plugin_guest,
 }
 
 
+/** drv_guest_func writing an index line for driver to arg's file. */
+static struct driver* index_driver(struct driver* drv, void* arg)
+{
+	struct index_ctx* ctx = (struct index_ctx*)arg;
+
+	fprintf(ctx->f, "%s\t%s\t%d\t0x%x\n",
+		drv->name, ctx->file, drv->api_version, drv->features);
+	return NULL;
+}
+
+
+/**
+ * plugin_guest_func adding all drivers in plugin on path to the index.
+ * Uses a private handle, so the plugin in use is not unloaded.
+ */
+static struct driver*
+index_plugin(const char* path, drv_guest_func func, void* arg)
+{
+	struct index_ctx* ctx = (struct index_ctx*)arg;
+	struct driver** drivers;
+	void* handle;
+
+	handle = dlopen(path, RTLD_NOW);
+	if (handle == NULL) {
+		log_debug("Not indexing %s: %s", path, dlerror());
+		return NULL;
+	}
+	drivers = (struct driver**)dlsym(handle, "hardwares");
+	ctx->file = strrchr(path, '/') + 1;
+	for (; drivers != NULL && *drivers != NULL; drivers++) {
+		if ((*drivers)->name != NULL)
+			func(*drivers, ctx);
+	}
+	dlclose(handle);
+	return NULL;
+}
+
+
+/**
+ * Open the index in dirpath, positioned after the magic line. Returns
+ * NULL if it is missing, has another format or is older than the
+ * directory i. e., plugins might have been added or removed.
+ */
+static FILE* index_open(const char* dirpath)
+{
+	char path[1024];
+	char line[64];
+	struct stat dir_st;
+	struct stat st;
+	FILE* f;
+
+	if (stat(dirpath, &dir_st) != 0)
+		return NULL;
+	make_path(path, sizeof(path), dirpath, PLUGIN_INDEX);
+	f = fopen(path, "r");
+	if (f == NULL)
+		return NULL;
+	if (fstat(fileno(f), &st) != 0
+	    || st.st_mtime < dir_st.st_mtime
+	    || fgets(line, sizeof(line), f) == NULL
+	    || strncmp(line, PLUGIN_INDEX_MAGIC,
+		       strlen(PLUGIN_INDEX_MAGIC)) != 0) {
+		log_debug("Ignoring stale plugin index %s", path);
+		fclose(f);
+		return NULL;
+	}
+	return f;
+}
+
+
+/**
+ * Look up driver name in the index in dirpath.
+ * @return 1 if found, path updated with the plugin. 0 if not in
+ *     index, -1 if there is no valid index.
+ */
+static int index_lookup(const char* dirpath, const char* name,
+			char* path, size_t size)
+{
+	char line[512];
+	char drv_name[128];
+	char file[256];
+	FILE* f;
+
+	f = index_open(dirpath);
+	if (f == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%127s %255s", drv_name, file) != 2)
+			continue;
+		if (strcasecmp(drv_name, name) == 0) {
+			make_path(path, size, dirpath, file);
+			fclose(f);
+			return 1;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+
+/** Write index for all plugins in dirpath, see plugin_index_update(). */
+static int index_write(const char* dirpath)
+{
+	struct index_ctx ctx;
+	char path[1024];
+	char tmp[1060];
+
+	make_path(path, sizeof(path), dirpath, PLUGIN_INDEX);
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+	ctx.f = fopen(tmp, "w");
+	if (ctx.f == NULL) {
+		log_perror_warn("Cannot create plugin index %s", tmp);
+		return -1;
+	}
+	fprintf(ctx.f, "%s\n", PLUGIN_INDEX_MAGIC);
+	for_each_plugin_in_dir(dirpath, index_plugin, index_driver, &ctx);
+	if (fclose(ctx.f) != 0 || rename(tmp, path) != 0) {
+		log_perror_warn("Cannot write plugin index %s", path);
+		unlink(tmp);
+		return -1;
+	}
+	/* rename() touched the directory, index must not look stale. */
+	utime(path, NULL);
+	log_info("Updated plugin index %s", path);
+	return 0;
+}
+
+
+int plugin_index_update(const char* pluginpath)
+{
+	char* tmp_path;
+	char* s;
+	int r = 0;
+
+	pluginpath = get_pluginpath(pluginpath);
+	tmp_path = alloca(strlen(pluginpath) + 1);
+	strcpy(tmp_path, pluginpath);
+	for (s = strtok(tmp_path, ":"); s != NULL; s = strtok(NULL, ":")) {
+		if (index_write(s) != 0)
+			r = -1;
+	}
+	return r;
+}
+
+
+/**
+ * Rewrite missing or stale indexes in writable plugin directories if
+ * the lircd:update-plugin-index option is set.
+ */
+static void refresh_indexes(void)
+{
+	const char* pluginpath = get_pluginpath(NULL);
+	char* tmp_path;
+	FILE* f;
+	char* s;
+
+	if (!options_getboolean("lircd:update-plugin-index"))
+		return;
+	tmp_path = alloca(strlen(pluginpath) + 1);
+	strcpy(tmp_path, pluginpath);
+	for (s = strtok(tmp_path, ":"); s != NULL; s = strtok(NULL, ":")) {
+		f = index_open(s);
+		if (f != NULL)
+			fclose(f);
+		else if (access(s, W_OK) == 0)
+			index_write(s);
+	}
+}
+
+
+/**
+ * Find driver using the plugin indexes, loading just the plugin
+ * containing it. Returns NULL if not found or if some directory
+ * searched lacks a valid index; the caller then scans all plugins.
+ */
+static struct driver* find_indexed_driver(const char* name)
+{
+	const char* pluginpath = get_pluginpath(NULL);
+	struct driver* found = (struct driver*)NULL;
+	char path[1024];
+	char* tmp_path;
+	char* s;
+	int r;
+
+	tmp_path = alloca(strlen(pluginpath) + 1);
+	strcpy(tmp_path, pluginpath);
+	for (s = strtok(tmp_path, ":"); s != NULL; s = strtok(NULL, ":")) {
+		r = index_lookup(s, name, path, sizeof(path));
+		if (r == -1)
+			break;
+		if (r == 1) {
+			log_debug("Using plugin index for %s: %s", name, path);
+			found = visit_plugin(path, match_hw_name, (void*)name);
+			break;
+		}
+	}
+	return found;
+}
+
+
 /** Best effort attempt to get column width and # columns for output file. */
 static void get_columns(FILE* f, char_array names, int* cols, int* width)
 {
@@ -298,6 +531,7 @@ int hw_choose_driver(const char* name)
 {
 	struct driver* found;
 
+	drv_clear_pending();
 	if (name == NULL) {
 		memcpy(&drv, &drv_null, sizeof(struct driver));
 		drv.fd = -1;
@@ -306,9 +540,20 @@ int hw_choose_driver(const char* name)
 	if (strcasecmp(name, "dev/input") == 0)
 		/* backwards compatibility */
 		name = "devinput";
-	found = for_each_driver(match_hw_name, (void*)name, NULL);
+	found = find_indexed_driver(name);
+	if (found == (struct driver*)NULL) {
+		refresh_indexes();
+		found = for_each_driver(match_hw_name, (void*)name, NULL);
+	}
 	if (found != (struct driver*)NULL) {
-		memcpy(&drv, found, sizeof(struct driver));
+		if (found->api_version >= 4) {
+			memcpy(&drv, found, sizeof(struct driver));
+		} else {
+			/* Older plugins' struct ends before readdata_bulk. */
+			memset(&drv, 0, sizeof(struct driver));
+			memcpy(&drv, found,
+			       offsetof(struct driver, readdata_bulk));
+		}
 		drv.fd = -1;
 		return 0;
 	}
@@ -14,6 +14,10 @@
  *    - The "lircd:pluginpath" option.
  *    - The LIRC_PLUGIN_PATH environment variable.
  *    - The hardcoded PLUGINDIR constant.
+ *
+ *  Each plugin directory may contain an index file mapping driver names
+ *  to plugins, used by hw_choose_driver() to load only the plugin it
+ *  needs. See plugin_index_update().
  */
 
 #include "driver.h"
@@ -71,6 +75,18 @@ void for_each_plugin(plugin_guest_func plugin_guest,
 		     void* arg,
 		     const char* pluginpath);
 
+/**
+ * Write an index of all drivers (name, plugin file, api version and
+ * features) to each directory in pluginpath. The index is used by
+ * hw_choose_driver() while it is newer than its directory, otherwise
+ * all plugins are scanned. If the lircd:update-plugin-index option is
+ * set, hw_choose_driver() then also rewrites the index if the
+ * directory is writable.
+ * @param pluginpath ':'-separated path, NULL for the default one.
+ * @return 0 if all indexes were written, else -1.
+ */
+int plugin_index_update(const char* pluginpath);
+
 
 #ifdef __cplusplus
 }
@@ -123,14 +123,11 @@ void ir_remote_init(int use_dyncodes)
 }
 
 
-static lirc_t time_left(struct timeval* current,
-			struct timeval* last,
-			lirc_t		gap)
+static lirc_t time_left(uint64_t current, uint64_t last, lirc_t gap)
 {
-	unsigned long secs, diff;
+	unsigned long diff;
 
-	secs = current->tv_sec - last->tv_sec;
-	diff = 1000000 * secs + current->tv_usec - last->tv_usec;
+	diff = time_elapsed_ns(last, current);
 	return (lirc_t)(diff < gap ? gap - diff : 0);
 }
 
@@ -613,19 +610,17 @@ static uint64_t set_code(struct ir_remote*		remote,
 		      ir_code			toggle_bit_mask_state,
 		      struct decode_ctx_t*	ctx)
 {
-	struct timeval current;
 	static struct ir_remote* last_decoded = NULL;
 
 	log_trace("found: %s", found->name);
 
-	gettimeofday(&current, NULL);
 	log_trace("%lx %lx %lx %d %d %d %d %d %d %d",
 		  remote, last_remote, last_decoded,
 		  remote == last_decoded,
 		  found == remote->last_code, found->next != NULL,
 		  found->current != NULL, ctx->repeat_flag,
-		  time_elapsed(&remote->last_send,
-			       &current) < 1000000,
+		  time_elapsed_ns(remote->last_send,
+				  ctx->timestamp) < 1000000,
 		  (!has_toggle_bit_mask(remote)
 		   ||
 		   toggle_bit_mask_state ==
@@ -643,7 +638,7 @@ static uint64_t set_code(struct ir_remote*		remote,
 	    (found == remote->last_code
 	     || (found->next != NULL && found->current != NULL))
 	    && ctx->repeat_flag
-	    && time_elapsed(&remote->last_send, &current) < 1000000
+	    && time_elapsed_ns(remote->last_send, ctx->timestamp) < 1000000
 	    && (!has_toggle_bit_mask(remote)
 		|| toggle_bit_mask_state == remote->toggle_bit_mask_state)) {
 		if (has_toggle_mask(remote)) {
@@ -671,7 +666,7 @@ static uint64_t set_code(struct ir_remote*		remote,
 	last_decoded = remote;
 	if (found->current == NULL)
 		remote->last_code = found;
-	remote->last_send = current;
+	remote->last_send = ctx->timestamp;
 	remote->min_remaining_gap = ctx->min_remaining_gap;
 	remote->max_remaining_gap = ctx->max_remaining_gap;
 
@@ -740,6 +735,7 @@ char* decode_all(struct ir_remote* remotes)
 	decoding = remote = remotes;
 	while (remote) {
 		log_trace("trying \"%s\" remote", remote->name);
+		memset(&ctx, 0, sizeof(ctx));
 		if (curr_driver->decode_func(remote, &ctx)) {
 			ncode = get_code(remote,
 					 ctx.pre, ctx.code, ctx.post,
@@ -755,6 +751,11 @@ char* decode_all(struct ir_remote* remotes)
 						PACKET_EOF, sizeof(message));
 					return message;
 				}
+				/* Driver didn't report a timestamp. */
+				if (ctx.timestamp == 0)
+					ctx.timestamp = time_now_ns();
+				if (ctx.captured == 0)
+					ctx.captured = ctx.timestamp;
 				ctx.code = set_code(remote,
 						    ncode,
 						    toggle_bit_mask_state,
@@ -787,7 +788,9 @@ char* decode_all(struct ir_remote* remotes)
 				register_button_press(remote,
 						      remote->last_code,
 						      ctx.code,
-						      reps);
+						      reps,
+						      ctx.timestamp,
+						      ctx.captured);
 				len = write_message(message, PACKET_SIZE + 1,
 						    remote->name,
 						    remote->last_code->name,
@@ -823,12 +826,10 @@ int send_ir_ncode(struct ir_remote* remote, struct ir_ncode* code, int delay)
 	if (delay) {
 		/* insert pause when needed: */
 		if (remote->last_code != NULL) {
-			struct timeval current;
 			unsigned long usecs;
 
-			gettimeofday(&current, NULL);
-			usecs = time_left(&current,
-					  &remote->last_send,
+			usecs = time_left(time_now_ns(),
+					  remote->last_send,
 					  remote->min_remaining_gap * 2);
 			if (usecs > 0) {
 				if (repeat_remote == NULL || remote !=
@@ -841,7 +842,7 @@ int send_ir_ncode(struct ir_remote* remote, struct ir_ncode* code, int delay)
 	ret = curr_driver->send_func(remote, code);
 
 	if (ret) {
-		gettimeofday(&remote->last_send, NULL);
+		remote->last_send = time_now_ns();
 		remote->last_code = code;
 	}
 	return ret;
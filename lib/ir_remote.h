@@ -23,6 +23,8 @@
 
 #include <sys/types.h>
 #include <sys/time.h>
+#include <stdint.h>
+#include <time.h>
 #include <unistd.h>
 #include <string.h>
 #include <math.h>
@@ -417,6 +419,27 @@ static inline unsigned long time_elapsed(const struct timeval*	last,
 	return diff;
 }
 
+/**
+ * Current time (ns) from the monotonic clock. Unlike gettimeofday() this
+ * is not affected by wall clock steps e. g., from NTP.
+ */
+static inline uint64_t time_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Elapsed time (us) between two time_now_ns() values, like
+ * time_elapsed(). Only works if last <= current.
+ */
+static inline unsigned long time_elapsed_ns(uint64_t last, uint64_t current)
+{
+	return (current - last) / 1000;
+}
+
 static inline ir_code gen_mask(int bits)
 {
 	int i;
@@ -141,6 +141,8 @@ struct decode_ctx_t {
 	int	repeat_flag;            /**< True if code is a repeated one. */
 	lirc_t	max_remaining_gap;      /**< Estimated max time of trailing gap.*/
 	lirc_t	min_remaining_gap;      /**< Estimated min time of trailing gap.*/
+	uint64_t timestamp;             /**< time_now_ns() of frame, 0 if unset. */
+	uint64_t captured;              /**< time_now_ns() when first sample of frame was received, 0 if unknown. */
 };
 
 
@@ -223,7 +225,7 @@ struct ir_remote {
 	struct ir_ncode*	last_code;                      /**< code received or sent last */
 	struct ir_ncode*	toggle_code;                    /**< toggle code received or sent last */
 	int			reps;
-	struct timeval		last_send;                      /**< time last_code was received or sent */
+	uint64_t		last_send;                      /**< time_now_ns() when last_code was received or sent */
 	lirc_t			min_remaining_gap;              /**< remember gap for CONST_LENGTH remotes */
 	lirc_t			max_remaining_gap;              /**< gap range */
 
@@ -234,6 +236,7 @@ struct ir_remote {
 	lirc_t			min_pulse_length, max_pulse_length;
 	lirc_t			min_space_length, max_space_length;
 	int			release_detected;       /**< set by release generator */
+	int			no_early_emit;          /**< set when early emitted code wasn't followed by a gap */
 	int			manual_sort;            /**< If set in any remote, disables automatic sorting. */
 	struct ir_remote*	next;
 };
@@ -121,6 +121,8 @@ int availabledata(void)
 		.fd = curr_driver->fd, .events = POLLIN, .revents = 0};
 	int ret;
 
+	if (drv_pending() > 0)
+		return 1;
 	do {
 		do {
 			ret = curl_poll(&pfd, 1, 0);
@@ -144,7 +146,7 @@ void flushhw(void)
 	switch (curr_driver->rec_mode) {
 	case LIRC_MODE_MODE2:
 		while (availabledata())
-			curr_driver->readdata(0);
+			drv_readdata(0, NULL);
 		return;
 	case LIRC_MODE_LIRCCODE:
 		size = curr_driver->code_length / CHAR_BIT;
@@ -506,6 +508,8 @@ static int mywaitfordata(uint32_t maxusec)
 	struct pollfd pfd  = {
 		.fd = curr_driver->fd, .events = POLLIN, .revents = 0};
 
+	if (drv_pending() > 0)
+		return 1;
 	do {
 		ret = curl_poll(&pfd, 1, maxusec / 1000);
 	} while (ret == -1 && errno == EINTR);
@@ -1213,12 +1217,12 @@ enum get_gap_status get_gap_length(struct gap_state*	state,
 		free_lengths(&(state->gaps));
 		return STS_GAP_TIMEOUT;
 	}
-	gettimeofday(&(state->start), NULL);
+	state->start = time_now_ns();
 	while (availabledata())
 		curr_driver->rec_func(NULL);
-	gettimeofday(&(state->end), NULL);
+	state->end = time_now_ns();
 	if (state->flag) {
-		state->gap = time_elapsed(&(state->last), &(state->start));
+		state->gap = time_elapsed_ns(state->last, state->start);
 		add_length(&(state->gaps), state->gap);
 		merge_lengths(state->gaps);
 		state->maxcount = 0;
@@ -1393,7 +1397,7 @@ enum lengths_status get_lengths(struct lengths_state* state,
 	static int lastmaxcount = 0;
 	enum lengths_status again = STS_LEN_AGAIN;
 
-	state->data = curr_driver->readdata(10000000);
+	state->data = drv_readdata(10000000, NULL);
 	if (!state->data) {
 		state->retval = 0;
 		return STS_LEN_TIMEOUT;
@@ -1790,6 +1794,7 @@ int do_analyse(const struct opts* opts, struct main_state* state)
 	struct ir_remote* r;
 
 	memcpy((void*)curr_driver, &hw_emulation, sizeof(struct driver));
+	drv_clear_pending();
 	f = fopen(opts->filename, "r");
 	if (f == NULL) {
 		fprintf(stderr, "Cannot open file: %s\n", opts->filename);
@@ -1976,7 +1981,7 @@ enum button_status record_buttons(struct button_state*	btn_state,
 				timeout = 10000000;
 			else
 				timeout = remote.gap * 5;
-			btn_state->data = curr_driver->readdata(timeout);
+			btn_state->data = drv_readdata(timeout, NULL);
 			if (!btn_state->data) {
 				if (btn_state->count == 0)
 					return STS_BTN_TIMEOUT;
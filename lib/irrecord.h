@@ -185,9 +185,9 @@ struct main_state {
 struct gap_state {
 	struct lengths* scan;
 	struct lengths* gaps;
-	struct timeval	start;
-	struct timeval	end;
-	struct timeval	last;
+	uint64_t	start;
+	uint64_t	end;
+	uint64_t	last;
 	int		flag;
 	int		maxcount;
 	int		lastmaxcount;
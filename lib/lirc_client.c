@@ -20,6 +20,7 @@
 # include <config.h>
 #endif
 
+#include <ctype.h>
 #include <errno.h>
 #include <libgen.h>
 #include <limits.h>
@@ -71,6 +72,61 @@ struct filestack_t {
 	struct filestack_t*	parent;
 };
 
+/** Size of the lirc_reader buffer, also the max line length. */
+#define LIRC_READER_SIZE (16 * PACKET_SIZE)
+
+/** Buffered line reader, opaque in lirc_client.h. */
+struct lirc_reader {
+	int	fd;                             /**< File read from. */
+	int	head;                           /**< First unconsumed byte. */
+	int	tail;                           /**< First free buffer index. */
+	char	buffer[LIRC_READER_SIZE + 1];   /**< Line IO buffer. */
+};
+
+struct lirc_config_index;
+
+/**
+ * A lirc_config as allocated by lirc_readconfig(). The public part comes
+ * first, private data is kept here to keep lirc_client.h ABI stable.
+ */
+struct lirc_config_priv {
+	struct lirc_config		pub;
+	struct lirc_config_index*	index;  /**< Dispatch index. */
+};
+
+/** A lirc_code as allocated by lirc_readconfig(), with interned names. */
+struct lirc_code_priv {
+	struct lirc_code	pub;
+	unsigned int		remote_id;
+	unsigned int		button_id;
+};
+
+/** A lirc_config_entry as allocated by lirc_readconfig(), ditto. */
+struct lirc_entry_priv {
+	struct lirc_config_entry	pub;
+	unsigned int			prog_id;
+	unsigned int			mode_id;
+	unsigned int			change_mode_id;
+};
+
+static inline struct lirc_code_priv* code_priv(const struct lirc_code* code)
+{
+	return (struct lirc_code_priv*)code;
+}
+
+static inline struct lirc_entry_priv*
+entry_priv(const struct lirc_config_entry* entry)
+{
+	return (struct lirc_entry_priv*)entry;
+}
+
+/** Return the dispatch index of a config from lirc_readconfig(). */
+static inline struct lirc_config_index*
+config_index(const struct lirc_config* config)
+{
+	return ((const struct lirc_config_priv*)config)->index;
+}
+
 
 /** protocol state. */
 enum packet_state {
@@ -94,7 +150,7 @@ unsigned int lirc_flags(char* string);
 static int lirc_lircd = -1;
 static int lirc_verbose = 0;
 static char* lirc_prog = NULL;
-static char* lirc_buffer = NULL;
+static struct lirc_reader lirc_code_reader = { -1, 0, 0, { '\0' } };
 
 char* prog;
 
@@ -362,6 +418,15 @@ int lirc_init(const char* prog, int verbose)
 }
 
 
+static void reader_init(struct lirc_reader* reader, int fd)
+{
+	reader->fd = fd;
+	reader->head = 0;
+	reader->tail = 0;
+	reader->buffer[0] = '\0';
+}
+
+
 int lirc_deinit(void)
 {
 	int r = 0;
@@ -370,10 +435,7 @@ int lirc_deinit(void)
 		free(lirc_prog);
 		lirc_prog = NULL;
 	}
-	if (lirc_buffer != NULL) {
-		free(lirc_buffer);
-		lirc_buffer = NULL;
-	}
+	reader_init(&lirc_code_reader, -1);
 	if (lirc_lircd != -1) {
 		r = close(lirc_lircd);
 		lirc_lircd = -1;
@@ -601,7 +663,7 @@ int lirc_mode(char* token, char* token2, char** mode,
 		if (token2 == NULL) {
 			if (new_entry == NULL) {
 				new_entry = (struct lirc_config_entry*)
-					    malloc(sizeof(struct lirc_config_entry));
+					    malloc(sizeof(struct lirc_entry_priv));
 				if (new_entry == NULL) {
 					lirc_printf("%s: out of memory\n",
 						    lirc_prog);
@@ -1045,6 +1107,409 @@ static void lirc_freeconfigentries(struct lirc_config_entry* first)
 }
 
 
+/** Symbol id of a '*' remote or button. */
+#define LIRC_SYM_ALL UINT_MAX
+
+/**
+ * Interned case-folded names. Ids start at 1, 0 means no name or a
+ * name which is not in the table.
+ */
+struct lirc_symtab {
+	char**		names;          /**< By id - 1. */
+	unsigned int	count;
+	unsigned int*	table;          /**< Open addressing, ids. */
+	unsigned int	size;           /**< A power of 2. */
+};
+
+/**
+ * A bucket in the dispatch index: entries for one (remote, button)
+ * pair where either may be LIRC_SYM_ALL, as ordinals in file order.
+ */
+struct lirc_index_bucket {
+	unsigned int			remote_id;
+	unsigned int			button_id;
+	unsigned int*			items;
+	unsigned int			count;
+	unsigned int			size;
+	struct lirc_index_bucket*	next;   /**< Hash chain. */
+};
+
+/**
+ * Dispatch index for lirc_code2char(). Entries with a single code which
+ * doesn't use toggle_reset are only affected by events matching the
+ * code, and are found in the buckets. All other entries (sequences,
+ * toggle_reset, no code, remote and button both '*') may change state
+ * on any event and are in the always list.
+ */
+struct lirc_config_index {
+	struct lirc_config_entry**	entries;        /**< By ordinal. */
+	unsigned int			count;
+	unsigned int			next;   /**< Ordinal of config->next. */
+	unsigned int			mode_id;        /**< current_mode. */
+	struct lirc_symtab		symbols;
+	struct lirc_index_bucket	always;
+	struct lirc_index_bucket**	table;
+	unsigned int			table_size;     /**< A power of 2. */
+};
+
+/** Iterates candidate entries for an event in file order. */
+struct lirc_index_cursor {
+	const struct lirc_index_bucket*	buckets[4];
+	unsigned int			pos[4];
+	unsigned int			ordinal;        /**< Last returned. */
+};
+
+
+static unsigned int symtab_hash(const char* s, size_t len)
+{
+	unsigned int h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ (unsigned char)tolower(s[i])) * 16777619u;
+	return h;
+}
+
+
+/** Return id of the len first chars in s, 0 if not interned. */
+static unsigned int
+symtab_lookup(const struct lirc_symtab* symtab, const char* s, size_t len)
+{
+	unsigned int i;
+	unsigned int id;
+
+	if (s == NULL || symtab->size == 0)
+		return 0;
+	i = symtab_hash(s, len) & (symtab->size - 1);
+	for (; (id = symtab->table[i]) != 0; i = (i + 1) & (symtab->size - 1)) {
+		if (strncasecmp(symtab->names[id - 1], s, len) == 0
+		    && symtab->names[id - 1][len] == '\0')
+			return id;
+	}
+	return 0;
+}
+
+
+static int symtab_grow(struct lirc_symtab* symtab)
+{
+	unsigned int size = symtab->size > 0 ? 2 * symtab->size : 64;
+	unsigned int* table;
+	char** names;
+	unsigned int i;
+	unsigned int id;
+
+	names = realloc(symtab->names, size / 2 * sizeof(char*));
+	if (names == NULL)
+		return 0;
+	symtab->names = names;
+	table = calloc(size, sizeof(unsigned int));
+	if (table == NULL)
+		return 0;
+	for (id = 1; id <= symtab->count; id++) {
+		i = symtab_hash(names[id - 1], strlen(names[id - 1]));
+		for (i &= size - 1; table[i] != 0; i = (i + 1) & (size - 1))
+			;
+		table[i] = id;
+	}
+	free(symtab->table);
+	symtab->table = table;
+	symtab->size = size;
+	return 1;
+}
+
+
+/**
+ * Return id of s, adding it if required. LIRC_ALL is LIRC_SYM_ALL,
+ * NULL is 0. Returns -1 if out of memory.
+ */
+static int symtab_intern(struct lirc_symtab* symtab,
+			 const char* s, unsigned int* id)
+{
+	unsigned int i;
+
+	if (s == NULL || s == LIRC_ALL) {
+		*id = s == NULL ? 0 : LIRC_SYM_ALL;
+		return 0;
+	}
+	*id = symtab_lookup(symtab, s, strlen(s));
+	if (*id != 0)
+		return 0;
+	if (symtab->count + 1 > symtab->size / 2 && !symtab_grow(symtab))
+		return -1;
+	symtab->names[symtab->count] = strdup(s);
+	if (symtab->names[symtab->count] == NULL)
+		return -1;
+	*id = ++symtab->count;
+	i = symtab_hash(s, strlen(s)) & (symtab->size - 1);
+	while (symtab->table[i] != 0)
+		i = (i + 1) & (symtab->size - 1);
+	symtab->table[i] = *id;
+	return 0;
+}
+
+
+static void symtab_free(struct lirc_symtab* symtab)
+{
+	unsigned int i;
+
+	for (i = 0; i < symtab->count; i++)
+		free(symtab->names[i]);
+	free(symtab->names);
+	free(symtab->table);
+}
+
+
+static unsigned int index_hash(unsigned int remote_id, unsigned int button_id)
+{
+	return (remote_id * 2654435761u) ^ (button_id * 40503u);
+}
+
+
+static struct lirc_index_bucket*
+index_find(const struct lirc_config_index* index,
+	   unsigned int remote_id, unsigned int button_id)
+{
+	struct lirc_index_bucket* b;
+
+	b = index->table[index_hash(remote_id, button_id)
+			 & (index->table_size - 1)];
+	for (; b != NULL; b = b->next) {
+		if (b->remote_id == remote_id && b->button_id == button_id)
+			return b;
+	}
+	return NULL;
+}
+
+
+static int index_bucket_add(struct lirc_index_bucket* b, unsigned int ordinal)
+{
+	unsigned int* items;
+
+	if (b->count == b->size) {
+		b->size = b->size > 0 ? 2 * b->size : 4;
+		items = realloc(b->items, b->size * sizeof(unsigned int));
+		if (items == NULL)
+			return 0;
+		b->items = items;
+	}
+	b->items[b->count++] = ordinal;
+	return 1;
+}
+
+
+static void lirc_freeindex(struct lirc_config_index* index)
+{
+	struct lirc_index_bucket* b;
+	struct lirc_index_bucket* next;
+	unsigned int i;
+
+	if (index == NULL)
+		return;
+	for (i = 0; i < index->table_size; i++) {
+		for (b = index->table[i]; b != NULL; b = next) {
+			next = b->next;
+			free(b->items);
+			free(b);
+		}
+	}
+	free(index->table);
+	free(index->always.items);
+	free(index->entries);
+	symtab_free(&index->symbols);
+	free(index);
+}
+
+
+/** Intern all names used by entry, return -1 if out of memory. */
+static int lirc_internentry(struct lirc_symtab*		symtab,
+			    struct lirc_config_entry*	entry)
+{
+	struct lirc_entry_priv* e = entry_priv(entry);
+	struct lirc_code* code;
+
+	if (symtab_intern(symtab, entry->prog, &e->prog_id) == -1
+	    || symtab_intern(symtab, entry->mode, &e->mode_id) == -1
+	    || symtab_intern(symtab, entry->change_mode,
+			     &e->change_mode_id) == -1)
+		return -1;
+	for (code = entry->code; code != NULL; code = code->next) {
+		if (symtab_intern(symtab, code->remote,
+				  &code_priv(code)->remote_id) == -1
+		    || symtab_intern(symtab, code->button,
+				     &code_priv(code)->button_id) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+
+/**
+ * Intern all names in entries and build the dispatch index, NULL if
+ * out of memory.
+ */
+static struct lirc_config_index*
+lirc_buildindex(struct lirc_config_entry* first)
+{
+	struct lirc_config_index* index;
+	struct lirc_config_entry* scan;
+	struct lirc_index_bucket* b;
+	struct lirc_code* code;
+	struct lirc_code_priv* c;
+	unsigned int h;
+	unsigned int i;
+
+	index = calloc(1, sizeof(struct lirc_config_index));
+	if (index == NULL)
+		return NULL;
+	for (scan = first; scan != NULL; scan = scan->next)
+		index->count++;
+	index->table_size = 16;
+	while (index->table_size < index->count)
+		index->table_size *= 2;
+	index->entries = calloc(index->count + 1,
+				sizeof(struct lirc_config_entry*));
+	index->table = calloc(index->table_size,
+			      sizeof(struct lirc_index_bucket*));
+	if (index->entries == NULL || index->table == NULL)
+		goto nomem;
+	for (scan = first, i = 0; scan != NULL; scan = scan->next, i++) {
+		index->entries[i] = scan;
+		if (lirc_internentry(&index->symbols, scan) == -1)
+			goto nomem;
+		code = scan->code;
+		if (code == NULL || code->next != NULL
+		    || (scan->flags & toggle_reset)
+		    || (code_priv(code)->remote_id == LIRC_SYM_ALL
+			&& code_priv(code)->button_id == LIRC_SYM_ALL)) {
+			if (!index_bucket_add(&index->always, i))
+				goto nomem;
+			continue;
+		}
+		c = code_priv(code);
+		b = index_find(index, c->remote_id, c->button_id);
+		if (b == NULL) {
+			b = calloc(1, sizeof(struct lirc_index_bucket));
+			if (b == NULL)
+				goto nomem;
+			b->remote_id = c->remote_id;
+			b->button_id = c->button_id;
+			h = index_hash(c->remote_id, c->button_id);
+			b->next = index->table[h & (index->table_size - 1)];
+			index->table[h & (index->table_size - 1)] = b;
+		}
+		if (!index_bucket_add(b, i))
+			goto nomem;
+	}
+	return index;
+
+nomem:
+	lirc_freeindex(index);
+	return NULL;
+}
+
+
+/** Update config->current_mode and its symbol id. */
+static void lirc_setcurrentmode(struct lirc_config* config, const char* mode)
+{
+	struct lirc_config_index* index = config_index(config);
+
+	free(config->current_mode);
+	config->current_mode = mode ? strdup(mode) : NULL;
+	index->mode_id =
+		config->current_mode == NULL ? 0 :
+		symtab_lookup(&index->symbols, config->current_mode,
+			      strlen(config->current_mode));
+}
+
+
+/** Return ordinal of config->next. */
+static unsigned int index_next_ordinal(const struct lirc_config* config)
+{
+	const struct lirc_config_index* index = config_index(config);
+	unsigned int i;
+
+	if (config->next == config->first)
+		return 0;
+	if (index->next < index->count
+	    && index->entries[index->next] == config->next)
+		return index->next;
+	for (i = 0; i < index->count; i++) {
+		if (index->entries[i] == config->next)
+			break;
+	}
+	return i;
+}
+
+
+/** Return next candidate from cursor, or NULL. */
+static struct lirc_config_entry*
+index_cursor_next(const struct lirc_config_index* index,
+		  struct lirc_index_cursor* cursor)
+{
+	const struct lirc_index_bucket* b;
+	unsigned int best = index->count;
+	int k;
+	int found = -1;
+
+	for (k = 0; k < 4; k++) {
+		b = cursor->buckets[k];
+		if (b != NULL && cursor->pos[k] < b->count
+		    && b->items[cursor->pos[k]] < best) {
+			best = b->items[cursor->pos[k]];
+			found = k;
+		}
+	}
+	if (found == -1)
+		return NULL;
+	cursor->pos[found]++;
+	cursor->ordinal = best;
+	return index->entries[best];
+}
+
+
+/**
+ * Set up cursor over the entries which may react on an event with
+ * given remote and button ids, starting at config->next. Return first
+ * candidate or NULL.
+ */
+static struct lirc_config_entry*
+index_cursor_init(const struct lirc_config* config,
+		  struct lirc_index_cursor* cursor,
+		  unsigned int remote_id,
+		  unsigned int button_id)
+{
+	const struct lirc_config_index* index = config_index(config);
+	const struct lirc_index_bucket* b;
+	unsigned int start;
+	unsigned int lo;
+	unsigned int hi;
+	unsigned int mid;
+	int k;
+
+	if (config->next == NULL)
+		return NULL;
+	cursor->buckets[0] = &index->always;
+	cursor->buckets[1] = index_find(index, remote_id, button_id);
+	cursor->buckets[2] = index_find(index, remote_id, LIRC_SYM_ALL);
+	cursor->buckets[3] = index_find(index, LIRC_SYM_ALL, button_id);
+	start = index_next_ordinal(config);
+	for (k = 0; k < 4; k++) {
+		b = cursor->buckets[k];
+		lo = 0;
+		hi = b != NULL ? b->count : 0;
+		while (lo < hi) {
+			mid = (lo + hi) / 2;
+			if (b->items[mid] < start)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		cursor->pos[k] = lo;
+	}
+	return index_cursor_next(index, cursor);
+}
+
+
 static void
 parse_shebang(char* line, int depth, const char* path, char* buff, size_t size)
 {
@@ -1249,7 +1714,7 @@ static int lirc_readconfig_only_internal(const char*		file,
 					struct lirc_code* code;
 
 					code = (struct lirc_code*)
-					       malloc(sizeof(struct lirc_code));
+					       malloc(sizeof(struct lirc_code_priv));
 					if (code == NULL) {
 						free(token2);
 						lirc_printf(
@@ -1393,28 +1858,39 @@ static int lirc_readconfig_only_internal(const char*		file,
 		free(mode);
 	}
 	if (ret == 0) {
+		struct lirc_config_priv* priv;
 		char* startupmode;
 
-		*config = (struct lirc_config*)
-			  malloc(sizeof(struct lirc_config));
-		if (*config == NULL) {
+		priv = (struct lirc_config_priv*)
+		       malloc(sizeof(struct lirc_config_priv));
+		if (priv == NULL) {
+			*config = NULL;
 			lirc_printf("%s: out of memory\n", lirc_prog);
 			lirc_freeconfigentries(first);
 			return -1;
 		}
+		*config = &priv->pub;
 		(*config)->first = first;
 		(*config)->next = first;
 		startupmode = lirc_startupmode((*config)->first);
-		(*config)->current_mode =
-			startupmode ? strdup(startupmode) : NULL;
+		(*config)->current_mode = NULL;
 		if (lircrc_class[0] != '\0')
 			(*config)->lircrc_class = strdup(lircrc_class);
 		else
 			(*config)->lircrc_class = NULL;
 		(*config)->sockfd = -1;
-		if (full_name != NULL) {
-			*full_name = save_full_name;
-			save_full_name = NULL;
+		priv->index = lirc_buildindex(first);
+		if (priv->index == NULL) {
+			lirc_printf("%s: out of memory\n", lirc_prog);
+			lirc_freeconfig(*config);
+			*config = NULL;
+			ret = -1;
+		} else {
+			lirc_setcurrentmode(*config, startupmode);
+			if (full_name != NULL) {
+				*full_name = save_full_name;
+				save_full_name = NULL;
+			}
 		}
 	} else {
 		*config = NULL;
@@ -1531,6 +2007,55 @@ int lirc_readconfig_only(const char*		file,
 }
 
 
+int lirc_subscribe(struct lirc_config* config)
+{
+	static const char* const request = "SUBSCRIBE\n";
+	static const char* const reply = "BEGIN\nSUBSCRIBE\nSUCCESS\nEND\n";
+	char buffer[PACKET_SIZE + 1];
+	struct sockaddr_un addr;
+	socklen_t len = sizeof(addr);
+	size_t done;
+	ssize_t r;
+	int sockfd;
+
+	if (config->sockfd == -1) {
+		lirc_printf("%s: not connected to lircrcd\n", lirc_prog);
+		return -1;
+	}
+	/* Use same lircrcd as config, also when started with --output. */
+	if (getpeername(config->sockfd, (struct sockaddr*)&addr, &len) == -1) {
+		lirc_perror(lirc_prog);
+		return -1;
+	}
+	sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sockfd == -1) {
+		lirc_perror(lirc_prog);
+		return -1;
+	}
+	if (connect(sockfd, (struct sockaddr*)&addr, len) == -1
+	    || lirc_identify(sockfd) != LIRC_RET_SUCCESS
+	    || write(sockfd, request, strlen(request)) != (ssize_t)strlen(request)) {
+		close(sockfd);
+		return -1;
+	}
+	/*
+	 * Pushed strings may follow the reply directly, don't read past it
+	 * as lirc_command_run() would.
+	 */
+	for (done = 0; done < strlen(reply); done += r) {
+		r = read(sockfd, buffer + done, strlen(reply) - done);
+		if (r <= 0)
+			break;
+	}
+	if (done < strlen(reply) || strncmp(buffer, reply, done) != 0) {
+		lirc_printf("%s: lircrcd SUBSCRIBE failed\n", lirc_prog);
+		close(sockfd);
+		return -1;
+	}
+	return sockfd;
+}
+
+
 void lirc_freeconfig(struct lirc_config* config)
 {
 	if (config != NULL) {
@@ -1541,6 +2066,7 @@ void lirc_freeconfig(struct lirc_config* config)
 		if (config->lircrc_class != NULL)
 			free(config->lircrc_class);
 		lirc_freeconfigentries(config->first);
+		lirc_freeindex(config_index(config));
 		free(config->current_mode);
 		free(config);
 	}
@@ -1556,18 +2082,18 @@ static void lirc_clearmode(struct lirc_config* config)
 	scan = config->first;
 	while (scan != NULL) {
 		if (scan->change_mode != NULL)
-			if (strcasecmp(scan->change_mode,
-				       config->current_mode) == 0)
+			if (entry_priv(scan)->change_mode_id
+			    == config_index(config)->mode_id)
 				scan->flags &= ~ecno;
 		scan = scan->next;
 	}
-	free(config->current_mode);
-	config->current_mode = NULL;
+	lirc_setcurrentmode(config, NULL);
 }
 
 
 static char* lirc_execute(struct lirc_config*		config,
-			  struct lirc_config_entry*	scan)
+			  struct lirc_config_entry*	scan,
+			  unsigned int			prog_id)
 {
 	char* s;
 	int do_once = 1;
@@ -1575,8 +2101,7 @@ static char* lirc_execute(struct lirc_config*		config,
 	if (scan->flags & mode)
 		lirc_clearmode(config);
 	if (scan->change_mode != NULL) {
-		free(config->current_mode);
-		config->current_mode = strdup(scan->change_mode);
+		lirc_setcurrentmode(config, scan->change_mode);
 		if (scan->flags & once) {
 			if (scan->flags & ecno)
 				do_once = 0;
@@ -1586,7 +2111,7 @@ static char* lirc_execute(struct lirc_config*		config,
 	}
 	if (scan->next_config != NULL
 	    && scan->prog != NULL
-	    && (lirc_prog == NULL || strcasecmp(scan->prog, lirc_prog) == 0)
+	    && (lirc_prog == NULL || entry_priv(scan)->prog_id == prog_id)
 	    && do_once == 1) {
 		s = scan->next_config->string;
 		scan->next_config = scan->next_config->next;
@@ -1634,9 +2159,21 @@ static int rep_filter(struct lirc_config_entry* scan, int rep)
 	return 0;
 }
 
+/** Return true if code, possibly using wildcards, matches given ids. */
+static int code_matches(const struct lirc_code*	code,
+			unsigned int			remote_id,
+			unsigned int			button_id)
+{
+	const struct lirc_code_priv* c = code_priv(code);
+
+	return (c->remote_id == LIRC_SYM_ALL || c->remote_id == remote_id)
+	       && (c->button_id == LIRC_SYM_ALL || c->button_id == button_id);
+}
+
+
 static int lirc_iscode(struct lirc_config_entry*	scan,
-		       char*				remote,
-		       char*				button,
+		       unsigned int			remote_id,
+		       unsigned int			button_id,
 		       int				rep)
 {
 	struct lirc_code* codes;
@@ -1646,26 +2183,22 @@ static int lirc_iscode(struct lirc_config_entry*	scan,
 		return rep_filter(scan, rep);
 
 	/* remote/button match? */
-	if (scan->next_code->remote == LIRC_ALL
-	    || strcasecmp(scan->next_code->remote, remote) == 0) {
-		if (scan->next_code->button == LIRC_ALL
-		    || strcasecmp(scan->next_code->button, button) == 0) {
-			int iscode = 0;
-			/* button sequence? */
-			if (scan->code->next == NULL || rep == 0) {
-				scan->next_code = scan->next_code->next;
-				if (scan->code->next != NULL)
-					iscode = 1;
-			}
-			/* sequence completed? */
-			if (scan->next_code == NULL) {
-				scan->next_code = scan->code;
-				if (scan->code->next != NULL ||
-				    rep_filter(scan, rep))
-					iscode = 2;
-			}
-			return iscode;
+	if (code_matches(scan->next_code, remote_id, button_id)) {
+		int iscode = 0;
+		/* button sequence? */
+		if (scan->code->next == NULL || rep == 0) {
+			scan->next_code = scan->next_code->next;
+			if (scan->code->next != NULL)
+				iscode = 1;
+		}
+		/* sequence completed? */
+		if (scan->next_code == NULL) {
+			scan->next_code = scan->code;
+			if (scan->code->next != NULL ||
+			    rep_filter(scan, rep))
+				iscode = 2;
 		}
+		return iscode;
 	}
 
 	if (rep != 0)
@@ -1688,33 +2221,18 @@ static int lirc_iscode(struct lirc_config_entry*	scan,
 		prev = scan->code;
 		next = codes;
 		while (next != scan->next_code) {
-			if (prev->remote == LIRC_ALL
-			    || strcasecmp(prev->remote, next->remote) == 0) {
-				if (prev->button == LIRC_ALL
-				    || strcasecmp(prev->button,
-						  next->button) == 0) {
-					prev = prev->next;
-					next = next->next;
-				} else {
-					flag = 0;
-					break;
-				}
-			} else {
+			if (!code_matches(prev, code_priv(next)->remote_id,
+					  code_priv(next)->button_id)) {
 				flag = 0;
 				break;
 			}
+			prev = prev->next;
+			next = next->next;
 		}
-		if (flag == 1) {
-			if (prev->remote == LIRC_ALL
-			    || strcasecmp(prev->remote, remote) == 0) {
-				if (prev->button == LIRC_ALL
-				    || strcasecmp(prev->button, button) == 0) {
-					if (rep == 0) {
-						scan->next_code = prev->next;
-						return 0;
-					}
-				}
-			}
+		if (flag == 1 && rep == 0
+		    && code_matches(prev, remote_id, button_id)) {
+			scan->next_code = prev->next;
+			return 0;
 		}
 		codes = codes->next;
 	}
@@ -1739,49 +2257,74 @@ char* lirc_ir2char(struct lirc_config* config, char* code)
 }
 
 
+/**
+ * Like strtok(3), but leaves the string as is: returns next token
+ * starting at *pos and sets len to its length, or returns NULL.
+ */
+static const char* lirc_token(const char** pos, const char* delims, size_t* len)
+{
+	const char* s = *pos + strspn(*pos, delims);
+
+	if (*s == '\0') {
+		*pos = s;
+		return NULL;
+	}
+	*len = strcspn(s, delims);
+	*pos = s[*len] == '\0' ? s + *len : s + *len + 1;
+	return s;
+}
+
+
 static int lirc_code2char_internal(struct lirc_config*	config,
 				   char*		code,
 				   char**		string,
 				   char**		prog)
 {
+	struct lirc_config_index* index = config_index(config);
+	const struct lirc_symtab* symbols = &index->symbols;
 	int rep;
-	char* backup;
-	char* remote;
-	char* button;
+	const char* pos;
+	const char* remote;
+	const char* button;
+	size_t remote_len;
+	size_t button_len;
+	unsigned int remote_id;
+	unsigned int button_id;
+	unsigned int prog_id;
 	char* s = NULL;
 	struct lirc_config_entry* scan;
+	struct lirc_index_cursor cursor;
 	int exec_level;
 	int quit_happened;
 
 	*string = NULL;
 	if (sscanf(code, "%*x %x %*s %*s\n", &rep) == 1) {
-		backup = strdup(code);
-		if (backup == NULL)
-			return -1;
-
-		strtok(backup, " ");
-		strtok(NULL, " ");
-		button = strtok(NULL, " ");
-		remote = strtok(NULL, "\n");
+		pos = code;
+		lirc_token(&pos, " ", &button_len);
+		lirc_token(&pos, " ", &button_len);
+		button = lirc_token(&pos, " ", &button_len);
+		remote = lirc_token(&pos, "\n", &remote_len);
 
-		if (button == NULL || remote == NULL) {
-			free(backup);
+		if (button == NULL || remote == NULL)
 			return 0;
-		}
 
-		scan = config->next;
+		/* Names are matched by symbol id from here. */
+		remote_id = symtab_lookup(symbols, remote, remote_len);
+		button_id = symtab_lookup(symbols, button, button_len);
+		prog_id = lirc_prog == NULL ? 0 :
+			  symtab_lookup(symbols, lirc_prog, strlen(lirc_prog));
+
+		/* Entries not in cursor can't react on this event. */
+		scan = index_cursor_init(config, &cursor, remote_id, button_id);
 		quit_happened = 0;
 		while (scan != NULL) {
-			exec_level = lirc_iscode(scan, remote, button, rep);
+			exec_level = lirc_iscode(scan, remote_id, button_id, rep);
 			if (exec_level > 0 &&
 			    (scan->mode == NULL ||
-			     (scan->mode != NULL &&
-			      config->current_mode != NULL &&
-			      strcasecmp(scan->mode,
-					 config->current_mode) == 0)) &&
+			     entry_priv(scan)->mode_id == index->mode_id) &&
 			    quit_happened == 0) {
 				if (exec_level > 1) {
-					s = lirc_execute(config, scan);
+					s = lirc_execute(config, scan, prog_id);
 					if (s != NULL && prog != NULL)
 						*prog = scan->prog;
 				} else {
@@ -1790,16 +2333,16 @@ static int lirc_code2char_internal(struct lirc_config*	config,
 				if (scan->flags & quit) {
 					quit_happened = 1;
 					config->next = NULL;
-					scan = scan->next;
+					scan = index_cursor_next(index, &cursor);
 					continue;
 				} else if (s != NULL) {
 					config->next = scan->next;
+					index->next = cursor.ordinal + 1;
 					break;
 				}
 			}
-			scan = scan->next;
+			scan = index_cursor_next(index, &cursor);
 		}
-		free(backup);
 		if (s != NULL) {
 			*string = s;
 			return 0;
@@ -1815,18 +2358,16 @@ int lirc_code2char(struct lirc_config* config, char* code, char** string)
 	lirc_cmd_ctx cmd;
 	static char static_buff[PACKET_SIZE];
 	int ret;
-	char* my_code;
-	char* pos;
-
-	my_code = strdup(code);
-	pos = rindex(my_code, '\n');
-	if (pos != NULL)
-		*pos = '\0';
-	ret = lirc_command_init(&cmd, "CODE %s\n", my_code);
-	free(my_code);
-	if (ret != 0)
-		return -1;
+	const char* pos;
+
 	if (config->sockfd != -1) {
+		pos = strrchr(code, '\n');
+		ret = lirc_command_init(&cmd, "CODE %.*s\n",
+					(int)(pos != NULL ?
+					      pos - code : strlen(code)),
+					code);
+		if (ret != 0)
+			return -1;
 		do
 			ret = lirc_command_run(&cmd, config->sockfd);
 		while (ret == EAGAIN || ret == EWOULDBLOCK);
@@ -1878,59 +2419,92 @@ char* lirc_nextir(void)
 
 int lirc_nextcode(char** code)
 {
-	static int packet_size = PACKET_SIZE;
-	static int end_len = 0;
-	ssize_t len = 0;
-	char* end;
-	char c;
+	const char* line;
+	size_t len;
+	int r;
 
 	*code = NULL;
-	if (lirc_buffer == NULL) {
-		lirc_buffer = (char*)malloc(packet_size + 1);
-		if (lirc_buffer == NULL) {
-			lirc_printf("%s: out of memory\n", lirc_prog);
-			return -1;
-		}
-		lirc_buffer[0] = 0;
-	}
-	while ((end = strchr(lirc_buffer, '\n')) == NULL) {
-		if (end_len >= packet_size) {
-			char* new_buffer;
+	r = lirc_nextcodes(&line, 1);
+	if (r <= 0)
+		return r;
+	/* Old interface: malloc()'d, including the newline. */
+	len = strlen(line);
+	*code = (char*)malloc(len + 2);
+	if (*code == NULL)
+		return -1;
+	memcpy(*code, line, len);
+	(*code)[len] = '\n';
+	(*code)[len + 1] = '\0';
+	return 0;
+}
 
-			packet_size += PACKET_SIZE;
-			new_buffer =
-				(char*)realloc(lirc_buffer, packet_size + 1);
-			if (new_buffer == NULL)
-				return -1;
-			lirc_buffer = new_buffer;
-		}
-		len = read(lirc_lircd, lirc_buffer + end_len,
-			   packet_size - end_len);
-		if (len <= 0) {
-			if (len == -1 && errno == EAGAIN)
+
+int lirc_nextcodes(const char** codes, int max)
+{
+	if (lirc_code_reader.fd != lirc_lircd)
+		reader_init(&lirc_code_reader, lirc_lircd);
+	return lirc_reader_read(&lirc_code_reader, codes, max);
+}
+
+
+lirc_reader* lirc_reader_new(int fd)
+{
+	lirc_reader* reader;
+
+	reader = (lirc_reader*)malloc(sizeof(struct lirc_reader));
+	if (reader != NULL)
+		reader_init(reader, fd);
+	return reader;
+}
+
+
+void lirc_reader_free(lirc_reader* reader)
+{
+	free(reader);
+}
+
+
+int lirc_reader_read(lirc_reader* reader, const char** lines, int max)
+{
+	char* buf = reader->buffer;
+	char* end;
+	ssize_t len;
+	int count = 0;
+
+	if (memchr(buf + reader->head, '\n', reader->tail - reader->head)
+	    == NULL) {
+		/* No complete line: move partial one to start and read. */
+		reader->tail -= reader->head;
+		memmove(buf, buf + reader->head, reader->tail);
+		reader->head = 0;
+		if (reader->tail < LIRC_READER_SIZE) {
+			len = read(reader->fd, buf + reader->tail,
+				   LIRC_READER_SIZE - reader->tail);
+			if (len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
 				return 0;
-			else
+			if (len <= 0)
 				return -1;
+			reader->tail += len;
+		}
+		if (reader->tail == LIRC_READER_SIZE
+		    && memchr(buf, '\n', reader->tail) == NULL) {
+			/* Overlong line, return what we have. */
+			buf[reader->tail] = '\0';
+			lines[0] = buf;
+			reader->head = reader->tail;
+			return 1;
 		}
-		end_len += len;
-		lirc_buffer[end_len] = 0;
-		/* return if next code not yet available completely */
-		end = strchr(lirc_buffer, '\n');
+	}
+	while (count < max && reader->head < reader->tail) {
+		end = (char*)memchr(buf + reader->head, '\n',
+				    reader->tail - reader->head);
 		if (end == NULL)
-			return 0;
+			break;
+		*end = '\0';
+		lines[count++] = buf + reader->head;
+		reader->head = end - buf + 1;
 	}
-	/* copy first line to buffer (code) and move remaining chars to
-	 * lirc_buffers start */
-	end++;
-	end_len = strlen(end);
-	c = end[0];
-	end[0] = 0;
-	*code = strdup(lirc_buffer);
-	end[0] = c;
-	memmove(lirc_buffer, end, end_len + 1);
-	if (*code == NULL)
-		return -1;
-	return 0;
+	return count;
 }
 
 
@@ -1986,8 +2560,7 @@ const char* lirc_setmode(struct lirc_config* config, const char* mode)
 		}
 		return NULL;
 	}
-	free(config->current_mode);
-	config->current_mode = mode ? strdup(mode) : NULL;
+	lirc_setcurrentmode(config, mode);
 	return config->current_mode;
 }
 
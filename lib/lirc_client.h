@@ -65,6 +65,9 @@
  *         purposes here the returned code is just an opaque handle. It
  *         will sometimes return on a timeout without any data available, thus
  *         the `if (code == NULL) continue` statement.
+ *       - Applications handling many events could instead use
+ *         lirc_nextcodes() which returns all buffered codes after a single
+ *         read without allocating any memory.
  *       - lirc_code2char() translates the code handle to one ore more
  *         application specific string as defined in the licrrc file. Since
  *         more than one string can be returned  lirc_code2char() should be
@@ -194,6 +197,9 @@ typedef struct {
 	char*	next;                           /**< Next newline-separated word in buffer.*/
 } lirc_cmd_ctx;
 
+/** Opaque buffered line reader for lircd sockets, see lirc_reader_read(). */
+typedef struct lirc_reader lirc_reader;
+
 /**
  * Initial setup: connect to lircd socket.
  *
@@ -250,6 +256,54 @@ char* lirc_ir2char(struct lirc_config* config, char* code);
  */
 int lirc_nextcode(char** code);
 
+/**
+ * Create a lirc_reader reading from given file.
+ *
+ * @param fd Open file connected to e. g., a lircd output socket. It is
+ *     not closed by lirc_reader_free().
+ * @return New reader to be freed using lirc_reader_free(), or NULL if
+ *     out of memory.
+ * @since 0.10.2
+ */
+lirc_reader* lirc_reader_new(int fd);
+
+/**
+ * Free a reader created by lirc_reader_new(), NULL is ignored.
+ * @since 0.10.2
+ */
+void lirc_reader_free(lirc_reader* reader);
+
+/**
+ * Get all complete lines available from a reader, reading at most once
+ * from the underlying file and only if no complete line is buffered.
+ *
+ * The lines are borrowed from the reader's buffer: they are NUL-terminated
+ * without trailing newline and valid until next call using the same
+ * reader. Lines longer than the internal 4 kB buffer are split.
+ *
+ * @param reader Created using lirc_reader_new().
+ * @param lines On exit, the first return value items are filled in.
+ * @param max Size of lines, >= 1.
+ * @return Number of lines, 0 if none is available or -1 on errors
+ *     and end of file.
+ * @since 0.10.2
+ */
+int lirc_reader_read(lirc_reader* reader, const char** lines, int max);
+
+/**
+ * Get all available codes from the lircd daemon, like
+ * lirc_reader_read() on the socket opened by lirc_init(). This does not
+ * allocate any memory, the codes are valid until next call or
+ * lirc_deinit().
+ *
+ * @param codes On exit, the first return value items are filled in with
+ *     code strings without trailing newline.
+ * @param max Size of codes, >= 1.
+ * @return Number of codes, 0 if none is available or -1 on errors.
+ * @since 0.10.2
+ */
+int lirc_nextcodes(const char** codes, int max);
+
 /**
  * Translate a code string to an application string using .lircrc.
  * An translation might return more than one string so this function should
@@ -296,6 +350,23 @@ int lirc_code2charprog(struct lirc_config* config,
  */
 size_t lirc_getsocketname(const char* id, char* buf, size_t size);
 
+/**
+ * Let lircrcd push the application strings for this program instead of
+ * translating each code using lirc_code2char(). lircrcd then reads the
+ * events from lircd itself and translates each of them once for all
+ * subscribed clients. Modes are still shared as before.
+ *
+ * The returned connection only carries the pushed strings, one per
+ * line, and could be read using lirc_reader_read(). Commands like
+ * lirc_setmode() still use the connection in config.
+ *
+ * @param config Parsed lircrc file as obtained from lirc_readconfig(),
+ *     connected to lircrcd i. e., config->sockfd != -1.
+ * @return Open file descriptor, or -1 on errors.
+ * @since 0.10.2
+ */
+int lirc_subscribe(struct lirc_config* config);
+
 /**
  * Get mode  defined  in lircrc. Will use lircrcd if available, else
  * local data.
@@ -16,8 +16,11 @@
 #include "lirc/drv_enum.h"
 #include "lirc/ir_remote_types.h"
 #include "lirc/lirc_log.h"
+#include "lirc/lirc_trace.h"
 #include "lirc/driver.h"
 #include "lirc/ir_remote.h"
+#include "lirc/modulate.h"
+#include "lirc/reader_thread.h"
 #include "lirc/receive.h"
 #include "lirc/transmit.h"
 
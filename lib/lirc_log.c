@@ -19,6 +19,11 @@
 
 
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -58,6 +63,51 @@ static int nodaemon = 0;
 
 static const int PRIO_LEN = 16; /**< Longest priority label, some margin. */
 
+/** Number of records in async ring, must be a power of 2. */
+#define LOG_RING_SIZE 1024
+
+/** Max length of an async log message, longer are truncated. */
+#define LOG_RECORD_LEN 512
+
+/** Max time (ms) the async writer sleeps while not woken up. */
+static const int LOG_WRITER_SLEEP_MS = 20;
+
+/** Wake up the writer each time this many records are added. */
+#define LOG_WAKEUP_RECORDS (LOG_RING_SIZE / 4)
+
+/**
+ * A preformatted message in the async ring. seq implements the slot
+ * protocol of a bounded MPMC queue (Dmitry Vyukov): the slot at
+ * position pos is free when seq == pos and holds a record when
+ * seq == pos + 1.
+ */
+struct log_record {
+	unsigned long	seq;
+	loglevel_t	prio;
+	struct timespec	ts;
+	char		text[LOG_RECORD_LEN];
+};
+
+/** Async logging state, ring is NULL unless started. */
+static struct {
+	struct log_record*	ring;
+	unsigned long		enqueue_pos;
+	unsigned long		dequeue_pos;
+	unsigned long		dropped;
+	unsigned long		reported_dropped;
+	int			draining;
+	int			stop;
+	int			producers;      /**< Threads in async_push(). */
+	int			fatal_fd;       /**< Used by async_fatal(). */
+	int			wakeup[2];      /**< Pipe waking up writer. */
+	pthread_t		writer;
+} async_log;
+
+static const int fatal_signals[] = {
+	SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT, 0 };
+static struct sigaction old_fatal_actions[sizeof(fatal_signals) /
+					  sizeof(fatal_signals[0])];
+
 
 static const char* prio2text(int prio)
 {
@@ -136,6 +186,7 @@ int lirc_log_open(const char* _progname, int _nodaemon, loglevel_t level)
 
 int lirc_log_close(void)
 {
+	lirc_log_async_stop();
 	if (use_syslog) {
 		closelog();
 		return 0;
@@ -147,14 +198,10 @@ int lirc_log_close(void)
 }
 
 
-int lirc_log_reopen(void)
+static int reopen_logfile(void)
 {
 	struct stat s;
 
-	if (use_syslog)
-		/* Don't need to do anything; this is syslogd's task */
-		return 0;
-
 	log_info("closing logfile");
 	if (-1 == fstat(fileno(lf), &s)) {
 		perror("Invalid logfile!");
@@ -176,6 +223,26 @@ int lirc_log_reopen(void)
 }
 
 
+int lirc_log_reopen(void)
+{
+	int async;
+	int r;
+
+	if (use_syslog)
+		/* Don't need to do anything; this is syslogd's task */
+		return 0;
+
+	/* The writer thread must not use lf while reopening. */
+	async = async_log.ring != NULL;
+	if (async)
+		lirc_log_async_stop();
+	r = reopen_logfile();
+	if (async && r == 0)
+		lirc_log_async_start();
+	return r;
+}
+
+
 int lirc_log_setlevel(loglevel_t level)
 {
 	if (level >= LIRC_MIN_LOGLEVEL && level <= LIRC_MAX_LOGLEVEL) {
@@ -263,6 +330,287 @@ void perrorf(const char* format, ...)
 }
 
 
+/** Write a formatted message line to the logfile, no flush. */
+static void write_logline(FILE*			f,
+			  loglevel_t		prio,
+			  const struct timespec*	ts,
+			  const char*		text)
+{
+	char currents[32];
+
+	ctime_r(&ts->tv_sec, currents);
+	fprintf(f, "%15.15s.%06ld %s %s: %s: %s\n",
+		currents + 4, ts->tv_nsec / 1000, hostname, progname,
+		prio2text(prio), text);
+}
+
+
+/** Write a record to syslog or logfile. */
+static void write_record(const struct log_record* rec)
+{
+	if (use_syslog)
+		syslog(min(7, rec->prio), "%s: %s",
+		       prio2text(rec->prio), rec->text);
+	else if (lf)
+		write_logline(lf, rec->prio, &rec->ts, rec->text);
+}
+
+
+static void wakeup_writer(void)
+{
+	ssize_t r;
+
+	/* Errors, notably a full pipe, are harmless. */
+	r = write(async_log.wakeup[1], "", 1);
+	(void)r;
+}
+
+
+/** Push a formatted message to the async ring, return 0 if full. */
+static int async_push(struct log_record*	ring,
+		      loglevel_t		prio,
+		      const char*		format_str,
+		      va_list			ap)
+{
+	struct log_record* rec;
+	unsigned long pos;
+	unsigned long seq;
+	long dif;
+
+	pos = __atomic_load_n(&async_log.enqueue_pos, __ATOMIC_RELAXED);
+	while (1) {
+		rec = &ring[pos & (LOG_RING_SIZE - 1)];
+		seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+		dif = (long)seq - (long)pos;
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&async_log.enqueue_pos,
+							&pos, pos + 1, 1,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			__atomic_add_fetch(&async_log.dropped, 1,
+					   __ATOMIC_RELAXED);
+			return 0;
+		} else {
+			pos = __atomic_load_n(&async_log.enqueue_pos,
+					      __ATOMIC_RELAXED);
+		}
+	}
+	rec->prio = prio;
+	clock_gettime(CLOCK_REALTIME, &rec->ts);
+	vsnprintf(rec->text, sizeof(rec->text), format_str, ap);
+	__atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+	/* Avoid overflow on bursts. */
+	if ((pos + 1) % LOG_WAKEUP_RECORDS == 0)
+		wakeup_writer();
+	return 1;
+}
+
+
+/**
+ * Write record to fatal_fd using write(2) only, for async_fatal().
+ * No timestamp, it would require non async-signal-safe functions.
+ */
+static void write_record_fatal(const struct log_record* rec)
+{
+	char line[PRIO_LEN + LOG_RECORD_LEN + 4];
+	const char* prio = prio2text(rec->prio);
+	size_t len = strlen(prio);
+	size_t text_len = strnlen(rec->text, LOG_RECORD_LEN - 1);
+	ssize_t r;
+
+	if (len > PRIO_LEN)
+		len = PRIO_LEN;
+	memcpy(line, prio, len);
+	memcpy(line + len, ": ", 2);
+	len += 2;
+	memcpy(line + len, rec->text, text_len);
+	len += text_len;
+	line[len++] = '\n';
+	r = write(async_log.fatal_fd, line, len);
+	(void)r;
+}
+
+
+/**
+ * Write all records available in the ring. Only one thread at a time
+ * can drain; returns -1 if someone else is already doing it, else
+ * the number of written records. If fatal, only async-signal-safe
+ * functions are used.
+ */
+static int async_drain(struct log_record* ring, int fatal)
+{
+	struct log_record* rec;
+	unsigned long pos;
+	unsigned long dropped;
+	int count = 0;
+
+	if (__atomic_exchange_n(&async_log.draining, 1, __ATOMIC_ACQUIRE))
+		return -1;
+	pos = async_log.dequeue_pos;
+	while (1) {
+		rec = &ring[pos & (LOG_RING_SIZE - 1)];
+		if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != pos + 1)
+			break;
+		if (fatal)
+			write_record_fatal(rec);
+		else
+			write_record(rec);
+		__atomic_store_n(&rec->seq, pos + LOG_RING_SIZE,
+				 __ATOMIC_RELEASE);
+		pos += 1;
+		count += 1;
+	}
+	async_log.dequeue_pos = pos;
+	dropped = __atomic_load_n(&async_log.dropped, __ATOMIC_RELAXED);
+	if (!fatal && dropped != async_log.reported_dropped) {
+		struct log_record notice;
+
+		notice.prio = LIRC_WARNING;
+		clock_gettime(CLOCK_REALTIME, &notice.ts);
+		snprintf(notice.text, sizeof(notice.text),
+			 "Log ring full, %lu messages dropped",
+			 dropped - async_log.reported_dropped);
+		write_record(&notice);
+		async_log.reported_dropped = dropped;
+		count += 1;
+	}
+	if (!fatal && count > 0 && lf != NULL)
+		fflush(lf);
+	__atomic_store_n(&async_log.draining, 0, __ATOMIC_RELEASE);
+	return count;
+}
+
+
+static void* async_writer(void* arg)
+{
+	struct log_record* ring = (struct log_record*)arg;
+	struct pollfd pfd = {
+		.fd = async_log.wakeup[0], .events = POLLIN, .revents = 0 };
+	char buff[64];
+
+	while (!__atomic_load_n(&async_log.stop, __ATOMIC_ACQUIRE)) {
+		if (async_drain(ring, 0) > 0)
+			continue;
+		if (poll(&pfd, 1, LOG_WRITER_SLEEP_MS) > 0)
+			while (read(pfd.fd, buff, sizeof(buff)) > 0)
+				;
+	}
+	async_drain(ring, 0);
+	return NULL;
+}
+
+
+/** Fatal signal handler: flush what we have, and die as planned. */
+static void async_fatal(int sig)
+{
+	struct log_record* ring;
+	int i;
+
+	ring = __atomic_load_n(&async_log.ring, __ATOMIC_ACQUIRE);
+	for (i = 0; ring != NULL && i < 100 && async_drain(ring, 1) < 0; i += 1)
+		usleep(1000);
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+
+int lirc_log_async_start(void)
+{
+	struct log_record* ring;
+	struct sigaction act;
+	int i;
+
+	if (async_log.ring != NULL)
+		return 0;
+	ring = calloc(LOG_RING_SIZE, sizeof(struct log_record));
+	if (ring == NULL) {
+		log_error("Cannot allocate async log ring");
+		return -1;
+	}
+	for (i = 0; i < LOG_RING_SIZE; i += 1)
+		ring[i].seq = i;
+	async_log.enqueue_pos = 0;
+	async_log.dequeue_pos = 0;
+	async_log.stop = 0;
+	async_log.fatal_fd = lf != NULL ? fileno(lf) : STDERR_FILENO;
+	if (pipe(async_log.wakeup) != 0) {
+		free(ring);
+		log_perror_err("Cannot create async log pipe");
+		return -1;
+	}
+	for (i = 0; i < 2; i += 1) {
+		fcntl(async_log.wakeup[i], F_SETFL, O_NONBLOCK);
+		fcntl(async_log.wakeup[i], F_SETFD, FD_CLOEXEC);
+	}
+	if (pthread_create(&async_log.writer, NULL, async_writer, ring) != 0) {
+		close(async_log.wakeup[0]);
+		close(async_log.wakeup[1]);
+		free(ring);
+		log_error("Cannot create async log thread");
+		return -1;
+	}
+	__atomic_store_n(&async_log.ring, ring, __ATOMIC_RELEASE);
+	act.sa_handler = async_fatal;
+	sigemptyset(&act.sa_mask);
+	act.sa_flags = SA_RESETHAND;
+	for (i = 0; fatal_signals[i] != 0; i += 1)
+		sigaction(fatal_signals[i], &act, &old_fatal_actions[i]);
+	log_debug("Async logging started");
+	return 0;
+}
+
+
+void lirc_log_async_stop(void)
+{
+	struct log_record* ring = async_log.ring;
+	int i;
+
+	if (ring == NULL)
+		return;
+	for (i = 0; fatal_signals[i] != 0; i += 1)
+		sigaction(fatal_signals[i], &old_fatal_actions[i], NULL);
+	/* New messages are now logged synchronously. */
+	__atomic_store_n(&async_log.ring, NULL, __ATOMIC_SEQ_CST);
+	/* Wait for threads which loaded ring before it was cleared. */
+	while (__atomic_load_n(&async_log.producers, __ATOMIC_SEQ_CST) > 0)
+		sched_yield();
+	__atomic_store_n(&async_log.stop, 1, __ATOMIC_RELEASE);
+	wakeup_writer();
+	pthread_join(async_log.writer, NULL);
+	close(async_log.wakeup[0]);
+	close(async_log.wakeup[1]);
+	free(ring);
+}
+
+
+/**
+ * Push message to the async ring if async logging is started.
+ * @return 1 if pushed (or dropped when full), 0 if not started.
+ */
+static int async_log_message(loglevel_t		prio,
+			     const char*	format_str,
+			     va_list		ap)
+{
+	struct log_record* ring;
+
+	/* lirc_log_async_stop() waits for producers before freeing ring. */
+	__atomic_add_fetch(&async_log.producers, 1, __ATOMIC_SEQ_CST);
+	ring = __atomic_load_n(&async_log.ring, __ATOMIC_SEQ_CST);
+	if (ring != NULL)
+		async_push(ring, prio, format_str, ap);
+	__atomic_sub_fetch(&async_log.producers, 1, __ATOMIC_RELEASE);
+	return ring != NULL;
+}
+
+
+unsigned long lirc_log_dropped(void)
+{
+	return __atomic_load_n(&async_log.dropped, __ATOMIC_RELAXED);
+}
+
+
 /**
  * Write a message to the log.
  * Caller should use the log_ macros and not call this directly.
@@ -275,7 +623,15 @@ void logprintf(loglevel_t prio, const char* format_str, ...)
 	int save_errno = errno;
 	va_list ap;
 	char buff[PRIO_LEN + strlen(format_str)];
+	int async;
 
+	va_start(ap, format_str);
+	async = async_log_message(prio, format_str, ap);
+	va_end(ap);
+	if (async) {
+		errno = save_errno;
+		return;
+	}
 	if (use_syslog) {
 		snprintf(buff, sizeof(buff),
 			 "%s: %s", prio2text(prio), format_str);
@@ -283,13 +639,15 @@ void logprintf(loglevel_t prio, const char* format_str, ...)
 		vsyslog(min(7, prio), buff, ap);
 		va_end(ap);
 	} else if (lf) {
-		char* currents;
+		char currents[32];
 		struct timeval tv;
 		struct timezone tz;
 
 		gettimeofday(&tv, &tz);
-		currents = ctime(&tv.tv_sec);
+		ctime_r(&tv.tv_sec, currents);
 
+		/* Keep lines from concurrent threads apart. */
+		flockfile(lf);
 		fprintf(lf, "%15.15s.%06ld %s %s: ",
 			currents + 4, (long) tv.tv_usec, hostname, progname);
 		fprintf(lf, "%s: ", prio2text(prio));
@@ -298,6 +656,7 @@ void logprintf(loglevel_t prio, const char* format_str, ...)
 		va_end(ap);
 		fputc('\n', lf);
 		fflush(lf);
+		funlockfile(lf);
 	}
 	errno = save_errno;
 }
@@ -315,7 +674,7 @@ void logperror(loglevel_t prio, const char* fmt, ...)
 	va_start(ap, fmt);
 	vsnprintf(s, sizeof(s), fmt, ap);
 	va_end(ap);
-	if (use_syslog) {
+	if (use_syslog && async_log.ring == NULL) {
 		if (*s != '\0')
 			syslog(min(7, prio), "%s: %m\n", s);
 		else
@@ -186,6 +186,25 @@ int lirc_log_open(const char* progname, int _nodaemon, loglevel_t level);
 /** Close the log previosly opened with lirc_log_open(). */
 int lirc_log_close(void);
 
+/**
+ * Start asynchronous logging. logprintf() then just formats the message
+ * into a lock-free ring buffer, a separate thread writes the records in
+ * batches to the logfile or syslog. If the ring is full messages are
+ * dropped, see lirc_log_dropped(). Pending messages are flushed on
+ * lirc_log_close() and on fatal signals (SIGSEGV, SIGABRT etc.).
+ *
+ * Must be called after lirc_log_open() and after any fork(), e. g.,
+ * daemon(3): the writer thread does not survive it.
+ * @return 0 if OK, else -1.
+ */
+int lirc_log_async_start(void);
+
+/** Flush pending messages and stop asynchronous logging, if started. */
+void lirc_log_async_stop(void);
+
+/** Return number of messages dropped due to a full async log ring. */
+unsigned long lirc_log_dropped(void);
+
 /**
  * Set logfile. Either a regular path or the string 'syslog'; the latter
  * does indeed use syslog(1) instead. Must be called before lirc_log_open().
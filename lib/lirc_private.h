@@ -17,9 +17,11 @@
 
 #include "ir_remote_types.h"
 #include "lirc_log.h"
+#include "lirc_trace.h"
 #include "lirc_options.h"
 #include "lirc-utils.h"
 #include "curl_poll.h"
+#include "capture.h"
 #include "config_file.h"
 #include "dump_config.h"
 #include "input_map.h"
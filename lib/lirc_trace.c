@@ -0,0 +1,238 @@
+/****************************************************************************
+** lirc_trace.c ************************************************************
+****************************************************************************
+*
+* Binary tracepoints, rings mapped from files.
+*
+*/
+
+/**
+ * @file lirc_trace.c
+ * @brief Implements lirc_trace.h
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "lirc/lirc_log.h"
+#include "lirc/lirc_trace.h"
+
+static const logchannel_t logchannel = LOG_LIB;
+
+volatile int lirc_trace_enabled = 0;
+
+/** Bumped on each start/stop, rings from older generations are stale. */
+static volatile unsigned int generation = 1;
+
+/** Protects trace_dir and capacity. */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char trace_dir[PATH_MAX] = { '\0' };
+static uint32_t capacity = LIRC_TRACE_RECORDS;
+
+/** Used to unmap rings on thread exit. */
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+/** Current thread's ring. */
+struct trace_ring {
+	struct trace_header*	header;
+	struct trace_record*	records;
+	size_t			size;           /**< Mapped bytes. */
+	unsigned int		generation;
+};
+
+static __thread struct trace_ring thread_ring = { NULL, NULL, 0, 0 };
+
+static const char* const formats[TP_LAST] = {
+	[TP_NONE]		= "none",
+	[TP_REC_READ]		= "rec.read       pulse=%u usec=%u",
+	[TP_REC_REREAD]		= "rec.reread     pulse=%u usec=%u",
+	[TP_REC_TIMEOUT]	= "rec.timeout    maxusec=%u",
+	[TP_REC_CLEAR]		= "rec.clear      samples=%u",
+	[TP_EXPECT_PULSE]	= "expect.pulse   exdelta=%u pending=%u",
+	[TP_EXPECT_SPACE]	= "expect.space   exdelta=%u pending=%u",
+	[TP_DATA_BIT]		= "data.bit       bit=%u value=%u",
+	[TP_DATA_FAIL]		= "data.fail      bit=%u",
+	[TP_DECODE]		= "decode         code=0x%08x%08x",
+	[TP_SEND_CLEAR]		= "send.clear",
+	[TP_SEND_ADD]		= "send.add       pulse=%u usec=%u",
+};
+
+
+const char* lirc_trace_format(uint32_t id)
+{
+	return id < TP_LAST ? formats[id] : NULL;
+}
+
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void ring_unmap(struct trace_ring* ring)
+{
+	if (ring->header != NULL)
+		munmap(ring->header, ring->size);
+	ring->header = NULL;
+	ring->records = NULL;
+	ring->size = 0;
+}
+
+
+static void ring_destroy(void* arg)
+{
+	ring_unmap((struct trace_ring*)arg);
+}
+
+
+static void ring_key_create(void)
+{
+	pthread_key_create(&ring_key, ring_destroy);
+}
+
+
+/** Create and map a new ring file for current thread. */
+static int ring_open(struct trace_ring* ring)
+{
+	char path[PATH_MAX + 64];
+	uint32_t records;
+	void* p;
+	int fd;
+
+	ring_unmap(ring);
+	pthread_mutex_lock(&trace_lock);
+	ring->generation = generation;
+	records = capacity;
+	if (trace_dir[0] == '\0') {
+		/* Raced with lirc_trace_stop(). */
+		pthread_mutex_unlock(&trace_lock);
+		return 0;
+	}
+	snprintf(path, sizeof(path), "%s/lirc-trace-%d-%ld-%u.bin",
+		 trace_dir, getpid(), (long)syscall(SYS_gettid),
+		 ring->generation);
+	pthread_mutex_unlock(&trace_lock);
+
+	ring->size = sizeof(struct trace_header)
+		     + (size_t)records * sizeof(struct trace_record);
+	fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+		  0644);
+	if (fd == -1) {
+		log_perror_warn("Cannot create trace file %s", path);
+		return 0;
+	}
+	if (ftruncate(fd, ring->size) == -1) {
+		log_perror_warn("Cannot resize trace file %s", path);
+		close(fd);
+		return 0;
+	}
+	p = mmap(NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		log_perror_warn("Cannot map trace file %s", path);
+		return 0;
+	}
+	ring->header = (struct trace_header*)p;
+	ring->records = (struct trace_record*)(ring->header + 1);
+	memcpy(ring->header->magic, LIRC_TRACE_MAGIC, 8);
+	ring->header->record_size = sizeof(struct trace_record);
+	ring->header->capacity = records;
+	ring->header->pid = getpid();
+	ring->header->tid = syscall(SYS_gettid);
+	ring->header->start = now_ns();
+	ring->header->head = 0;
+
+	pthread_once(&ring_key_once, ring_key_create);
+	pthread_setspecific(ring_key, ring);
+	log_debug("Tracing to %s (%u records)", path, records);
+	return 1;
+}
+
+
+void lirc_trace_emit(uint32_t id, uint32_t a0, uint32_t a1, uint32_t a2)
+{
+	struct trace_ring* ring = &thread_ring;
+	struct trace_record* record;
+	uint64_t head;
+
+	if (ring->generation != generation) {
+		/* Don't retry a failed open until next start. */
+		if (!ring_open(ring))
+			return;
+	}
+	if (ring->header == NULL)
+		return;
+	head = ring->header->head;
+	record = &ring->records[head % ring->header->capacity];
+	record->ns = now_ns();
+	record->id = id;
+	record->arg[0] = a0;
+	record->arg[1] = a1;
+	record->arg[2] = a2;
+	__atomic_store_n(&ring->header->head, head + 1, __ATOMIC_RELEASE);
+}
+
+
+int lirc_trace_start(const char* dir, uint32_t records)
+{
+	struct stat st;
+
+	if (stat(dir, &st) == -1)
+		return -1;
+	if (!S_ISDIR(st.st_mode)) {
+		errno = ENOTDIR;
+		return -1;
+	}
+	if (strlen(dir) >= sizeof(trace_dir)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	pthread_mutex_lock(&trace_lock);
+	strncpy(trace_dir, dir, sizeof(trace_dir) - 1);
+	capacity = records > 0 ? records : LIRC_TRACE_RECORDS;
+	generation += 1;
+	pthread_mutex_unlock(&trace_lock);
+	lirc_trace_enabled = 1;
+	log_notice("Tracing started in %s", dir);
+	return 0;
+}
+
+
+void lirc_trace_stop(void)
+{
+	if (!lirc_trace_enabled)
+		return;
+	lirc_trace_enabled = 0;
+	pthread_mutex_lock(&trace_lock);
+	generation += 1;
+	trace_dir[0] = '\0';
+	pthread_mutex_unlock(&trace_lock);
+	/* Other threads unmaps on next start or at exit. */
+	ring_unmap(&thread_ring);
+	log_notice("Tracing stopped");
+}
+
+
+const char* lirc_trace_dir(void)
+{
+	return lirc_trace_enabled ? trace_dir : NULL;
+}
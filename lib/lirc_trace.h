@@ -0,0 +1,113 @@
+/****************************************************************************
+** lirc_trace.h ************************************************************
+****************************************************************************/
+
+/**
+ * @file lirc_trace.h
+ * @brief Binary tracepoints for the receive and transmit hot paths.
+ * @ingroup private_api
+ * @ingroup driver_api
+ *
+ * The log_trace() macros formats text through logprintf() for each
+ * sample, which changes the timing being debugged. Tracepoints instead
+ * stores a fixed size binary record (timestamp, tracepoint id and three
+ * arguments) in a ring mapped from a file, one ring per thread. When
+ * tracing is off a tracepoint is just a test of lirc_trace_enabled.
+ *
+ * The ring files are rendered by irtrace(1).
+ *
+ * @addtogroup driver_api
+ * @{
+ */
+
+#ifndef _LIRC_TRACE_H
+#define _LIRC_TRACE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Magic bytes starting each ring file. */
+#define LIRC_TRACE_MAGIC   "LIRCTRC1"
+
+/** Default number of records in each ring. */
+#define LIRC_TRACE_RECORDS 65536
+
+/** Tracepoint ids, see lirc_trace_format() for the arguments. */
+enum trace_point {
+	TP_NONE = 0,
+	TP_REC_READ,            /**< New sample from driver. */
+	TP_REC_REREAD,          /**< Sample re-read from rec_buffer. */
+	TP_REC_TIMEOUT,         /**< Timeout waiting for sample. */
+	TP_REC_CLEAR,           /**< rec_buffer_clear(). */
+	TP_EXPECT_PULSE,        /**< expectpulse() entered. */
+	TP_EXPECT_SPACE,        /**< expectspace() entered. */
+	TP_DATA_BIT,            /**< get_data() got a bit. */
+	TP_DATA_FAIL,           /**< get_data() failed. */
+	TP_DECODE,              /**< receive_decode() succeeded. */
+	TP_SEND_CLEAR,          /**< Transmit buffer cleared. */
+	TP_SEND_ADD,            /**< add_send_buffer(). */
+	TP_LAST
+};
+
+/** Header of a ring file, followed by capacity records. */
+struct trace_header {
+	char			magic[8];       /**< LIRC_TRACE_MAGIC */
+	uint32_t		record_size;    /**< sizeof(trace_record) */
+	uint32_t		capacity;       /**< Number of records. */
+	uint32_t		pid;
+	uint32_t		tid;
+	uint64_t		start;          /**< Ring creation time (ns). */
+	volatile uint64_t	head;           /**< Records written, ever. */
+	uint8_t			pad[24];
+};
+
+/** A tracepoint record. */
+struct trace_record {
+	uint64_t	ns;             /**< CLOCK_MONOTONIC timestamp. */
+	uint32_t	id;             /**< enum trace_point. */
+	uint32_t	arg[3];
+};
+
+/** True while tracing. Use lirc_trace_start/stop() to change. */
+extern volatile int lirc_trace_enabled;
+
+/** Store a record in current thread's ring, use lirc_trace(). */
+void lirc_trace_emit(uint32_t id, uint32_t a0, uint32_t a1, uint32_t a2);
+
+/** Tracepoint: store a record if tracing is enabled. */
+#define lirc_trace(id, a0, a1, a2) \
+	{ if (lirc_trace_enabled) \
+		{ lirc_trace_emit(id, a0, a1, a2); } }
+
+/**
+ * Start tracing. Each thread hitting a tracepoint creates a ring file
+ * lirc-trace-<pid>-<tid>-<n>.bin in dir where n is bumped on each start.
+ * @param dir Existing directory for the ring files.
+ * @param records Ring capacity, 0 means LIRC_TRACE_RECORDS.
+ * @return 0 on success, else -1 with errno set.
+ */
+int lirc_trace_start(const char* dir, uint32_t records);
+
+/** Stop tracing. Ring files are left as is for irtrace(1). */
+void lirc_trace_stop(void);
+
+/** Return directory used by running trace or NULL if stopped. */
+const char* lirc_trace_dir(void);
+
+/**
+ * Return printf(3) format for rendering a tracepoint's name and
+ * arguments, NULL if id is unknown. The format expects three
+ * unsigned int arguments in the same order as the record.
+ */
+const char* lirc_trace_format(uint32_t id);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif
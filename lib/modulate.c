@@ -0,0 +1,315 @@
+/****************************************************************************
+** modulate.c **************************************************************
+****************************************************************************
+*
+* Carrier modulation for drivers generating the carrier in software.
+*
+*/
+
+/**
+ * @file modulate.c
+ * @brief Implements modulate.h
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lirc/lirc_log.h"
+#include "lirc/modulate.h"
+
+static const logchannel_t logchannel = LOG_LIB;
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	uint32_t t;
+
+	while (b != 0) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+
+/** Square wave sample at position ix, as in the original ftdi driver. */
+static unsigned char square_sample(const struct carrier_table* table,
+				   uint64_t ix)
+{
+	uint32_t duty;
+	uint32_t div_carrier;
+
+	duty = (uint64_t)table->f_sample * table->duty_cycle / 100;
+	if (duty <= 1)
+		duty = 1;
+	else if (duty >= table->f_sample)
+		duty = table->f_sample - 1;
+	div_carrier = ((ix + 1) * table->f_carrier) % table->f_sample;
+	return div_carrier < duty ? 255 : 0;
+}
+
+
+static unsigned char sine_sample(const struct carrier_table* table,
+				 uint64_t ix)
+{
+	double phase;
+
+	phase = (double)((ix * table->f_carrier) % table->f_sample);
+	return (unsigned char)rint(
+		sin(2 * M_PI * phase / table->f_sample) * 127.0 + 128.0);
+}
+
+
+static unsigned char carrier_sample(const struct carrier_table* table,
+				    uint64_t ix)
+{
+	if (table->duty_cycle == 0)
+		return sine_sample(table, ix);
+	return square_sample(table, ix);
+}
+
+
+static int table_init(struct carrier_table*	table,
+		      uint32_t			f_sample,
+		      uint32_t			f_carrier,
+		      unsigned int		duty_cycle,
+		      unsigned char		idle)
+{
+	size_t i;
+
+	if (f_sample == 0 || f_carrier == 0) {
+		log_error("Bad carrier setup, rate: %u, freq: %u",
+			  f_sample, f_carrier);
+		return 0;
+	}
+	if (table->f_sample == f_sample
+	    && table->f_carrier == f_carrier
+	    && table->duty_cycle == duty_cycle
+	    && table->size > 0)
+		return 1;
+	carrier_table_free(table);
+	table->f_sample = f_sample;
+	table->f_carrier = f_carrier;
+	table->duty_cycle = duty_cycle;
+	table->idle = idle;
+	table->size = f_sample / gcd(f_sample, f_carrier);
+	if (table->size > CARRIER_TABLE_MAX) {
+		log_debug("Carrier cycle too long (%zu samples), not cached",
+			  table->size);
+		return 1;
+	}
+	table->samples = malloc(table->size);
+	if (table->samples == NULL) {
+		log_error("Out of memory creating carrier table");
+		table->size = 0;
+		return 0;
+	}
+	for (i = 0; i < table->size; i += 1)
+		table->samples[i] = carrier_sample(table, i);
+	log_debug("Carrier table: rate: %u, freq: %u, duty: %u, %zu samples",
+		  f_sample, f_carrier, duty_cycle, table->size);
+	return 1;
+}
+
+
+int carrier_table_square(struct carrier_table*	table,
+			 uint32_t		f_sample,
+			 uint32_t		f_carrier,
+			 unsigned int		duty_cycle)
+{
+	if (duty_cycle == 0)
+		duty_cycle = 1;
+	if (duty_cycle > 100)
+		duty_cycle = 100;
+	return table_init(table, f_sample, f_carrier, duty_cycle, 0);
+}
+
+
+int carrier_table_sine(struct carrier_table*	table,
+		       uint32_t			f_sample,
+		       uint32_t			f_carrier)
+{
+	return table_init(table, f_sample, f_carrier, 0, 128);
+}
+
+
+void carrier_table_free(struct carrier_table* table)
+{
+	if (table->samples != NULL)
+		free(table->samples);
+	memset(table, 0, sizeof(struct carrier_table));
+}
+
+
+/** Write count carrier samples starting at sample position ix to buf. */
+static void copy_carrier(const struct carrier_table*	table,
+			 unsigned char*			buf,
+			 uint64_t			ix,
+			 size_t				count)
+{
+	size_t phase;
+	size_t chunk;
+
+	if (table->samples == NULL) {
+		while (count-- > 0)
+			*buf++ = carrier_sample(table, ix++);
+		return;
+	}
+	phase = ix % table->size;
+	while (count > 0) {
+		chunk = table->size - phase;
+		if (chunk > count)
+			chunk = count;
+		memcpy(buf, table->samples + phase, chunk);
+		buf += chunk;
+		count -= chunk;
+		phase = 0;
+	}
+}
+
+
+ssize_t carrier_modulate(const struct carrier_table*	table,
+			 unsigned char*			buf,
+			 size_t				size,
+			 const lirc_t*			signals,
+			 int				length)
+{
+	uint64_t usecs = 0;
+	uint64_t start = 0;
+	uint64_t end;
+	int i;
+
+	for (i = 0; i < length; i += 1) {
+		/* Sample boundaries from the accumulated time: no drift. */
+		usecs += signals[i] & PULSE_MASK;
+		end = usecs * table->f_sample / 1000000;
+		/* Note: be sure to have room for the last idle sample. */
+		if (end >= size) {
+			log_error("Buffer overflow while modulating IR pattern");
+			return -1;
+		}
+		if (i % 2 == 0)
+			copy_carrier(table, buf + start, start, end - start);
+		else
+			memset(buf + start, table->idle, end - start);
+		start = end;
+	}
+	buf[start++] = table->idle;
+	return start;
+}
+
+
+static uint32_t hash_signals(const lirc_t* signals, int length)
+{
+	uint32_t hash = 2166136261u;
+	int i;
+
+	for (i = 0; i < length; i += 1) {
+		hash ^= (uint32_t)signals[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+
+static void entry_free(struct carrier_cache_entry* entry)
+{
+	free(entry->signals);
+	free(entry->samples);
+	memset(entry, 0, sizeof(struct carrier_cache_entry));
+}
+
+
+static int entry_matches(const struct carrier_cache_entry*	entry,
+			 const struct carrier_table*		table,
+			 uint32_t				hash,
+			 const lirc_t*				signals,
+			 int					length)
+{
+	return entry->samples != NULL
+	       && entry->hash == hash
+	       && entry->length == length
+	       && entry->f_sample == table->f_sample
+	       && entry->f_carrier == table->f_carrier
+	       && entry->duty_cycle == table->duty_cycle
+	       && memcmp(entry->signals, signals, length * sizeof(lirc_t)) == 0;
+}
+
+
+const unsigned char* carrier_cache_get(struct carrier_cache*		cache,
+				       const struct carrier_table*	table,
+				       const lirc_t*			signals,
+				       int				length,
+				       size_t				max_size,
+				       size_t*				size)
+{
+	struct carrier_cache_entry* entry;
+	uint32_t hash;
+	uint64_t usecs = 0;
+	ssize_t r;
+	int i;
+
+	hash = hash_signals(signals, length);
+	for (i = 0; i < CARRIER_CACHE_SIZE; i += 1) {
+		entry = &cache->entries[i];
+		if (entry_matches(entry, table, hash, signals, length)) {
+			log_trace("Using cached modulated buffer %d", i);
+			*size = entry->size;
+			return entry->samples;
+		}
+	}
+	entry = &cache->entries[cache->next];
+	cache->next = (cache->next + 1) % CARRIER_CACHE_SIZE;
+	entry_free(entry);
+
+	for (i = 0; i < length; i += 1)
+		usecs += signals[i] & PULSE_MASK;
+	entry->size = usecs * table->f_sample / 1000000 + 1;
+	if (entry->size > max_size) {
+		log_error("Buffer overflow while modulating IR pattern");
+		entry->size = 0;
+		return NULL;
+	}
+	entry->samples = malloc(entry->size);
+	entry->signals = malloc(length * sizeof(lirc_t));
+	if (entry->samples == NULL || entry->signals == NULL) {
+		log_error("Out of memory modulating IR pattern");
+		entry_free(entry);
+		return NULL;
+	}
+	r = carrier_modulate(table, entry->samples, entry->size,
+			     signals, length);
+	if (r < 0) {
+		entry_free(entry);
+		return NULL;
+	}
+	memcpy(entry->signals, signals, length * sizeof(lirc_t));
+	entry->length = length;
+	entry->hash = hash;
+	entry->f_sample = table->f_sample;
+	entry->f_carrier = table->f_carrier;
+	entry->duty_cycle = table->duty_cycle;
+	entry->size = r;
+	*size = entry->size;
+	return entry->samples;
+}
+
+
+void carrier_cache_free(struct carrier_cache* cache)
+{
+	int i;
+
+	for (i = 0; i < CARRIER_CACHE_SIZE; i += 1)
+		entry_free(&cache->entries[i]);
+	cache->next = 0;
+}
@@ -0,0 +1,142 @@
+/****************************************************************************
+** modulate.h **************************************************************
+****************************************************************************/
+
+/**
+ * @file modulate.h
+ * @brief Carrier modulation for drivers generating the carrier in software.
+ * @ingroup driver_api
+ *
+ * Drivers like ftdi and audio transmit by writing a stream of samples
+ * where the pulses are modulated with the carrier. Instead of computing
+ * each sample, a carrier_table holds all samples of one carrier cycle
+ * for a given sample rate, carrier frequency and duty cycle. A modulated
+ * buffer is then built by block copies from this table using
+ * carrier_modulate().
+ *
+ * Since lircd sends the same codes over and over again, the modulated
+ * buffers can also be kept in a carrier_cache, keyed by the send buffer
+ * contents.
+ *
+ * @addtogroup driver_api
+ * @{
+ */
+
+#ifndef _MODULATE_H
+#define _MODULATE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "media/lirc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Max samples in a table, longer cycles are computed on the fly. */
+#define CARRIER_TABLE_MAX  65536
+
+/** Number of modulated buffers kept in a carrier_cache. */
+#define CARRIER_CACHE_SIZE 8
+
+/** Precomputed samples for one complete carrier cycle. */
+struct carrier_table {
+	uint32_t	f_sample;       /**< Sample rate (Hz). */
+	uint32_t	f_carrier;      /**< Carrier frequency (Hz). */
+	unsigned int	duty_cycle;     /**< 1..100, 0 for a sine carrier. */
+	unsigned char	idle;           /**< Sample value used in spaces. */
+	size_t		size;           /**< Number of samples in one cycle. */
+	unsigned char*	samples;        /**< NULL if size > CARRIER_TABLE_MAX.*/
+};
+
+/** A modulated buffer in a carrier_cache. */
+struct carrier_cache_entry {
+	uint32_t	f_sample;
+	uint32_t	f_carrier;
+	unsigned int	duty_cycle;
+	uint32_t	hash;           /**< Hash of signals. */
+	lirc_t*		signals;        /**< Copy of send buffer. */
+	int		length;         /**< Number of signals. */
+	unsigned char*	samples;        /**< Modulated samples. */
+	size_t		size;           /**< Number of samples. */
+};
+
+/** Small cache of modulated buffers, see carrier_cache_get(). */
+struct carrier_cache {
+	struct carrier_cache_entry	entries[CARRIER_CACHE_SIZE];
+	unsigned int			next;   /**< Next slot to replace. */
+};
+
+/**
+ * Setup table for a square wave carrier which is 255 during the
+ * duty cycle, else 0. Spaces are 0. A no-op if table already is
+ * setup with the same parameters.
+ * @return 0 on errors, else 1.
+ */
+int carrier_table_square(struct carrier_table* table,
+			 uint32_t		f_sample,
+			 uint32_t		f_carrier,
+			 unsigned int		duty_cycle);
+
+/**
+ * Setup table for a sine carrier with samples centered around 128.
+ * Spaces are 128. A no-op if table already is setup with the same
+ * parameters.
+ * @return 0 on errors, else 1.
+ */
+int carrier_table_sine(struct carrier_table*	table,
+		       uint32_t			f_sample,
+		       uint32_t			f_carrier);
+
+/** Free memory allocated by carrier_table_square/sine(). */
+void carrier_table_free(struct carrier_table* table);
+
+/**
+ * Create samples for signals, pulses modulated with the carrier in
+ * table. The samples always ends with an idle sample, turning the
+ * transmitter off.
+ * @param table Carrier setup by carrier_table_square/sine().
+ * @param buf Buffer for resulting samples.
+ * @param size Size of buf.
+ * @param signals Pulse/space durations (us) starting with a pulse, as
+ *      returned by send_buffer_data().
+ * @param length Number of items in signals.
+ * @return Number of samples in buf, or -1 if buf is too small.
+ */
+ssize_t carrier_modulate(const struct carrier_table*	table,
+			 unsigned char*			buf,
+			 size_t				size,
+			 const lirc_t*			signals,
+			 int				length);
+
+/**
+ * Return modulated samples for signals, using a cached buffer if
+ * the same signals has been modulated with the same carrier before.
+ * Otherwise, carrier_modulate() the signals into a new cache entry.
+ * @param cache Cache, initially zeroed.
+ * @param table Carrier setup by carrier_table_square/sine().
+ * @param signals Pulse/space durations as for carrier_modulate().
+ * @param length Number of items in signals.
+ * @param max_size Max number of samples in result.
+ * @param size On successful exit, number of samples in result.
+ * @return Pointer to samples, owned by cache and valid until next call,
+ *      or NULL on errors.
+ */
+const unsigned char* carrier_cache_get(struct carrier_cache*		cache,
+				       const struct carrier_table*	table,
+				       const lirc_t*			signals,
+				       int				length,
+				       size_t				max_size,
+				       size_t*				size);
+
+/** Free all memory allocated in cache, leaving it empty. */
+void carrier_cache_free(struct carrier_cache* cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif
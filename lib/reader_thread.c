@@ -0,0 +1,141 @@
+/****************************************************************************
+** reader_thread.c *********************************************************
+****************************************************************************
+*
+* Device reader running on a separate thread.
+*
+*/
+
+/**
+ * @file reader_thread.c
+ * @brief Implements reader_thread.h
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "lirc/lirc_log.h"
+#include "lirc/reader_thread.h"
+
+static const logchannel_t logchannel = LOG_LIB;
+
+
+int reader_thread_stopping(struct reader_thread* rt)
+{
+	return __atomic_load_n(&rt->stop, __ATOMIC_ACQUIRE);
+}
+
+
+/** Send all of buf, retrying on EINTR and partial writes. */
+static int send_all(int fd, const char* buf, size_t size)
+{
+	ssize_t r;
+
+	while (size > 0) {
+		r = send(fd, buf, size, MSG_NOSIGNAL);
+		if (r == -1 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return 0;
+		buf += r;
+		size -= r;
+	}
+	return 1;
+}
+
+
+static void* reader_main(void* arg)
+{
+	struct reader_thread* rt = (struct reader_thread*)arg;
+	int r;
+
+	while (!reader_thread_stopping(rt)) {
+		r = rt->func(rt->arg, rt->buf, rt->size);
+		if (r < 0)
+			break;
+		if (r == 0)
+			continue;
+		if (!send_all(rt->write_fd, (const char*)rt->buf, r)) {
+			if (!reader_thread_stopping(rt))
+				log_perror_err("reader thread: cannot send data");
+			break;
+		}
+	}
+	/* Reader sees EOF once remaining data is consumed. */
+	shutdown(rt->write_fd, SHUT_WR);
+	return NULL;
+}
+
+
+int reader_thread_start(struct reader_thread* rt,
+			reader_func_t func, void* arg, size_t size)
+{
+	sigset_t all;
+	sigset_t old;
+	int fds[2];
+	int r;
+
+	memset(rt, 0, sizeof(struct reader_thread));
+	rt->fd = -1;
+	rt->write_fd = -1;
+	rt->buf = malloc(size);
+	if (rt->buf == NULL) {
+		log_error("reader thread: out of memory");
+		return -1;
+	}
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+		log_perror_err("reader thread: cannot create socket pair");
+		free(rt->buf);
+		rt->buf = NULL;
+		return -1;
+	}
+	rt->func = func;
+	rt->arg = arg;
+	rt->size = size;
+	rt->fd = fds[0];
+	rt->write_fd = fds[1];
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	r = pthread_create(&rt->thread, NULL, reader_main, rt);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (r != 0) {
+		log_error("reader thread: cannot create thread: %s",
+			  strerror(r));
+		close(rt->fd);
+		close(rt->write_fd);
+		free(rt->buf);
+		memset(rt, 0, sizeof(struct reader_thread));
+		rt->fd = -1;
+		rt->write_fd = -1;
+		return -1;
+	}
+	rt->running = 1;
+	return rt->fd;
+}
+
+
+void reader_thread_stop(struct reader_thread* rt)
+{
+	if (!rt->running)
+		return;
+	__atomic_store_n(&rt->stop, 1, __ATOMIC_RELEASE);
+	/* Unblock a send() waiting for the main loop to read. */
+	shutdown(rt->write_fd, SHUT_RDWR);
+	pthread_join(rt->thread, NULL);
+	close(rt->fd);
+	close(rt->write_fd);
+	free(rt->buf);
+	rt->fd = -1;
+	rt->write_fd = -1;
+	rt->buf = NULL;
+	rt->running = 0;
+}
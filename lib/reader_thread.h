@@ -0,0 +1,90 @@
+/****************************************************************************
+** reader_thread.h *********************************************************
+****************************************************************************/
+
+/**
+ * @file reader_thread.h
+ * @brief Device reader running on a separate thread.
+ * @ingroup driver_api
+ *
+ * Some devices, notably the ones accessed using libusb, can only be read
+ * using blocking calls which cannot be polled together with lircd's
+ * other file descriptors. A reader_thread runs such calls on a dedicated
+ * thread and makes the data available as a byte stream on a file
+ * descriptor suitable as drv.fd: it can be polled, read(2) by
+ * readdata() or rec_buffer_clear() and reports EOF when the reader has
+ * stopped.
+ *
+ * Each chunk returned by the read function is written using a single
+ * send(2), so a device delivering many samples per transfer costs one
+ * wakeup in the main loop rather than one per sample.
+ *
+ * @addtogroup driver_api
+ * @{
+ */
+
+#ifndef _READER_THREAD_H
+#define _READER_THREAD_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Read function called repeatedly on the reader thread. It should
+ * return within a fraction of a second also when there is no data e. g.,
+ * by using a short USB timeout, since reader_thread_stop() waits for it.
+ * @param arg As given to reader_thread_start().
+ * @param buf Buffer to fill with data for the main loop.
+ * @param size Size of buf, as given to reader_thread_start().
+ * @return Number of bytes in buf, 0 if there is no data (yet) and -1 on
+ *     fatal errors, which stops the thread.
+ */
+typedef int (*reader_func_t)(void* arg, void* buf, size_t size);
+
+/** A device reader thread, see reader_thread_start(). */
+struct reader_thread {
+	pthread_t	thread;
+	reader_func_t	func;
+	void*		arg;
+	void*		buf;            /**< Buffer passed to func. */
+	size_t		size;           /**< Size of buf. */
+	int		fd;             /**< Read end, data for main loop. */
+	int		write_fd;       /**< Write end, used by the thread. */
+	int		stop;           /**< Set by reader_thread_stop(). */
+	int		running;        /**< Thread started, not yet joined. */
+};
+
+/**
+ * Start a thread calling func(arg, buf, size) until it returns -1 or
+ * reader_thread_stop() is called. Signals are blocked in the thread, so
+ * they are handled by the main thread as usual.
+ * @param rt Reader to start, not running.
+ * @param func Read function, see reader_func_t.
+ * @param arg Opaque argument to func.
+ * @param size Max number of bytes func can return in each call.
+ * @return File descriptor to read data from, typically stored in drv.fd,
+ *     or -1 on errors.
+ */
+int reader_thread_start(struct reader_thread* rt,
+			reader_func_t func, void* arg, size_t size);
+
+/**
+ * Stop and join the reader thread, close both file descriptors. Waits
+ * until a running func() call returns. No-op if rt is not running.
+ */
+void reader_thread_stop(struct reader_thread* rt);
+
+/** Return 1 if reader_thread_stop() has been called, for use in func. */
+int reader_thread_stopping(struct reader_thread* rt);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif
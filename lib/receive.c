@@ -25,8 +25,10 @@
 
 #include "media/lirc.h"
 
+#include "lirc/capture.h"
 #include "lirc/driver.h"
 #include "lirc/lirc_log.h"
+#include "lirc/lirc_trace.h"
 #include "lirc/receive.h"
 #include "lirc/ir_remote.h"
 
@@ -49,9 +51,15 @@ struct rbuf {
 	lirc_t		pendingp;
 	lirc_t		pendings;
 	lirc_t		sum;
-	struct timeval	last_signal_time;
+	uint64_t	last_signal_time;
+	uint64_t	timestamp;
+	uint64_t	captured;
+	uint64_t	read_ts;        /**< Timestamp of last read sample. */
+	lirc_t		early_gap;      /**< Min gap after early emit, or 0. */
 	int		at_eof;
 	FILE*		input_log;
+	struct capture_writer*	capture;        /**< Binary input log. */
+	uint64_t	log_pending;    /**< Oldest unflushed log data, or 0. */
 };
 
 
@@ -60,6 +68,7 @@ struct rbuf {
  */
 static struct rbuf rec_buffer;
 static int update_mode = 0;
+static int early_emit = 0;
 
 
 void rec_set_update_mode(int mode)
@@ -67,6 +76,12 @@ void rec_set_update_mode(int mode)
 	update_mode = mode;
 }
 
+
+void rec_set_early_emit(int enable)
+{
+	early_emit = enable;
+}
+
 int (*lircd_waitfordata)(uint32_t timeout) = NULL;
 
 
@@ -74,8 +89,13 @@ static lirc_t readdata(lirc_t timeout)
 {
 	lirc_t data;
 
-	data = curr_driver->readdata(timeout);
+	data = drv_readdata(timeout, &rec_buffer.read_ts);
 	rec_buffer.at_eof = data & LIRC_EOF ? 1 : 0;
+	if (rec_buffer.capture != NULL && data != 0 && !rec_buffer.at_eof) {
+		capture_put(rec_buffer.capture, data, rec_buffer.read_ts);
+		if (rec_buffer.log_pending == 0)
+			rec_buffer.log_pending = rec_buffer.read_ts;
+	}
 	if (rec_buffer.at_eof)
 		log_debug("receive: Got EOF");
 	return data;
@@ -104,7 +124,8 @@ static void log_input(lirc_t data)
 {
 	fprintf(rec_buffer.input_log, "%s %u\n",
 		data & PULSE_BIT ? "pulse" : "space", data & PULSE_MASK);
-	fflush(rec_buffer.input_log);
+	if (rec_buffer.log_pending == 0)
+		rec_buffer.log_pending = rec_buffer.read_ts;
 }
 
 
@@ -113,6 +134,9 @@ static lirc_t get_next_rec_buffer_internal(lirc_t maxusec)
 	if (rec_buffer.rptr < rec_buffer.wptr) {
 		log_trace2("<%c%lu", rec_buffer.data[rec_buffer.rptr] & PULSE_BIT ? 'p' : 's', (uint32_t)
 			  rec_buffer.data[rec_buffer.rptr] & (PULSE_MASK));
+		lirc_trace(TP_REC_REREAD,
+			   is_pulse(rec_buffer.data[rec_buffer.rptr]),
+			   rec_buffer.data[rec_buffer.rptr] & PULSE_MASK, 0);
 		rec_buffer.sum += rec_buffer.data[rec_buffer.rptr] & (PULSE_MASK);
 		return rec_buffer.data[rec_buffer.rptr++];
 	}
@@ -120,16 +144,14 @@ static lirc_t get_next_rec_buffer_internal(lirc_t maxusec)
 		lirc_t data = 0;
 		unsigned long elapsed = 0;
 
-		if (timerisset(&rec_buffer.last_signal_time)) {
-			struct timeval current;
-
-			gettimeofday(&current, NULL);
-			elapsed = time_elapsed(&rec_buffer.last_signal_time, &current);
-		}
+		if (rec_buffer.last_signal_time != 0)
+			elapsed = time_elapsed_ns(rec_buffer.last_signal_time,
+						  time_now_ns());
 		if (elapsed < maxusec)
 			data = readdata(maxusec - elapsed);
 		if (!data) {
 			log_trace2("timeout: %u", maxusec);
+			lirc_trace(TP_REC_TIMEOUT, maxusec, 0, 0);
 			return 0;
 		}
 		if (data & LIRC_EOF) {
@@ -155,6 +177,7 @@ static lirc_t get_next_rec_buffer_internal(lirc_t maxusec)
 		log_trace2("+%c%lu", rec_buffer.data[rec_buffer.rptr - 1] & PULSE_BIT ? 'p' : 's', (uint32_t)
 			  rec_buffer.data[rec_buffer.rptr - 1]
 			  & (PULSE_MASK));
+		lirc_trace(TP_REC_READ, is_pulse(data), data & PULSE_MASK, 0);
 		return rec_buffer.data[rec_buffer.rptr - 1];
 	}
 	rec_buffer.too_long = 1;
@@ -205,6 +228,36 @@ void rec_buffer_set_logfile(FILE* f)
 }
 
 
+int rec_buffer_set_capture(const char* path)
+{
+	if (rec_buffer.capture != NULL)
+		capture_close(rec_buffer.capture);
+	rec_buffer.capture = NULL;
+	if (path == NULL)
+		return 1;
+	rec_buffer.capture = capture_open(path, curr_driver);
+	return rec_buffer.capture != NULL;
+}
+
+
+void rec_buffer_flush_log(void)
+{
+	if (rec_buffer.input_log != NULL)
+		fflush(rec_buffer.input_log);
+	if (rec_buffer.capture != NULL)
+		capture_flush(rec_buffer.capture);
+	rec_buffer.log_pending = 0;
+}
+
+
+uint64_t rec_buffer_log_deadline(void)
+{
+	if (rec_buffer.log_pending == 0)
+		return 0;
+	return rec_buffer.log_pending + CAPTURE_MAX_DELAY;
+}
+
+
 static lirc_t get_next_rec_buffer(lirc_t maxusec)
 {
 	return get_next_rec_buffer_internal(receive_timeout(maxusec));
@@ -230,11 +283,41 @@ void rec_buffer_reset_wptr(void)
 	rec_buffer.wptr = 0;
 }
 
+/**
+ * Check the gap after an early emitted code, now being the first item in
+ * buffer. If too short the code was actually not complete: don't let the
+ * next signal be taken as a repeat of it, and always wait for the gap for
+ * this remote from now on.
+ */
+static void check_early_gap(void)
+{
+	lirc_t data = rec_buffer.data[0];
+	lirc_t gap = rec_buffer.early_gap;
+
+	rec_buffer.early_gap = 0;
+	if (rec_buffer.wptr == 0 || data & LIRC_EOF || !is_space(data)
+	    || LIRC_IS_TIMEOUT(data))
+		return;
+	if ((data & PULSE_MASK) >= gap)
+		return;
+	log_debug("Early emitted code not followed by gap (%d < %d)",
+		  data & PULSE_MASK, gap);
+	if (last_remote != NULL) {
+		log_notice("Disabling early emit for remote %s",
+			   last_remote->name);
+		last_remote->no_early_emit = 1;
+		last_remote->release_detected = 1;
+		last_remote = NULL;
+	}
+}
+
+
 int rec_buffer_clear(void)
 {
 	int move, i;
 
-	timerclear(&rec_buffer.last_signal_time);
+	rec_buffer.last_signal_time = 0;
+	rec_buffer.timestamp = 0;
 	if (curr_driver->rec_mode == LIRC_MODE_LIRCCODE) {
 		unsigned char buffer[curr_driver->code_length/CHAR_BIT + 1];
 		size_t count;
@@ -247,6 +330,7 @@ int rec_buffer_clear(void)
 			log_error("reading in mode LIRC_MODE_LIRCCODE failed");
 			return 0;
 		}
+		rec_buffer.captured = time_now_ns();
 		for (i = 0, rec_buffer.decoded = 0; i < count; i++)
 			rec_buffer.decoded = (rec_buffer.decoded << CHAR_BIT) + ((ir_code)buffer[i]);
 	} else {
@@ -257,9 +341,14 @@ int rec_buffer_clear(void)
 			memmove(&rec_buffer.data[0], &rec_buffer.data[rec_buffer.rptr],
 				sizeof(rec_buffer.data[0]) * move);
 			rec_buffer.wptr -= rec_buffer.rptr;
+			/* Read while decoding last frame, exact time unknown. */
+			rec_buffer.captured = time_now_ns();
 		} else {
 			rec_buffer.wptr = 0;
 			data = readdata(0);
+			/* End of the leading gap i. e., start of frame. */
+			rec_buffer.captured = data != 0 ?
+					      rec_buffer.read_ts : time_now_ns();
 
 			log_trace2("c%lu", (uint32_t)data & (PULSE_MASK));
 
@@ -268,6 +357,9 @@ int rec_buffer_clear(void)
 		}
 	}
 
+	lirc_trace(TP_REC_CLEAR, rec_buffer.wptr, 0, 0);
+	if (rec_buffer.early_gap != 0)
+		check_early_gap();
 	rec_buffer_rewind();
 	rec_buffer.is_biphase = 0;
 
@@ -357,6 +449,7 @@ static int expectpulse(struct ir_remote* remote, int exdelta)
 	int retval;
 
 	log_trace2("expecting pulse: %lu", exdelta);
+	lirc_trace(TP_EXPECT_PULSE, exdelta, rec_buffer.pendingp, 0);
 	if (!sync_pending_space(remote))
 		return 0;
 
@@ -382,6 +475,7 @@ static int expectspace(struct ir_remote* remote, int exdelta)
 	int retval;
 
 	log_trace2("expecting space: %lu", exdelta);
+	lirc_trace(TP_EXPECT_SPACE, exdelta, rec_buffer.pendings, 0);
 	if (!sync_pending_pulse(remote))
 		return 0;
 
@@ -968,12 +1062,15 @@ static ir_code get_data(struct ir_remote* remote, int bits, int done)
 		code = code << 1;
 		if (expectone(remote, done + i)) {
 			log_trace1("1");
+			lirc_trace(TP_DATA_BIT, done + i, 1, 0);
 			code |= 1;
 		} else if (expectzero(remote, done + i)) {
 			log_trace1("0");
+			lirc_trace(TP_DATA_BIT, done + i, 0, 0);
 			code |= 0;
 		} else {
 			log_trace("failed on bit %d", done + i + 1);
+			lirc_trace(TP_DATA_FAIL, done + i + 1, 0, 0);
 			return (ir_code) -1;
 		}
 	}
@@ -1035,15 +1132,55 @@ static ir_code get_post(struct ir_remote* remote)
 	return post;
 }
 
+/** True if code is complete and matches exactly one button in remote. */
+static int is_unique_code(const struct ir_remote* remote, ir_code code)
+{
+	const struct ir_ncode* ncode;
+	int found = 0;
+
+	if (remote->codes == NULL)
+		return 0;
+	for (ncode = remote->codes; ncode->name != NULL; ncode++) {
+		if (ncode->next != NULL)
+			return 0;
+		if ((ncode->code | remote->ignore_mask)
+		    == (code | remote->ignore_mask))
+			found += 1;
+	}
+	return found == 1;
+}
+
+
+/** True if we can emit code without waiting for the trailing gap. */
+static int can_emit_early(const struct ir_remote* remote, ir_code code)
+{
+	return early_emit
+	       && !remote->no_early_emit
+	       && !is_const(remote)
+	       && !has_toggle_mask(remote)
+	       && is_unique_code(remote, code);
+}
+
+
+/** Return time of current frame, reading the clock at most once. */
+static uint64_t frame_timestamp(void)
+{
+	if (rec_buffer.timestamp == 0)
+		rec_buffer.timestamp = time_now_ns();
+	return rec_buffer.timestamp;
+}
+
+
 int receive_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 {
 	lirc_t sync;
 	int header;
-	struct timeval current;
 
 	sync = 0;               /* make compiler happy */
 	memset(ctx, 0, sizeof(struct decode_ctx_t));
 	ctx->code = ctx->pre = ctx->post = 0;
+	ctx->captured = rec_buffer.captured;
+	rec_buffer.early_gap = 0;
 	header = 0;
 
 	if (rec_buffer.at_eof && rec_buffer.wptr - rec_buffer.rptr <= 1) {
@@ -1084,6 +1221,7 @@ int receive_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 				ctx->code = remote->last_code->code;
 				ctx->post = remote->post_data;
 				ctx->repeat_flag = 1;
+				ctx->timestamp = frame_timestamp();
 
 				ctx->min_remaining_gap =
 					is_const(remote) ? (min_gap(remote) >
@@ -1168,7 +1306,6 @@ int receive_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 			ctx->code = decoded & gen_mask(remote->bits);
 			ctx->pre = decoded >> remote->bits;
 
-			gettimeofday(&current, NULL);
 			sum = remote->phead + remote->shead +
 			      lirc_t_max(remote->pone + remote->sone,
 					 remote->pzero + remote->szero) * bit_count(remote) + remote->plead +
@@ -1176,7 +1313,8 @@ int receive_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 			      remote->post_p + remote->post_s;
 
 			rec_buffer.sum = sum >= remote->gap ? remote->gap - 1 : sum;
-			sync = time_elapsed(&remote->last_send, &current) - rec_buffer.sum;
+			sync = time_elapsed_ns(remote->last_send, frame_timestamp())
+			       - rec_buffer.sum;
 		} else {
 			if (!get_lead(remote)) {
 				log_trace("failed on leading pulse");
@@ -1227,6 +1365,11 @@ int receive_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 					     min_gap(remote) - rec_buffer.sum :
 					     0))
 					return 0;
+			} else if (can_emit_early(remote, ctx->code)) {
+				/* Gap is checked by next rec_buffer_clear(). */
+				log_trace("early emit, not waiting for gap");
+				rec_buffer.early_gap =
+					lower_limit(remote, min_gap(remote));
 			} else {
 				if (!get_gap(remote, min_gap(remote)))
 					return 0;
@@ -1242,7 +1385,8 @@ int receive_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 		/* Most TV cards don't pass each signal to the
 		 * driver. This heuristic should fix repeat in such
 		 * cases. */
-		if (time_elapsed(&remote->last_send, &current) < 325000)
+		if (time_elapsed_ns(remote->last_send, frame_timestamp())
+		    < 325000)
 			ctx->repeat_flag = 1;
 	}
 	if (is_const(remote)) {
@@ -1252,5 +1396,7 @@ int receive_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 		ctx->min_remaining_gap = min_gap(remote);
 		ctx->max_remaining_gap = max_gap(remote);
 	}
+	ctx->timestamp = frame_timestamp();
+	lirc_trace(TP_DECODE, (uint32_t)(ctx->code >> 32), (uint32_t)ctx->code, 0);
 	return 1;
 }
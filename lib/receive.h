@@ -40,12 +40,40 @@ extern "C" {
  */
 void rec_set_update_mode(int mode);
 
+/**
+ * Set early emit mode, reducing latency by not waiting for the trailing
+ * gap when the decoded code uniquely identifies a button. Only used for
+ * remotes which are not CONST_LENGTH and have no toggle_mask. The gap
+ * is instead checked when next signal is received; if it turns out to
+ * be too short the repeat state is reset and early emit is disabled for
+ * that remote. By default false.
+ */
+void rec_set_early_emit(int enable);
+
 /**
  * Set a file logging input from driver in same format as mode2(1).
  * @param f Open file to write on or NULL to disable logging.
  */
 void rec_buffer_set_logfile(FILE* f);
 
+/**
+ * Set a binary capture file logging all input from driver including
+ * timestamps, see capture.h. Unlike rec_buffer_set_logfile() data is
+ * buffered until rec_buffer_flush_log() or the buffer is full.
+ * @param path File to create, or NULL to close current capture.
+ * @return 1 on success, 0 on errors with errno set.
+ */
+int rec_buffer_set_capture(const char* path);
+
+/** Write all buffered data in input logs. */
+void rec_buffer_flush_log(void);
+
+/**
+ * Return time_now_ns() time when buffered input log data should be
+ * written using rec_buffer_flush_log(), or 0 if there is none.
+ */
+uint64_t rec_buffer_log_deadline(void);
+
 /** Return actual timeout to use given MIN_RECEIVE_TIMEOUT limitation. */
 static inline lirc_t receive_timeout(lirc_t usec)
 {
@@ -20,7 +20,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
-#include <sys/time.h>
+#include <stdint.h>
 
 #include "media/lirc.h"
 
@@ -30,7 +30,9 @@
 
 static const logchannel_t logchannel = LOG_LIB;
 
-static struct timeval release_time;
+static uint64_t release_time;
+static uint64_t capture_time;
+static uint64_t decode_time;
 static struct ir_remote* release_remote;
 static struct ir_ncode* release_ncode;
 static ir_code release_code;
@@ -41,24 +43,20 @@ static struct ir_remote* release_remote2;
 static struct ir_ncode* release_ncode2;
 static ir_code release_code2;
 
-static void register_input(void)
+static void register_input(uint64_t timestamp)
 {
-	struct timeval gap;
-
 	if (release_remote == NULL)
 		return;
 
-	timerclear(&gap);
-	gap.tv_usec = release_gap;
-
-	gettimeofday(&release_time, NULL);
-	timeradd(&release_time, &gap, &release_time);
+	release_time = timestamp + (uint64_t)release_gap * 1000;
 }
 
 void register_button_press(struct ir_remote* remote,
 			   struct ir_ncode*  ncode,
 			   ir_code           code,
-			   int               reps)
+			   int               reps,
+			   uint64_t          timestamp,
+			   uint64_t          captured)
 {
 	if (reps == 0 && release_remote != NULL) {
 		release_remote2 = release_remote;
@@ -70,6 +68,8 @@ void register_button_press(struct ir_remote* remote,
 	release_ncode = ncode;
 	release_code = code;
 	release_reps = reps;
+	capture_time = captured;
+	decode_time = timestamp;
 	/* some additional safety margin */
 	release_gap = upper_limit(remote,
 				  remote->max_total_signal_length
@@ -78,7 +78,7 @@ void register_button_press(struct ir_remote* remote,
 						    remote->min_gap_length))
 		      + 10000;
 	log_trace("release_gap: %lu", release_gap);
-	register_input();
+	register_input(timestamp);
 }
 
 void get_release_data(const char** remote_name,
@@ -96,7 +96,19 @@ void get_release_data(const char** remote_name,
 }
 
 
-void get_release_time(struct timeval* tv)
+uint64_t get_release_time(void)
+{
+	return release_time;
+}
+
+
+uint64_t get_capture_time(void)
+{
+	return capture_time;
+}
+
+
+uint64_t get_decode_time(void)
 {
-	*tv = release_time;
+	return decode_time;
 }
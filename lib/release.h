@@ -23,11 +23,15 @@ extern "C" {
 /**
  * Set up pending events for given button, including the
  * release_gap. Data is saved to be retrieved using get_release_data().
+ * The timestamp is the time_now_ns() value when the button press
+ * was decoded, captured when its first sample was received.
  */
 void register_button_press(struct ir_remote* remote,
 			   struct ir_ncode*  ncode,
 			   ir_code           code,
-			   int               reps);
+			   int               reps,
+			   uint64_t          timestamp,
+			   uint64_t          captured);
 
 
 /** Get data from saved from last call to register_button_press(). */
@@ -36,9 +40,23 @@ void get_release_data(const char** remote_name,
 		      int*         reps);
 
 /**
- *  Get time for last call to register_button_press() if defined, else a noop.
+ *  Get time_now_ns() time when the release event is due after last call
+ *  to register_button_press(), or 0 if undefined.
  */
-void get_release_time(struct timeval* tv);
+uint64_t get_release_time(void);
+
+/**
+ *  Get time_now_ns() time when the first sample of the button press in
+ *  last call to register_button_press() was received, or 0 if undefined.
+ */
+uint64_t get_capture_time(void);
+
+/**
+ *  Get time_now_ns() time when the button press in last call to
+ *  register_button_press() was decoded i. e., its timestamp argument,
+ *  or 0 if undefined.
+ */
+uint64_t get_decode_time(void);
 
 
 #ifdef __cplusplus
@@ -25,6 +25,7 @@
 #include "media/lirc.h"
 
 #include "lirc/lirc_log.h"
+#include "lirc/lirc_trace.h"
 #include "lirc/transmit.h"
 
 static const logchannel_t logchannel = LOG_LIB;
@@ -63,6 +64,7 @@ void send_buffer_init(void)
 static void clear_send_buffer(void)
 {
 	log_trace2("clearing transmit buffer");
+	lirc_trace(TP_SEND_CLEAR, 0, 0, 0);
 	send_buffer.wptr = 0;
 	send_buffer.too_long = 0;
 	send_buffer.is_biphase = 0;
@@ -75,6 +77,8 @@ static void add_send_buffer(lirc_t data)
 {
 	if (send_buffer.wptr < WBUF_SIZE) {
 		log_trace2("adding to transmit buffer: %u", data);
+		/* Buffer starts with a pulse, then alternates. */
+		lirc_trace(TP_SEND_ADD, send_buffer.wptr % 2 == 0, data, 0);
 		send_buffer.sum += data;
 		send_buffer._data[send_buffer.wptr] = data;
 		send_buffer.wptr++;
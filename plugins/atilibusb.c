@@ -25,22 +25,21 @@
 
 #include <errno.h>
 #include <glob.h>
-#include <signal.h>
 #include <string.h>
 #include <unistd.h>
 #include <usb.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 
 #include "lirc_driver.h"
 
 #define CODE_BYTES 5
-#define USB_TIMEOUT (1000 * 60)
+/* Short, ati_deinit() waits for a pending read to time out. */
+#define USB_TIMEOUT 250
 
 static int ati_init(void);
 static int ati_deinit(void);
 static char* ati_rec(struct ir_remote* remotes);
-static void usb_read_loop(int fd);
+static int usb_read(void* arg, void* buf, size_t size);
 static struct usb_device* find_usb_device(void);
 static int find_device_endpoints(struct usb_device* dev);
 static char device_path[10000] = {0};
@@ -100,7 +99,8 @@ static usb_device_id usb_remote_id_table[] = {
 static struct usb_dev_handle* dev_handle = NULL;
 struct usb_endpoint_descriptor* dev_ep_in = NULL;
 struct usb_endpoint_descriptor* dev_ep_out = NULL;
-static pid_t child = -1;
+static struct reader_thread reader;
+static int inited = 0;
 
 /* init strings -- from lirc_atiusb */
 static char init1[] = { 0x80, 0x01, 0x00, 0x20, 0x14 };
@@ -145,21 +145,11 @@ static int drvctl_func(unsigned int cmd, void* arg)
 static int ati_init(void)
 {
 	struct usb_device* usb_dev;
-	int pipe_fd[2] = { -1, -1 };
 
 	log_trace("initializing USB receiver");
 
 	rec_buffer_init();
 
-	/* A separate process will be forked to read data from the USB
-	 * receiver and write it to a pipe. drv.fd is set to the readable
-	 * end of this pipe. */
-	if (pipe(pipe_fd) != 0) {
-		log_perror_err("couldn't open pipe");
-		return 0;
-	}
-	drv.fd = pipe_fd[0];
-
 	usb_dev = find_usb_device();
 	if (!usb_dev || !usb_dev->bus || !usb_dev->filename) {
 		log_error("couldn't find a compatible USB device");
@@ -203,13 +193,12 @@ static int ati_init(void)
 		 usb_dev->bus->dirname, usb_dev->filename);
 	drv.device = device_path;
 	log_debug("atilibusb: using device: %s", device_path);
-	child = fork();
-	if (child == -1) {
-		log_perror_err("couldn't fork child process");
+	/* A separate thread reads data from the USB receiver, drv.fd
+	 * is the readable end of its data stream. */
+	inited = 0;
+	drv.fd = reader_thread_start(&reader, usb_read, NULL, CODE_BYTES);
+	if (drv.fd == -1)
 		goto fail;
-	} else if (child == 0) {
-		usb_read_loop(pipe_fd[1]);
-	}
 	return 1;
 
 fail:
@@ -217,10 +206,6 @@ fail:
 		usb_close(dev_handle);
 		dev_handle = NULL;
 	}
-	if (pipe_fd[0] >= 0)
-		close(pipe_fd[0]);
-	if (pipe_fd[1] >= 0)
-		close(pipe_fd[1]);
 	return 0;
 }
 
@@ -229,24 +214,15 @@ static int ati_deinit(void)
 {
 	int err = 0;
 
+	reader_thread_stop(&reader);
+	drv.fd = -1;
+
 	if (dev_handle) {
 		if (usb_close(dev_handle) < 0)
 			err = 1;
 		dev_handle = NULL;
 	}
 
-	if (drv.fd >= 0) {
-		if (close(drv.fd) < 0)
-			err = 1;
-		drv.fd = -1;
-	}
-
-	if (child > 1) {
-		if ((kill(child, SIGTERM) == -1)
-		    || (waitpid(child, NULL, 0) == 0))
-			err = 1;
-	}
-
 	return !err;
 }
 
@@ -317,68 +293,41 @@ static int find_device_endpoints(struct usb_device* dev)
 	return 1;
 }
 
-/* this function is run in a forked process to read data from the USB
- * receiver and write it to the given fd. it calls exit() with result
- * code 0 on success, or 1 on failure. */
-static void usb_read_loop(int fd)
+/* this function is run on the reader thread to read a code from the USB
+ * receiver into buf. returns CODE_BYTES, 0 if there is no code and -1
+ * on errors. */
+static int usb_read(void* arg, void* buf, size_t size)
 {
-	int inited = 0;
-	int err = 0;
+	char* code = (char*)buf;
+	int bytes_r;
+
+	/* TODO: accept codes only for a specific channel */
+	// int channel;
+
+	/* read from the USB device */
+	bytes_r = usb_interrupt_read(dev_handle, dev_ep_in->bEndpointAddress,
+				     code, CODE_BYTES, USB_TIMEOUT);
+	if (bytes_r < 0) {
+		if (errno == EAGAIN || errno == ETIMEDOUT)
+			return 0;
+		log_perror_err("can't read from USB device");
+		return -1;
+	}
+	if (bytes_r == 0)
+		return 0;
 
-	alarm(0);
-	signal(SIGTERM, SIG_DFL);
-	signal(SIGPIPE, SIG_DFL);
-	signal(SIGINT, SIG_DFL);
-	signal(SIGHUP, SIG_IGN);
-	signal(SIGALRM, SIG_IGN);
-
-	for (;; ) {
-		char buf[CODE_BYTES];
-		int bytes_r, bytes_w, pos;
-		/* TODO: accept codes only for a specific channel */
-		// int channel;
-
-		/* read from the USB device */
-		bytes_r =
-			usb_interrupt_read(dev_handle, dev_ep_in->bEndpointAddress, &buf[0], sizeof(buf), USB_TIMEOUT);
-		if (bytes_r < 0) {
-			if (errno == EAGAIN || errno == ETIMEDOUT)
-				continue;
-
-			log_perror_err("can't read from USB device");
-			err = 1;
-			goto done;
-		}
-
-		/* sometimes the remote sends one byte on startup; ignore it */
-		if (!inited) {
-			inited = 1;
-			if (bytes_r == 1)
-				continue;
-		}
-
-		// channel = (buf[bytes_r - 1] >> 4) & 0x0F;
-
-		/* pad the code with zeros (if shorter than CODE_BYTES) */
-		memset(buf + bytes_r, 0, sizeof(buf) - bytes_r);
-		/* erase the channel code -- TODO: make this optional */
-		buf[bytes_r - 1] &= 0x0F;
-
-		/* write to the pipe */
-		bytes_r = sizeof(buf);
-		for (pos = 0; pos < bytes_r; pos += bytes_w) {
-			bytes_w = write(fd, buf + pos, bytes_r - pos);
-			if (bytes_w < 0) {
-				log_perror_err("can't write to pipe");
-				err = 1;
-				goto done;
-			}
-		}
+	/* sometimes the remote sends one byte on startup; ignore it */
+	if (!inited) {
+		inited = 1;
+		if (bytes_r == 1)
+			return 0;
 	}
 
-done:
-	close(fd);
-	if (!usb_close(dev_handle))
-		err = 1;
-	_exit(err);
+	// channel = (code[bytes_r - 1] >> 4) & 0x0F;
+
+	/* pad the code with zeros (if shorter than CODE_BYTES) */
+	memset(code + bytes_r, 0, CODE_BYTES - bytes_r);
+	/* erase the channel code -- TODO: make this optional */
+	code[bytes_r - 1] &= 0x0F;
+	return CODE_BYTES;
 }
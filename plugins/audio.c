@@ -19,54 +19,58 @@
 #endif
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <limits.h>
 #include <signal.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <termios.h>
-
-#ifdef HAVE_UTIL_H
-#include <util.h>
-#endif
-
-#ifdef HAVE_PTY_H
-#include <pty.h>
-#endif
 
 #include "lirc_driver.h"
 
-static int ptyfd;               /* the pty */
-
 /* PortAudio Includes */
 #include <portaudio.h>
 
 #define DEFAULT_SAMPLERATE (48000)
 #define NUM_CHANNELS           (2)
-#define PI           (3.141592654)
+
+/* Max number of samples in a modulated code. */
+#define TXBUFSZ      (1024 * 1024)
 
 
 /* Select sample format. */
 #define PA_SAMPLE_TYPE  paUInt8
 typedef unsigned char SAMPLE;
 
+/* Frames per buffer passed to the callback. */
+#define FRAMES_PER_BUFFER 512
+
+/* Size of the ring between callback and demodulator, power of two. */
+#define RING_SIZE (1 << 16)
+#define RING_MASK (RING_SIZE - 1)
+
+/* Max number of samples demodulated in one block. */
+#define BLOCK_SIZE 4096
+
+/* Number of samples kept from previous block, see find_edges(). */
+#define HISTORY 2
+
+/* Level change between two samples considered as an edge. */
+#define EDGE_THRESHOLD 100
+
+#define EDGE_UP   1
+#define EDGE_DOWN 2
+
 typedef struct {
-	int		lastFrames[3];
-	int		lastSign;
-	int		pulseSign;
-	unsigned int	lastCount;
-	lirc_t		carrierFreq;
-	/* position the sine generator is in */
-	double		carrierPos;
-	/* length of the remaining signal is stored here when the
-	 * callback exits */
-	double		remainingSignal;
-	/* 1 = pulse, 0 = space */
-	int		signalPhase;
-	int		signaledDone;
+	/* modulated samples being sent, owned by audio_send() */
+	const unsigned char*	sendSamples;
+	size_t		sendSize;
+	size_t		sendPos;
 	int		samplesToIgnore;
 	int		samplerate;
 } paTestData;
@@ -74,179 +78,138 @@ typedef struct {
 static const logchannel_t logchannel = LOG_DRIVER;
 
 static PaStream* stream;
+static paTestData data;
+
+/*
+ * Input samples of the first channel, written by the callback and read
+ * by the demodulator thread. Single producer, single consumer: head is
+ * only written by the callback, tail only by the thread.
+ */
+static struct {
+	SAMPLE		buf[RING_SIZE];
+	unsigned int	head;
+	unsigned int	tail;
+	/* Number of samples dropped since the ring was full. */
+	unsigned int	dropped;
+	/* PaStreamCallbackFlags seen by the callback. */
+	unsigned int	status;
+} ring;
+
+/* Demodulator state, owned by the reader thread. */
+static struct {
+	/* Samples being demodulated, preceded by HISTORY samples
+	 * of the previous block. */
+	SAMPLE		samples[HISTORY + BLOCK_SIZE];
+	/* EDGE_UP or EDGE_DOWN where a large level change is found. */
+	unsigned char	edges[BLOCK_SIZE];
+	int		lastSign;
+	int		pulseSign;
+	/* Samples since last edge at start of block. */
+	unsigned int	lastCount;
+	/* Time to wait for new samples, in ns. */
+	long		idle_ns;
+} demod;
 
+static struct reader_thread reader;
 
-static char ptyName[256];
-static int master;
-static int sendPipe[2];         /* signals are written from audio_send
-				 * and read from the callback */
+static int sendPipe[2];         /* modulated samples are written from
+				 * audio_send and read from the callback */
 static int completedPipe[2];    /* a byte is written here when the
-				 * callback has processed all signals */
+				 * callback has processed all samples */
 static int outputLatency;
 static int inDevicesPrinted = 0;
 static int outDevicesPrinted = 0;
 
-static void addCode(lirc_t data)
+/* Sine carrier and modulated codes, see modulate.h. */
+static struct carrier_table tx_carrier;
+static struct carrier_cache tx_cache;
+
+/* What audio_send() passes to the callback through sendPipe. */
+struct tx_samples {
+	const unsigned char*	samples;
+	size_t			size;
+};
+
+/* Copy the first channel of the input frames to the ring. */
+static void ring_put(const SAMPLE* in, unsigned long frames, paTestData* data)
 {
-	chk_write(master, &data, sizeof(lirc_t));
+	unsigned int head = ring.head;
+	unsigned int tail = __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE);
+	unsigned long space = RING_SIZE - (head - tail);
+	unsigned long i;
+
+	if (frames > space) {
+		__atomic_fetch_add(&ring.dropped, frames - space, __ATOMIC_RELAXED);
+		frames = space;
+	}
+	for (i = 0; i < frames; i++) {
+		/* check if we have to ignore this sample */
+		if (data->samplesToIgnore) {
+			ring.buf[(head + i) & RING_MASK] = 128;
+			data->samplesToIgnore--;
+		} else {
+			ring.buf[(head + i) & RING_MASK] = in[i * NUM_CHANNELS];
+		}
+	}
+	__atomic_store_n(&ring.head, head + frames, __ATOMIC_RELEASE);
 }
 
 /* This routine will be called by the PortAudio engine when audio is needed.
 ** It may be called at interrupt level on some machines so don't do anything
-** that could mess up the system like calling malloc() or free().
+** that could mess up the system like calling malloc() or free(). Input
+** samples are just copied to the ring, the reader thread demodulates them.
 */
 static int recordCallback(const void* inputBuffer, void* outputBuffer, unsigned long framesPerBuffer,
 			  const PaStreamCallbackTimeInfo* outTime, PaStreamCallbackFlags status, void* userData)
 {
 	paTestData* data = (paTestData*)userData;
-	SAMPLE* rptr = (SAMPLE*)inputBuffer;
 	long i;
 
-	SAMPLE* myPtr = rptr;
-
-	unsigned int time;
-	int diff;
-
 	SAMPLE* outptr = (SAMPLE*)outputBuffer;
 	int out;
-	double currentSignal = data->remainingSignal;
-	lirc_t signal;
+	struct tx_samples tx;
 
 	/* Prevent unused variable warnings. */
 	(void)outTime;
 
-	if (status & paOutputUnderflow)
-		log_warn("Output underflow %s", drv.device);
-	if (status & paInputOverflow)
-		log_warn("Input overflow %s", drv.device);
-
-	for (i = 0; i < framesPerBuffer; i++, myPtr++) {
-		/* check if we have to ignore this sample */
-		if (data->samplesToIgnore) {
-			*myPtr = 128;
-			data->samplesToIgnore--;
-		}
-
-		/* New Algo */
-		diff = abs(data->lastFrames[0] - *myPtr);
-		if (diff > 100) {
-			if (data->pulseSign == 0) {
-				/* we got the first signal, this is a PULSE */
-				if (*myPtr > data->lastFrames[0])
-					data->pulseSign = 1;
-				else
-					data->pulseSign = -1;
-			}
-
-			if (data->lastCount > 0) {
-				if (*myPtr > data->lastFrames[0] && data->lastSign <= 0) {
-					/* printf("CHANGE ++ "); */
-					data->lastSign = 1;
-
-					time = data->lastCount * 1000000 / data->samplerate;
-					if (data->lastSign == data->pulseSign)
-						addCode(time);
-						/* printf("Pause: %d us, %d\n", time, data->lastCount); */
-					else
-						addCode(time | PULSE_BIT);
-						/* printf("Pulse: %d us, %d\n", time, data->lastCount); */
-					data->lastCount = 0;
-				} else if (*myPtr < data->lastFrames[0] && data->lastSign >= 0) {
-					/* printf("CHANGE -- "); */
-					data->lastSign = -1;
-
-					time = data->lastCount * 1000000 / data->samplerate;
-					if (data->lastSign == data->pulseSign)
-						/* printf("Pause: %d us, %d\n", time, data->lastCount); */
-						addCode(time);
-					else
-						/* printf("Pulse: %d us, %d\n", time, data->lastCount); */
-						addCode(time | PULSE_BIT);
-					data->lastCount = 0;
-				}
-			}
-		}
-
-		if (data->lastCount < 100000)
-			data->lastCount++;
-
-		data->lastFrames[0] = data->lastFrames[1];
-		data->lastFrames[1] = *myPtr;
-
-		/* skip 2. channel */
-		if (NUM_CHANNELS == 2)
-			myPtr++;
+	/* Logged by the reader thread. */
+	if (status)
+		__atomic_fetch_or(&ring.status, status, __ATOMIC_RELAXED);
+
+	if (inputBuffer != NULL)
+		ring_put((const SAMPLE*)inputBuffer, framesPerBuffer, data);
+
+	/* generate output, try to read new samples, non blocking */
+	if (data->sendSamples == NULL
+	    && read(sendPipe[0], &tx, sizeof(tx)) == sizeof(tx)) {
+		data->sendSamples = tx.samples;
+		data->sendSize = tx.size;
+		data->sendPos = 0;
+		/* when transmitting, ignore input samples for one second */
+		data->samplesToIgnore = data->samplerate;
 	}
-
-	/* generate output */
 	for (i = 0; i < framesPerBuffer; i++) {
-		if (currentSignal <= 0.0) {     /* last signal we sent went out */
-			/* try to read a new signal, non blocking */
-			if (read(sendPipe[0], &signal, sizeof(signal)) > 0) {
-				if (data->signaledDone) {
-					/* first one sent is the
-					 * carrier frequency */
-					data->carrierFreq = signal;
-					data->signaledDone = 0;
-				} else {
-					/* when a new signal is read,
-					 * add it */
-					currentSignal += signal;
-					/* invert the phase */
-					data->signalPhase = data->signalPhase ? 0 : 1;
-				}
-
-				/* when transmitting, ignore input
-				 * samples for one second */
-				data->samplesToIgnore = data->samplerate;
-			} else {
-				/* no more signals, reset phase */
-				data->signalPhase = 0;
-				/* signal that we have written all
-				 * signals */
-				if (!data->signaledDone) {
-					char done = 0;
-
-					data->signaledDone = 1;
-					chk_write(completedPipe[1],
-						  &done,
-						  sizeof(done));
-				}
+		if (data->sendSamples != NULL) {
+			out = data->sendSamples[data->sendPos++];
+			if (data->sendPos >= data->sendSize) {
+				/* signal that we have written all samples */
+				char done = 0;
+
+				data->sendSamples = NULL;
+				chk_write(completedPipe[1],
+					  &done,
+					  sizeof(done));
 			}
-		}
-
-		if (currentSignal > 0.0) {
-			if (data->signalPhase)
-				/* write carrier */
-				out = rint(sin(data->carrierPos / (180.0 / PI)) * 127.0 + 128.0);
-			else
-				out = 128;
-
-			/* one channel is inverted, so both channels
-			 * can be used to double the voltage */
-			*outptr++ = out;
-			if (NUM_CHANNELS == 2)
-				*outptr++ = 256 - out;
-
-			/* subtract how much of the current signal was sent */
-			currentSignal -= 1000000.0 / data->samplerate;
 		} else {
-			*outptr++ = 128;
-			if (NUM_CHANNELS == 2)
-				*outptr++ = 128;
+			out = 128;
 		}
-
-		/* increase carrier position */
-		/* carrier frequency is halved */
-		data->carrierPos += (double)data->carrierFreq / data->samplerate * 360.0 / 2.0;
-
-		if (data->carrierPos >= 360.0)
-			data->carrierPos -= 360.0;
+		/* one channel is inverted, so both channels
+		 * can be used to double the voltage */
+		*outptr++ = out;
+		if (NUM_CHANNELS == 2)
+			*outptr++ = 256 - out;
 	}
 
-	/* save how much we still have to write */
-	data->remainingSignal = currentSignal;
-
 	return 0;
 }
 
@@ -254,8 +217,113 @@ static int recordCallback(const void* inputBuffer, void* outputBuffer, unsigned
  * decoding stuff
  */
 
-#define BUFSIZE 20
-#define SAMPLE 47999
+/*
+ * Mark samples which differ more than EDGE_THRESHOLD from the sample two
+ * positions back with EDGE_UP or EDGE_DOWN. This is a branch-free loop
+ * over bytes the compiler can vectorize. s[-1] and s[-2] must be valid.
+ */
+static void find_edges(const SAMPLE* s, unsigned char* edges, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		edges[i] = (s[i] > s[i - 2] + EDGE_THRESHOLD) * EDGE_UP
+			   | (s[i] + EDGE_THRESHOLD < s[i - 2]) * EDGE_DOWN;
+}
+
+/*
+ * Demodulate n samples in demod.samples, after the history, into buf.
+ * Returns the number of durations stored. Durations are emitted when the
+ * direction of the edges changes. The direction of the first edge ever
+ * seen is taken as start of a pulse.
+ */
+static int demod_block(int n, lirc_t* buf)
+{
+	const unsigned char* edges = demod.edges;
+	unsigned long long count = demod.lastCount;
+	unsigned int time;
+	uint64_t word;
+	int base = 0;
+	int got = 0;
+	int sign;
+	int i = 0;
+
+	find_edges(demod.samples + HISTORY, demod.edges, n);
+	while (i < n) {
+		/* Skip runs without edges a word at a time */
+		if (i + (int)sizeof(word) <= n) {
+			memcpy(&word, edges + i, sizeof(word));
+			if (word == 0) {
+				i += sizeof(word);
+				continue;
+			}
+		}
+		if (edges[i] == 0) {
+			i++;
+			continue;
+		}
+		sign = edges[i] == EDGE_UP ? 1 : -1;
+		if (demod.pulseSign == 0)
+			/* we got the first signal, this is a PULSE */
+			demod.pulseSign = sign;
+		count += i - base;
+		base = i;
+		if (count > 0 && sign != demod.lastSign) {
+			demod.lastSign = sign;
+			if (count > 100000)
+				count = 100000;
+			time = count * 1000000 / data.samplerate;
+			if (demod.lastSign == demod.pulseSign)
+				buf[got++] = time;
+			else
+				buf[got++] = time | PULSE_BIT;
+			count = 0;
+		}
+		i++;
+	}
+	count += n - base;
+	demod.lastCount = count < 100000 ? count : 100000;
+	memmove(demod.samples, demod.samples + n, HISTORY);
+	return got;
+}
+
+/* reader_thread function: demodulate samples available in the ring. */
+static int demod_read(void* arg, void* buf, size_t size)
+{
+	struct timespec idle = { 0, demod.idle_ns };
+	unsigned int tail = ring.tail;
+	unsigned int head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+	unsigned int status;
+	unsigned int dropped;
+	unsigned int n;
+	unsigned int first;
+
+	status = __atomic_exchange_n(&ring.status, 0, __ATOMIC_RELAXED);
+	if (status & paOutputUnderflow)
+		log_warn("Output underflow %s", drv.device);
+	if (status & paInputOverflow)
+		log_warn("Input overflow %s", drv.device);
+	dropped = __atomic_exchange_n(&ring.dropped, 0, __ATOMIC_RELAXED);
+	if (dropped > 0)
+		log_warn("Dropped %u samples %s", dropped, drv.device);
+
+	n = head - tail;
+	if (n == 0) {
+		/* Wait about one callback period for more samples */
+		nanosleep(&idle, NULL);
+		return 0;
+	}
+	if (n > BLOCK_SIZE)
+		n = BLOCK_SIZE;
+	first = RING_SIZE - (tail & RING_MASK);
+	if (first > n)
+		first = n;
+	memcpy(demod.samples + HISTORY, ring.buf + (tail & RING_MASK), first);
+	memcpy(demod.samples + HISTORY + first, ring.buf, n - first);
+	__atomic_store_n(&ring.tail, tail + n, __ATOMIC_RELEASE);
+
+	return demod_block(n, (lirc_t*)buf) * sizeof(lirc_t);
+}
 
 lirc_t audio_readdata(lirc_t timeout)
 {
@@ -282,6 +350,7 @@ int audio_send(struct ir_remote* remote, struct ir_ncode* code)
 	char completed;
 	lirc_t freq;
 	static lirc_t prevfreq = 0;
+	struct tx_samples tx;
 
 	if (!send_buffer_put(remote, code))
 		return 0;
@@ -294,6 +363,19 @@ int audio_send(struct ir_remote* remote, struct ir_ncode* code)
 		return 0;
 	}
 
+	/* carrier frequency is halved */
+	freq = remote->freq ? remote->freq : DEFAULT_FREQ;
+	if (!carrier_table_sine(&tx_carrier, data.samplerate, freq / 2))
+		return 0;
+	if (freq != prevfreq) {
+		prevfreq = freq;
+		log_info("Using carrier frequency %i", freq);
+	}
+	tx.samples = carrier_cache_get(&tx_cache, &tx_carrier,
+				       signals, length, TXBUFSZ, &tx.size);
+	if (tx.samples == NULL)
+		return 0;
+
 	/* set completed pipe to non blocking */
 	flags = fcntl(completedPipe[0], F_GETFL, 0);
 	fcntl(completedPipe[0], F_SETFL, flags | O_NONBLOCK);
@@ -305,21 +387,13 @@ int audio_send(struct ir_remote* remote, struct ir_ncode* code)
 	/* set completed pipe to blocking */
 	fcntl(completedPipe[0], F_SETFL, flags & ~O_NONBLOCK);
 
-	/* write carrier frequency */
-	freq = remote->freq ? remote->freq : DEFAULT_FREQ;
-	chk_write(sendPipe[1], &freq, sizeof(freq));
-	if (freq != prevfreq) {
-		prevfreq = freq;
-		log_info("Using carrier frequency %i", freq);
-	}
-
-	/* write signals to sendpipe */
-	if (write(sendPipe[1], signals, length * sizeof(lirc_t)) == -1) {
+	/* hand over samples to the callback */
+	if (write(sendPipe[1], &tx, sizeof(tx)) == -1) {
 		log_perror_err("write failed");
 		return 0;
 	}
 
-	/* wait for the callback to signal us that all signals are written */
+	/* wait for the callback to signal us that all samples are written */
 	chk_read(completedPipe[0], &completed, sizeof(completed));
 
 	return 1;
@@ -440,7 +514,6 @@ static void audio_choosedevice(PaStreamParameters* streamparameters, int input,
 /*
  * interface functions
  */
-static paTestData data;
 
 int audio_init(void)
 {
@@ -448,7 +521,6 @@ int audio_init(void)
 	PaStreamParameters outputParameters;
 	PaError err;
 	int flags;
-	struct termios t;
 	char api[1024];
 	char device[1024];
 	double latency;
@@ -460,19 +532,15 @@ int audio_init(void)
 	rec_buffer_init();
 	rec_buffer_rewind();
 
-	/* new */
-	data.lastFrames[0] = 128;
-	data.lastFrames[1] = 128;
-	data.lastFrames[2] = 128;
-	data.lastSign = 0;
-	data.lastCount = 0;
-	data.pulseSign = 0;
-	data.carrierPos = 0.0;
-	data.remainingSignal = 0.0;
-	data.signalPhase = 0;
-	data.signaledDone = 1;
+	memset(&ring, 0, sizeof(ring));
+	memset(demod.samples, 128, HISTORY);
+	demod.lastSign = 0;
+	demod.lastCount = 0;
+	demod.pulseSign = 0;
+	data.sendSamples = NULL;
+	data.sendSize = 0;
+	data.sendPos = 0;
 	data.samplesToIgnore = 0;
-	data.carrierFreq = DEFAULT_FREQ;
 
 	err = Pa_Initialize();
 	if (err != paNoError)
@@ -480,6 +548,7 @@ int audio_init(void)
 
 	audio_parsedevicestr(api, device, &data.samplerate, &latency);
 	log_info("Using samplerate %i", data.samplerate);
+	demod.idle_ns = 1000000000LL * FRAMES_PER_BUFFER / data.samplerate;
 
 	/* choose input device */
 	audio_choosedevice(&inputParameters, 1, api, device, latency);
@@ -504,40 +573,18 @@ int audio_init(void)
 	outputLatency = outputParameters.suggestedLatency * 1000000;
 
 	/* Record some audio. -------------------------------------------- */
-	err = Pa_OpenStream(&stream, &inputParameters, &outputParameters, data.samplerate, 512, /* frames per buffer */
+	err = Pa_OpenStream(&stream, &inputParameters, &outputParameters, data.samplerate, FRAMES_PER_BUFFER,
 			    paPrimeOutputBuffersUsingStreamCallback, recordCallback, &data);
 
 	if (err != paNoError)
 		goto error;
 
-	/* open pty */
-	if (openpty(&master, &ptyfd, ptyName, 0, 0) == -1) {
-		log_error("openpty failed");
-		log_perror_err("openpty()");
+	/* A separate thread demodulates the samples copied to the ring
+	 * by the callback, drv.fd is the readable end of its output. */
+	drv.fd = reader_thread_start(&reader, demod_read, NULL,
+				     BLOCK_SIZE * sizeof(lirc_t));
+	if (drv.fd == -1)
 		goto error;
-	}
-
-	/* regular device file */
-	if (tcgetattr(master, &t) < 0) {
-		log_error("tcgetattr failed");
-		log_perror_err("tcgetattr()");
-	}
-
-	cfmakeraw(&t);
-
-	/* apply file descriptor options */
-	if (tcsetattr(master, TCSANOW, &t) < 0) {
-		log_error("tcsetattr failed");
-		log_perror_err("tcsetattr()");
-	}
-
-	flags = fcntl(ptyfd, F_GETFL, 0);
-	if (flags != -1)
-		fcntl(ptyfd, F_SETFL, flags | O_NONBLOCK);
-
-	log_trace("PTY name: %s", ptyName);
-
-	drv.fd = ptyfd;
 
 	/* make a pipe for sending signals to the callback */
 	/* make a pipe for signaling from the callback that everything
@@ -566,6 +613,8 @@ int audio_init(void)
 	return 1;
 
 error:
+	reader_thread_stop(&reader);
+	drv.fd = -1;
 	Pa_Terminate();
 	log_error("an error occurred while using the portaudio stream");
 	log_error("error number: %d", err);
@@ -598,15 +647,17 @@ int audio_deinit(void)
 	/* wait for terminaton */
 	usleep(20000);
 
-	/* close pty */
-	close(master);
-	close(ptyfd);
+	reader_thread_stop(&reader);
+	drv.fd = -1;
 
 	close(sendPipe[0]);
 	close(sendPipe[1]);
 	close(completedPipe[0]);
 	close(completedPipe[1]);
 
+	carrier_cache_free(&tx_cache);
+	carrier_table_free(&tx_carrier);
+
 	return 1;
 
 error:
@@ -22,13 +22,11 @@
 # include <config.h>
 #endif
 
+#include <stdint.h>
 #include <stdlib.h>
-#include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
-#include <limits.h>
 #include <signal.h>
-#include <sys/types.h>
-#include <sys/stat.h>
 
 #define ALSA_PCM_NEW_HW_PARAMS_API
 #define ALSA_PCM_NEW_SW_PARAMS_API
@@ -43,14 +41,11 @@
  * desired the level of input signal to be relatively strong (without
  * clipping although it does not hurt).
  *
- * This driver works as following: it creates a named pipe (called usually
- * /dev/lirc) and opens it. The handle is handed then to the receive.c module
- * which reads or writes data from it. The client HAS to use non-blocking
- * I/O otherwise we don't get a chance to run ever (this could be fixed
- * by creating a secondary thread and doing all audio stuff there).
- * If one day this driver will support sending commands, we'll have to use
- * asyncronous I/O (O_ASYNC and a signal handler) so that we get control
- * right after client writes to the pipe.
+ * This driver works as following: a capture thread reads the sound card
+ * using blocking snd_pcm_readi() calls, one period at a time, and runs the
+ * demodulator on each block. The resulting pulse/space durations are
+ * written to a socket pair (see reader_thread.h) whose other end is handed
+ * to the receive.c module as drv.fd.
  *
  * For usage documentation see audio-alsa.html.
  */
@@ -65,10 +60,8 @@ static struct {
 	snd_pcm_format_t	format;
 	/* The audio buffer size in microseconds */
 	unsigned		buffer_time;
-	/* The FIFO handle for reading and writing */
-	int			fd;
-	/* The asynchronous I/O signal handler object */
-	snd_async_handler_t*	sighandler;
+	/* Number of frames read by each snd_pcm_readi() call */
+	snd_pcm_uframes_t	period_size;
 	/* Value indicating number of channels for capture */
 	unsigned char		num_channels;
 	/* Value indicating which channel to look for signal 0=right 1=left */
@@ -84,15 +77,44 @@ static struct {
 	 * and record.c thinks there is a time gap between data (and drops
 	 * the repeat count).
 	 */
-	100000,	-1, NULL, 1, 0 /*Use left channel by default */
+	100000, 0, 1, 0 /*Use left channel by default */
 };
 
+/* Demodulator state, carried from one block to the next */
+static struct {
+	/* Signal maximum and minimum (used for "zero" detection) */
+	unsigned char	signal_min;
+	unsigned char	signal_max;
+	/* Current signal level (dynamically changes) */
+	unsigned	signal_level;
+	/* Samples since last level change at start of block, 24.8 fp */
+	long long	sample_count;
+	/* Current state (pulse or space) */
+	lirc_t		signal_state;
+} demod;
+
+/* Buffers used by the capture thread, all period_size frames long */
+static struct {
+	/* Raw frames as read from ALSA */
+	char*		pcm;
+	/* Selected channel as unsigned 8-bit samples, preceded by the
+	 * last HISTORY samples of previous block */
+	unsigned char*	samples;
+	/* Non-zero where a level change is detected */
+	unsigned char*	edges;
+} blk;
+
+static struct reader_thread reader;
+
+/* Number of samples kept from previous block, see find_edges() */
+#define HISTORY 2
+
 /* Return the absolute difference between two unsigned 8-bit samples */
 #define U8_ABSDIFF(s1, s2) (((s1) >= (s2)) ? ((s1) - (s2)) : ((s2) - (s1)))
 
 /* Forward declarations */
 static int audio_alsa_deinit(void);
-static void alsa_sig_io(snd_async_handler_t* h);
+static int alsa_read(void* arg, void* buf, size_t size);
 
 static const logchannel_t logchannel = LOG_DRIVER;
 
@@ -132,7 +154,7 @@ static int alsa_set_hwparams(void)
 			  snd_pcm_hw_params_set_buffer_time_near(alsa_hw.handle, hwp, &alsa_hw.buffer_time, 0)))
 		return -1;
 
-	/* How often to call our SIGIO handler (~40Hz) */
+	/* Size of the blocks read by the capture thread (~40Hz) */
 	period_time = alsa_hw.buffer_time / 4;
 	if (alsa_error
 		    ("hw_params_set_period_time_near",
@@ -141,6 +163,7 @@ static int alsa_set_hwparams(void)
 	    || alsa_error("hw_params_get_period_size", snd_pcm_hw_params_get_period_size(hwp, &period_size, 0))
 	    || alsa_error("hw_params", snd_pcm_hw_params(alsa_hw.handle, hwp)))
 		return -1;
+	alsa_hw.period_size = period_size;
 
 	snd_pcm_sw_params_current(alsa_hw.handle, swp);
 	if (alsa_error("sw_params_set_start_threshold",
@@ -158,51 +181,53 @@ static int alsa_set_hwparams(void)
 	return 0;
 }
 
-int audio_alsa_init(void)
+static void demod_reset(void)
 {
-	int fd, err;
-	char* pcm_rate;
-	char tmp_name[20];
-
-	rec_buffer_init();
+	memset(blk.samples, 0x80, HISTORY);
+	demod.signal_min = 0x80;
+	demod.signal_max = 0x80;
+	demod.signal_level = 0;
+	demod.sample_count = 0;
+	demod.signal_state = 0;
+}
 
-	/* Create a temporary filename for our FIFO,
-	 * Use mkstemp() instead of mktemp() although we need a FIFO not a
-	 * regular file. We do this since glibc barfs at mktemp() and this
-	 * scares the users :-)
-	 */
-	strcpy(tmp_name, "/tmp/lircXXXXXX");
-	fd = mkstemp(tmp_name);
-	close(fd);
-
-	/* Start the race! */
-	unlink(tmp_name);
-	if (mknod(tmp_name, S_IFIFO | S_IRUSR | S_IWUSR, 0)) {
-		log_error("could not create FIFO %s", tmp_name);
-		log_perror_err("audio_alsa_init ()");
+static int alloc_buffers(void)
+{
+	size_t frames = alsa_hw.period_size;
+	size_t frame_bytes = snd_pcm_format_physical_width(alsa_hw.format) / 8
+			     * alsa_hw.num_channels;
+
+	blk.pcm = malloc(frames * frame_bytes);
+	blk.samples = malloc(HISTORY + frames);
+	blk.edges = malloc(frames);
+	if (blk.pcm == NULL || blk.samples == NULL || blk.edges == NULL) {
+		log_error("audio_alsa: out of memory");
 		return 0;
 	}
-	/* Phew, we won the race ... */
+	return 1;
+}
 
-	/* Open the pipe and hand it to LIRC ... */
-	drv.fd = open(tmp_name, O_RDWR);
-	if (drv.fd < 0) {
-		log_error("could not open pipe %s", tmp_name);
-		log_perror_err("audio_alsa_init ()");
-error:          unlink(tmp_name);
-		audio_alsa_deinit();
-		return 0;
-	}
+static void free_buffers(void)
+{
+	free(blk.pcm);
+	free(blk.samples);
+	free(blk.edges);
+	blk.pcm = NULL;
+	blk.samples = NULL;
+	blk.edges = NULL;
+}
 
-	/* Open the other end of the pipe and hand it to ALSA code.
-	 * We're opening it in non-blocking mode to avoid lockups.
-	 */
-	alsa_hw.fd = open(tmp_name, O_RDWR | O_NONBLOCK);
-	/* Ok, we don't need the FIFO visible in the filesystem anymore ... */
-	unlink(tmp_name);
+int audio_alsa_init(void)
+{
+	int err;
+	char* pcm_rate;
+	char tmp_name[20];
+
+	rec_buffer_init();
 
 	/* Examine the device name, if it contains a sample rate */
 	strncpy(tmp_name, drv.device, sizeof(tmp_name) - 1);
+	tmp_name[sizeof(tmp_name) - 1] = '\0';
 	pcm_rate = strchr(tmp_name, '@');
 	if (pcm_rate) {
 		int rate;
@@ -238,266 +263,282 @@ error:          unlink(tmp_name);
 			alsa_hw.rate = rate;
 	}
 
-	/* Open the audio card in non-blocking mode */
-	err = snd_pcm_open(&alsa_hw.handle, tmp_name, SND_PCM_STREAM_CAPTURE, SND_PCM_NONBLOCK);
+	/* Open the audio card, reads block in the capture thread */
+	err = snd_pcm_open(&alsa_hw.handle, tmp_name, SND_PCM_STREAM_CAPTURE, 0);
 	if (err < 0) {
 		log_error("could not open audio device %s: %s", drv.device, snd_strerror(err));
 		log_perror_err("audio_alsa_init ()");
 		goto error;
 	}
 
-	/* Set up the I/O signal handler */
-	if (alsa_error("async_add_handler",
-			 snd_async_add_pcm_handler(&alsa_hw.sighandler,
-						   alsa_hw.handle,
-						   alsa_sig_io, NULL)))
-		goto error;
-
 	/* Set sampling parameters */
 	if (alsa_set_hwparams())
 		goto error;
 
 	log_trace("hw_audio_alsa: Using device '%s', sampling rate %dHz\n", tmp_name, alsa_hw.rate);
 
+	if (!alloc_buffers())
+		goto error;
+	demod_reset();
+
 	/* Start sampling data */
 	if (alsa_error("start", snd_pcm_start(alsa_hw.handle)))
 		goto error;
 
+	/* Hand the readable end of the capture thread's output to LIRC */
+	drv.fd = reader_thread_start(&reader, alsa_read, NULL,
+				     alsa_hw.period_size * sizeof(lirc_t));
+	if (drv.fd == -1)
+		goto error;
+
 	return 1;
+
+error:
+	audio_alsa_deinit();
+	return 0;
 }
 
 int audio_alsa_deinit(void)
 {
-	if (alsa_hw.sighandler) {
-		snd_async_del_handler(alsa_hw.sighandler);
-		alsa_hw.sighandler = NULL;
-	}
+	reader_thread_stop(&reader);
+	drv.fd = -1;
 	if (alsa_hw.handle) {
 		snd_pcm_close(alsa_hw.handle);
 		alsa_hw.handle = NULL;
 	}
-	if (alsa_hw.fd != -1) {
-		close(alsa_hw.fd);
-		alsa_hw.fd = -1;
-	}
-	if (drv.fd != -1) {
-		close(drv.fd);
-		drv.fd = -1;
-	}
+	free_buffers();
 	return 1;
 }
 
 /*
- * ALSA calls this callback when some data is available for reading.
- * The detection algorithm is somewhat sophisticated but it should give
+ * The demodulator runs on each block read by the capture thread. The
+ * detection algorithm is somewhat sophisticated but it should give
  * good practical results. The algorithm works as follows:
  *
- * Sampled data is converted to unsigned form (e.g. 0x80 is zero).
+ * Sampled data of the selected channel is converted to unsigned 8-bit
+ * form (e.g. 0x80 is zero).
  *
- * The current "middle" value is constantly tracked (e.g. signal
- * could deviate from the 0x80 by a certain amount due to soundcard
- * entry capacitance). Then we subtract that middle from every sample
- * to get a signed value (to know whether it is less or more than current
- * tracked "zero" value). This is called 'current sample'.
+ * The current "middle" value is tracked from the block's minimum and
+ * maximum (e.g. signal could deviate from the 0x80 by a certain amount
+ * due to soundcard entry capacitance).
  *
- * The absolute value of current sample is integrated over time to get
- * automatic level correction (e.g. to smooth the difference between
- * different hardware which can have different output levels). This is
- * called 'signal level'.
+ * The mean absolute deviation from the middle is integrated over the
+ * blocks to get automatic level correction (e.g. to smooth the
+ * difference between different hardware which can have different output
+ * levels). This is called 'signal level'.
  *
- * Then the algorithm waits for a substantial change in the level of
+ * Then the algorithm looks for a substantial change in the level of
  * input signals (since IR module outputs a square wave). When this
  * substantial change crosses our "virtual zero", it is considered
  * a real level change, and the type of signal is toggled
  * (space <-> pulse).
+ *
+ * All passes except the final one over the (few) detected level changes
+ * are simple loops over byte arrays without branches, which the
+ * compiler can vectorize.
  */
 
-#define READ_BUFFER_SIZE (2 * 4096)
+/* Convert 8-bit samples of selected channel to unsigned form. */
+static void convert_8(const unsigned char* pcm, unsigned char* s,
+		      int n, int stride, unsigned char flip)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		s[i] = pcm[i * stride] ^ flip;
+}
 
-static void alsa_sig_io(snd_async_handler_t* h)
+/* Convert signed little-endian 16-bit samples of selected channel to
+ * unsigned 8-bit form, using the most significant byte. */
+static void convert_16(const unsigned char* pcm, unsigned char* s,
+		       int n, int stride)
 {
-	/* Previous sample */
-	static unsigned char ps = 0x80;
-	/* Count samples with similar level (to detect pule/space
-	 * length), 24.8 fp */
-	static unsigned sample_count = 0;
-	/* Current signal level (dynamically changes) */
-	static unsigned signal_level = 0;
-	/* Current state (pulse or space) */
-	static unsigned signal_state = 0;
-	/* Signal maximum and minimum (used for "zero" detection) */
-	static unsigned char signal_max = 0x80, signal_min = 0x80;
-	/* Non-zero if we're in zero crossing waiting state */
-	static char waiting_zerox = 0;
-	/* Store sample size, as our sample buffer will represent
-	 * shorts or chars */
-	unsigned char bytes_per_sample = (alsa_hw.format == SND_PCM_FORMAT_S16_LE ? 2 : 1);
-
-	int i, err;
-	char buff[READ_BUFFER_SIZE];
-	snd_pcm_sframes_t count;
+	int i;
 
+	for (i = 0; i < n; i++)
+		s[i] = pcm[i * stride + 1] ^ 0x80;
+}
+
+/* Convert n frames in blk.pcm to blk.samples after the history. */
+static void convert_block(int n)
+{
+	const unsigned char* pcm = (const unsigned char*)blk.pcm;
+
+	if (alsa_hw.format == SND_PCM_FORMAT_S16_LE)
+		convert_16(pcm + 2 * alsa_hw.channel, blk.samples + HISTORY,
+			   n, 2 * alsa_hw.num_channels);
+	else
+		convert_8(pcm + alsa_hw.channel, blk.samples + HISTORY,
+			  n, alsa_hw.num_channels,
+			  alsa_hw.format == SND_PCM_FORMAT_S8 ? 0x80 : 0);
+}
+
+/* Update signal_min, signal_max and signal_level from n samples,
+ * return current middle value. */
+static unsigned char track_envelope(const unsigned char* s, int n)
+{
+	unsigned char lo = 0xff;
+	unsigned char hi = 0;
+	unsigned char sz;
+	unsigned sum = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		lo = s[i] < lo ? s[i] : lo;
+		hi = s[i] > hi ? s[i] : hi;
+	}
+	/* Follow new extremes at once, decay slowly otherwise */
+	demod.signal_min = lo < demod.signal_min ?
+			   lo : (demod.signal_min * 7 + lo) / 8;
+	demod.signal_max = hi > demod.signal_max ?
+			   hi : (demod.signal_max * 7 + hi) / 8;
+	sz = (demod.signal_min + demod.signal_max) / 2;
+
+	for (i = 0; i < n; i++)
+		sum += U8_ABSDIFF(s[i], sz);
+	demod.signal_level = (demod.signal_level + sum / n) / 2;
+	return sz;
+}
+
+/* Mark samples with a change larger than threshold compared to the
+ * previous sample, which crosses the middle sz. A level change is often
+ * spread over two samples, where the smaller first step crosses the
+ * middle: the crossing is then accepted one sample late. The edge is
+ * EDGE_NOW if the crossing is at the sample itself, EDGE_PREV if it is
+ * at the previous one. s[-1] and s[-2] must be valid.
+ */
+#define EDGE_NOW	1
+#define EDGE_PREV	2
+
+static void find_edges(const unsigned char* s, unsigned char* edges, int n,
+		       unsigned char sz, unsigned char threshold)
+{
+	unsigned char xz, xz1, big, big1;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		xz = (s[i] < sz) ^ (s[i - 1] < sz);
+		xz1 = (s[i - 1] < sz) ^ (s[i - 2] < sz);
+		big = U8_ABSDIFF(s[i], s[i - 1]) > threshold;
+		big1 = U8_ABSDIFF(s[i - 1], s[i - 2]) > threshold;
+		edges[i] = big * (xz * EDGE_NOW | (xz1 & !big1) * EDGE_PREV);
+	}
+}
+
+/* Demodulate n samples in blk.samples into buf, return number of
+ * durations stored. */
+static int demod_block(int n, lirc_t* buf)
+{
+	const unsigned char* s = blk.samples + HISTORY;
 	/* The value to multiply with number of samples to get microseconds
 	 * (fixed-point 24.8 bits).
 	 */
 	unsigned mulconst = 256000000 / alsa_hw.rate;
 	/* Maximal number of samples that can be multiplied by mulconst */
-	unsigned maxcount = (((PULSE_MASK << 8) | 0xff) / mulconst) << 8;
-
-	/* First of all, check for underrun. This happens, for example, when
-	 * the X11 server starts. If we won't, recording will stop forever.
-	 */
-	snd_pcm_state_t state = snd_pcm_state(alsa_hw.handle);
-
-	switch (state) {
-	case SND_PCM_STATE_SUSPENDED:
-		while ((err = snd_pcm_resume(alsa_hw.handle)) == -EAGAIN)
-			/* wait until the suspend flag is released */
-			sleep(1);
-		if (err >= 0)
-			goto var_reset;
-	/* Fallthrough */
-	case SND_PCM_STATE_XRUN:
-		alsa_error("prepare", snd_pcm_prepare(alsa_hw.handle));
-		alsa_error("start", snd_pcm_start(alsa_hw.handle));
-var_reset:                      /* Reset variables */
-		sample_count = 0;
-		waiting_zerox = 0;
-		signal_level = 0;
-		signal_state = 0;
-		signal_max = signal_min = 0x80;
-		break;
-	default:
-		/* Stream is okay */
-		break;
-	}
-
-	/* Read all available data */
-	count = snd_pcm_avail_update(alsa_hw.handle);
-	if (count > 0) {
-		if (count > (READ_BUFFER_SIZE / (bytes_per_sample * alsa_hw.num_channels)))
-			count = READ_BUFFER_SIZE / (bytes_per_sample * alsa_hw.num_channels);
-		count = snd_pcm_readi(alsa_hw.handle, buff, count);
-
-		/*Loop around samples, if stereo we are
-		 * only interested in one channel*/
-		for (i = 0; i < count; i++) {
-			/* cs == current sample */
-			unsigned char cs, as, sl, sz, xz;
-			unsigned short stmp;
-
-			if (bytes_per_sample == 2) {
-				int ix = i * bytes_per_sample * alsa_hw.num_channels +
-					     bytes_per_sample * alsa_hw.channel;
-				memcpy(&stmp, &buff[ix], sizeof(stmp));
-				cs = stmp >> 8;
-				cs ^= 0x80;
-			} else {
-				cs = buff[i];
-
-				/* Convert signed samples to unsigned */
-				if (alsa_hw.format == SND_PCM_FORMAT_S8)
-					cs ^= 0x80;
+	long long maxcount = (((PULSE_MASK << 8) | 0xff) / mulconst) << 8;
+	/* sample_count at sample base */
+	long long count = demod.sample_count;
+	int base = 0;
+	unsigned char sz, sl;
+	uint64_t word;
+	int got = 0;
+	int i = 0;
+
+	sz = track_envelope(s, n);
+	/* Don't let too low signal levels as it makes us sensible to noise */
+	sl = demod.signal_level < 16 ? 16 : demod.signal_level;
+	find_edges(s, blk.edges, n, sz, sl / 2);
+
+	while (i < n) {
+		/* Skip runs without level changes a word at a time */
+		if (i + (int)sizeof(word) <= n) {
+			memcpy(&word, blk.edges + i, sizeof(word));
+			if (word == 0) {
+				i += sizeof(word);
+				continue;
 			}
-
-			/* Track signal middle value (it could differ from 0x80) */
-			sz = (signal_min + signal_max) / 2;
-			if (cs <= sz)
-				signal_min = (signal_min * 7 + cs) / 8;
-			if (cs >= sz)
-				signal_max = (signal_max * 7 + cs) / 8;
-
-			/* Compute the absolute signal deviation from middle */
-			as = U8_ABSDIFF(cs, sz);
-
-			/* Integrate incoming signal (auto level adjustment) */
-			signal_level = (signal_level * 7 + as) / 8;
-
-			/* Don't let too low signal levels as it makes us sensible to noise */
-			sl = signal_level;
-			if (sl < 16)
-				sl = 16;
-
-			/* Detect crossing current "zero" level */
-			xz = ((cs - sz) ^ (ps - sz)) & 0x80;
-
-			/* Don't wait for zero crossing for too long */
-			if (waiting_zerox && !xz)
-				waiting_zerox--;
-
-			/* Detect significant signal level changes */
-			if ((abs(cs - ps) > sl / 2) && xz)
-				waiting_zerox = 2;
-
-			/* If we have crossed zero with a substantial level change, go */
-			if (waiting_zerox && xz) {
-				lirc_t x;
-
-				waiting_zerox = 0;
-
-				if (sample_count >= maxcount) {
-					x = PULSE_MASK;
-					sample_count = 0;
-				} else {
-					/**
-					 * Try to interpolate the samples and determine where exactly
-					 * the zero crossing point was. This is required as the
-					 * remote signal frequency is relatively close to our sampling
-					 * frequency thus a sampling error of 1 sample can lead to
-					 * substantial time differences.
-					 *
-					 *     slope = (x2 - x1) / (y2 - y1)
-					 *     x = x1 + (y - y1) * slope
-					 *
-					 * where x1=-1, x2=0, y1=ps, y2=cs, y=sz, thus:
-					 *
-					 *     x = -1 + (y - y1) / (y2 - y1), or
-					 * ==> x = (y - y2) / (y2 - y1)
-					 *
-					 * y2 (cs) cannot be equal to y1 (ps), otherwise we wouldn't
-					 * get here.
-					 */
-					int delta = (((int)sz - (int)cs) << 8) / ((int)cs - (int)ps);
-					/* This expression can easily overflow the 'long' value since it
-					 * multiplies two 24.8 values (and we get a 24.16 instead).
-					 * To avoid this we cast the intermediate value to "long long".
-					 */
-					x = (((long long)sample_count + delta) * mulconst) >> 16;
-					/* The rest of the quantum is on behalf of next pulse. Note that
-					 * sample_count can easily be assigned here a negative value (in
-					 * the case zero crossing occurs during the next quantum).
-					 */
-					sample_count = -delta;
-				}
-
-				/* Consider impossible pulses with length greater than
-				 * 0.02 seconds, thus it is a space (desynchronization).
+		}
+		if (blk.edges[i]) {
+			/* Index of sample crossing the middle */
+			int j = blk.edges[i] & EDGE_NOW ? i : i - 1;
+			unsigned char cs = s[j];
+			unsigned char ps = s[j - 1];
+			long long sample_count = count + (j - base) * 0x100LL;
+			int delta = 0;
+			lirc_t x;
+
+			if (sample_count >= maxcount) {
+				x = PULSE_MASK;
+			} else {
+				/**
+				 * Try to interpolate the samples and determine where exactly
+				 * the zero crossing point was. This is required as the
+				 * remote signal frequency is relatively close to our sampling
+				 * frequency thus a sampling error of 1 sample can lead to
+				 * substantial time differences.
+				 *
+				 *     slope = (x2 - x1) / (y2 - y1)
+				 *     x = x1 + (y - y1) * slope
+				 *
+				 * where x1=-1, x2=0, y1=ps, y2=cs, y=sz, thus:
+				 *
+				 *     x = -1 + (y - y1) / (y2 - y1), or
+				 * ==> x = (y - y2) / (y2 - y1)
+				 *
+				 * y2 (cs) cannot be equal to y1 (ps), otherwise we wouldn't
+				 * get here.
 				 */
-				if ((x > 20000) && signal_state) {
-					signal_state = 0;
-					log_trace("Pulse/space desynchronization fixed - len %u", x);
-				}
-
-				x |= signal_state;
-
-				/* Write the LIRC code to the FIFO */
-				chk_write(alsa_hw.fd, &x, sizeof(x));
-
-				signal_state ^= PULSE_BIT;
+				delta = (((int)sz - (int)cs) << 8) / ((int)cs - (int)ps);
+				x = ((sample_count + delta) * mulconst) >> 16;
 			}
 
-			/* Remember previous sample */
-			ps = cs;
+			/* Consider impossible pulses with length greater than
+			 * 0.02 seconds, thus it is a space (desynchronization).
+			 */
+			if ((x > 20000) && demod.signal_state) {
+				demod.signal_state = 0;
+				log_trace("Pulse/space desynchronization fixed - len %u", x);
+			}
+			buf[got++] = x | demod.signal_state;
+			demod.signal_state ^= PULSE_BIT;
 
-			/* Count number of samples with the same level.
-			 * sample_count can be less than zero at the start of pulse
-			 * (due to interpolation) so we have to consider them.
+			/* The rest of the quantum is on behalf of next pulse. Note that
+			 * the count can be less than zero here (in the case zero
+			 * crossing occurs during the next quantum).
 			 */
-			if ((sample_count < UINT_MAX - 0x400)
-			    || (sample_count > UINT_MAX - 0x200))
-				sample_count += 0x100;
+			count = -delta + 0x100;
+			base = j + 1;
 		}
+		i++;
 	}
+	count += (n - base) * 0x100LL;
+	demod.sample_count = count < maxcount ? count : maxcount;
+	memmove(blk.samples, blk.samples + n, HISTORY);
+	return got;
+}
+
+/* reader_thread function: read and demodulate one period of samples. */
+static int alsa_read(void* arg, void* buf, size_t size)
+{
+	snd_pcm_sframes_t count;
+
+	count = snd_pcm_readi(alsa_hw.handle, blk.pcm, alsa_hw.period_size);
+	if (count < 0) {
+		/* Overrun or suspend. This happens, for example, when the
+		 * X11 server starts. If we won't recover, recording will
+		 * stop forever.
+		 */
+		if (alsa_error("recover",
+			       snd_pcm_recover(alsa_hw.handle, count, 1)))
+			return -1;
+		log_debug("audio_alsa: recovered from %s", snd_strerror(count));
+		demod_reset();
+		return 0;
+	}
+	if (count == 0)
+		return 0;
+	convert_block(count);
+	return demod_block(count, (lirc_t*)buf) * sizeof(lirc_t);
 }
 
 lirc_t audio_alsa_readdata(lirc_t timeout)
@@ -33,12 +33,10 @@
 #endif
 
 #include <errno.h>
-#include <signal.h>
 #include <string.h>
 #include <unistd.h>
 #include <usb.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <time.h>
 
 #include "lirc_driver.h"
@@ -46,7 +44,8 @@
 #define AW_MODE_LIRCCODE 1
 
 #define AWUSB_RECEIVE_BYTES 5
-#define USB_TIMEOUT (1000 * 60)
+/* Short, awlibusb_deinit() waits for a pending read to time out. */
+#define USB_TIMEOUT 250
 #define AW_VENDOR_THOMSON 0x069b
 #define AW_DEVICE_THOMSON 0x1111
 
@@ -63,7 +62,7 @@ static char device_path[10000] = {0};
 static int awlibusb_init(void);
 static int awlibusb_deinit(void);
 static char* awlibusb_rec(struct ir_remote* remotes);
-static void usb_read_loop(int fd);
+static int usb_read(void* arg, void* buf, size_t size);
 static struct usb_device* find_usb_device(void);
 static int find_device_endpoints(struct usb_device* dev);
 static int drvctl_func(unsigned int cmd, void* arg);
@@ -131,7 +130,8 @@ static usb_device_id usb_remote_id_table[] = {
 
 static struct usb_dev_handle* dev_handle = NULL;
 static struct usb_endpoint_descriptor* dev_ep_in = NULL;
-static pid_t child = -1;
+static struct reader_thread reader;
+static int inited = 0;
 
 /****/
 
@@ -153,21 +153,11 @@ static int drvctl_func(unsigned int cmd, void* arg)
 static int awlibusb_init(void)
 {
 	struct usb_device* usb_dev;
-	int pipe_fd[2] = { -1, -1 };
 
 	log_trace("initializing USB receiver");
 
 	rec_buffer_init();
 
-	/* A separate process will be forked to read data from the USB
-	 * receiver and write it to a pipe. drv.fd is set to the readable
-	 * end of this pipe. */
-	if (pipe(pipe_fd) != 0) {
-		log_perror_err("couldn't open pipe");
-		return 0;
-	}
-	drv.fd = pipe_fd[0];
-
 	usb_dev = find_usb_device();
 	if (usb_dev == NULL) {
 		log_error("couldn't find a compatible USB device");
@@ -196,13 +186,13 @@ static int awlibusb_init(void)
 	drv.device = device_path;
 	log_debug("atilibusb: using device: %s", device_path);
 
-	child = fork();
-	if (child == -1) {
-		log_perror_err("couldn't fork child process");
+	/* A separate thread reads data from the USB receiver, drv.fd
+	 * is the readable end of its data stream. */
+	inited = 0;
+	drv.fd = reader_thread_start(&reader, usb_read, NULL,
+				     AWUSB_RECEIVE_BYTES);
+	if (drv.fd == -1)
 		goto fail;
-	} else if (child == 0) {
-		usb_read_loop(pipe_fd[1]);
-	}
 
 	log_trace("USB receiver initialized");
 	return 1;
@@ -212,10 +202,6 @@ fail:
 		usb_close(dev_handle);
 		dev_handle = NULL;
 	}
-	if (pipe_fd[0] >= 0)
-		close(pipe_fd[0]);
-	if (pipe_fd[1] >= 0)
-		close(pipe_fd[1]);
 	return 0;
 }
 
@@ -224,24 +210,15 @@ static int awlibusb_deinit(void)
 {
 	int err = 0;
 
+	reader_thread_stop(&reader);
+	drv.fd = -1;
+
 	if (dev_handle) {
 		if (usb_close(dev_handle) < 0)
 			err = 1;
 		dev_handle = NULL;
 	}
 
-	if (drv.fd >= 0) {
-		if (close(drv.fd) < 0)
-			err = 1;
-		drv.fd = -1;
-	}
-
-	if (child > 1) {
-		if ((kill(child, SIGTERM) == -1)
-		    || (waitpid(child, NULL, 0) == 0))
-			err = 1;
-	}
-
 	return !err;
 }
 
@@ -316,13 +293,13 @@ static int find_device_endpoints(struct usb_device* dev)
 	return 1;
 }
 
-/* this function is run in a forked process to read data from the USB
- * receiver and write it to the given fd. it calls exit() with result
- * code 0 on success, or 1 on failure. */
-static void usb_read_loop(int fd)
+/* this function is run on the reader thread to read data from the USB
+ * receiver into buf. returns number of bytes in buf, 0 if there is no
+ * data and -1 on errors. */
+static int usb_read(void* arg, void* buf, size_t size)
 {
-	int inited = 0;
-	int err = 0;
+	char data[AWUSB_RECEIVE_BYTES];
+	int bytes_r;
 
 #if !defined(AW_MODE_LIRCCODE)
 	long elapsed_seconds = 0;       /* diff between seconds counter */
@@ -330,67 +307,41 @@ static void usb_read_loop(int fd)
 	long time_diff = 0;
 #endif
 
-	alarm(0);
-	signal(SIGTERM, SIG_DFL);
-	signal(SIGPIPE, SIG_DFL);
-	signal(SIGINT, SIG_DFL);
-	signal(SIGHUP, SIG_IGN);
-	signal(SIGALRM, SIG_IGN);
-
-	for (;; ) {
-		char buf[AWUSB_RECEIVE_BYTES];
-		int bytes_r, bytes_w;
-
-		/* read from the USB device */
-		bytes_r =
-			usb_interrupt_read(dev_handle, dev_ep_in->bEndpointAddress, &buf[0], sizeof(buf), USB_TIMEOUT);
-		if (bytes_r < 0) {
-			if (errno == EAGAIN || errno == ETIMEDOUT)
-				continue;
-			log_perror_err("can't read from USB device");
-			err = 1;
-			goto done;
-		}
-
-		/* sometimes the remote sends one byte on startup; ignore it */
-		if (!inited) {
-			inited = 1;
-			if (bytes_r == 1)
-				continue;
-		}
+	/* read from the USB device */
+	bytes_r = usb_interrupt_read(dev_handle, dev_ep_in->bEndpointAddress,
+				     &data[0], sizeof(data), USB_TIMEOUT);
+	if (bytes_r < 0) {
+		if (errno == EAGAIN || errno == ETIMEDOUT)
+			return 0;
+		log_perror_err("can't read from USB device");
+		return -1;
+	}
+
+	/* sometimes the remote sends one byte on startup; ignore it */
+	if (!inited) {
+		inited = 1;
+		if (bytes_r == 1)
+			return 0;
+	}
 #ifdef AW_MODE_LIRCCODE
-		bytes_w = write(fd, &(buf[1]), (AWUSB_RECEIVE_BYTES - 1));
-		/* ignore first byte */
-		if (bytes_w < 0) {
-			log_perror_err("can't write to pipe");
-			err = 1;
-			goto done;
-		}
+	/* ignore first byte */
+	memcpy(buf, &data[1], AWUSB_RECEIVE_BYTES - 1);
+	return AWUSB_RECEIVE_BYTES - 1;
 #else
-		code = buf[AWUSB_RECEIVE_BYTES - 2];
-
-		/* calculate time diff */
-		gettimeofday(&time_current, NULL);
-		elapsed_seconds = time_current.tv_sec - time_last.tv_sec;
-		elapsed_useconds = time_current.tv_usec - time_last.tv_usec;
-		time_diff = (elapsed_seconds) * 1000000 + elapsed_useconds;
-		//printf("time_diff = %d usec\n", time_diff);
-
-		if (!((code == code_last) && (time_diff < AW_KEY_GAP))) {
-			bytes_w = write(fd, &code, 1);
-			if (bytes_w < 0) {
-				log_perror_err("can't write to pipe");
-				err = 1;
-				goto done;
-			}
-			code_last = code;
-			memcpy(&time_last, &time_current, sizeof(struct timeval));
-		}
-#endif
-	}
+	code = data[AWUSB_RECEIVE_BYTES - 2];
+
+	/* calculate time diff */
+	gettimeofday(&time_current, NULL);
+	elapsed_seconds = time_current.tv_sec - time_last.tv_sec;
+	elapsed_useconds = time_current.tv_usec - time_last.tv_usec;
+	time_diff = (elapsed_seconds) * 1000000 + elapsed_useconds;
+	//printf("time_diff = %d usec\n", time_diff);
 
-done:
-	if (!usb_close(dev_handle))
-		err = 1;
-	_exit(err);
+	if ((code == code_last) && (time_diff < AW_KEY_GAP))
+		return 0;
+	code_last = code;
+	memcpy(&time_last, &time_current, sizeof(struct timeval));
+	*(char*)buf = code;
+	return 1;
+#endif
 }
@@ -30,6 +30,9 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#ifdef __GLIBC__
+#include <sys/sysmacros.h>
+#endif
 
 #include "media/lirc.h"
 
@@ -62,6 +65,8 @@ static int default_send(struct ir_remote* remote, struct ir_ncode* code);
 static char* default_rec(struct ir_remote* remotes);
 static int default_ioctl(unsigned int cmd, void* arg);
 static lirc_t default_readdata(lirc_t timeout);
+static int default_readdata_bulk(lirc_t* buf, size_t n, uint64_t* ts,
+				 lirc_t timeout);
 static int my_open(const char* path);
 static int drvctl(unsigned int cmd, void* arg);
 
@@ -83,10 +88,11 @@ static const struct driver hw_default = {
 	.decode_func	= receive_decode,
 	.drvctl_func	= drvctl,
 	.readdata	= default_readdata,
-	.api_version	= 3,
+	.api_version	= 4,
 	.driver_version = "0.10.2",
 	.info		= "See file://" PLUGINDOCS "/default.html",
 	.device_hint    = "drvctl",
+	.readdata_bulk	= default_readdata_bulk,
 };
 
 
@@ -101,6 +107,18 @@ const struct driver* hardwares[] = { &hw_default, (const struct driver*)NULL };
 
 static int write_send_buffer(int lirc);
 
+/** Max number of mode2 samples read by each read(). */
+#define SAMPLE_BATCH    512
+
+/** Samples read from device, not yet returned by readdata(). */
+static struct {
+	unsigned char	data[SAMPLE_BATCH * sizeof(int)];
+	size_t		head;           /**< First unused byte. */
+	size_t		tail;           /**< First free byte. */
+	uint64_t	read_ns;        /**< Time of last read(). */
+	uint64_t	after_ns;       /**< Duration of samples after head. */
+} samples;
+
 /***************************************************
 *
 * /sys/class/rc  stuff.
@@ -261,37 +279,74 @@ int my_open(const char* path)
 * decode stuff
 *
 **********************************************************************/
-int default_readdata(lirc_t timeout)
+/** Total duration (ns) of the complete samples in buf. */
+static uint64_t duration_ns(const unsigned char* buf, size_t size)
 {
-	int data, ret;
-	static int last_space = (lirc_t) 0;
+	uint64_t sum = 0;
+	int data;
 
-	if (!waitfordata((long)timeout))
-		return 0;
+	for (; size >= sizeof(data); size -= sizeof(data)) {
+		memcpy(&data, buf, sizeof(data));
+		sum += (uint64_t)(data & PULSE_MASK) * 1000;
+		buf += sizeof(data);
+	}
+	return sum;
+}
 
-	ret = read(drv.fd, &data, sizeof(data));
-	if (ret != sizeof(data)) {
-		log_perror_err("error reading from %s (ret %d, expected %d)",
-			  drv.device, ret, sizeof(data));
-		default_deinit();
 
-		return 0;
-	}
-	if (last_space == LIRC_SPACE(LIRC_VALUE_MASK) && LIRC_IS_SPACE(data)) {
-		/* Work around #172. */
+/**
+ * Get next sample from the samples buffer. When empty, refill it with
+ * all samples available in one read(). The last sample read is assumed
+ * to end at the time of the read(), the timestamps of the earlier ones
+ * are estimated from the durations of the samples after them.
+ * @return 1 if *data and *ts are updated, 0 on timeout and errors.
+ */
+static int next_sample(lirc_t timeout, int* data, uint64_t* ts)
+{
+	ssize_t ret;
+
+	while (samples.tail - samples.head < sizeof(*data)) {
+		/* Keep any partial sample from a socket or fifo. */
+		samples.tail -= samples.head;
+		memmove(samples.data, samples.data + samples.head, samples.tail);
+		samples.head = 0;
 		if (!waitfordata((long)timeout))
 			return 0;
-
-		ret = read(drv.fd, &data, sizeof(data));
-		if (ret != sizeof(data)) {
-			log_perror_err(
-				"error reading from %s (got %d, expected %d)",
-				drv.device, ret, sizeof(data));
+		ret = read(drv.fd, samples.data + samples.tail,
+			   sizeof(samples.data) - samples.tail);
+		if (ret <= 0) {
+			log_perror_err("error reading from %s (ret %d)",
+				       drv.device, (int)ret);
 			default_deinit();
 			return 0;
 		}
+		samples.read_ns = time_now_ns();
+		samples.tail += ret;
+		samples.after_ns = duration_ns(samples.data, samples.tail);
+	}
+	memcpy(data, samples.data + samples.head, sizeof(*data));
+	samples.head += sizeof(*data);
+	samples.after_ns -= (uint64_t)(*data & PULSE_MASK) * 1000;
+	*ts = samples.read_ns - samples.after_ns;
+	return 1;
+}
+
+
+/**
+ * Filter a sample read from the device.
+ * @return 0 if sample should be dropped, else 1 with *data possibly
+ *     updated.
+ */
+static int filter_sample(int* data)
+{
+	static int last_space = (lirc_t) 0;
+
+	if (last_space == LIRC_SPACE(LIRC_VALUE_MASK) && LIRC_IS_SPACE(*data)) {
+		/* Work around #172. */
+		last_space = 0;
+		return 0;
 	}
-	if (data == 0) {
+	if (*data == 0) {
 		static int data_warning = 1;
 
 		if (data_warning) {
@@ -299,10 +354,41 @@ int default_readdata(lirc_t timeout)
 				  drv.device);
 			data_warning = 0;
 		}
-		data = 1;
+		*data = 1;
 	}
-	last_space = data;
-	return data;
+	last_space = *data;
+	return 1;
+}
+
+
+static int default_readdata_bulk(lirc_t* buf, size_t n, uint64_t* ts,
+				 lirc_t timeout)
+{
+	size_t count = 0;
+	uint64_t stamp;
+	int data;
+
+	while (count < n) {
+		if (count > 0 && samples.tail - samples.head < sizeof(data))
+			break;
+		if (!next_sample(timeout, &data, &stamp))
+			break;
+		if (!filter_sample(&data))
+			continue;
+		buf[count] = data;
+		if (ts != NULL)
+			ts[count] = stamp;
+		count += 1;
+	}
+	return count;
+}
+
+
+lirc_t default_readdata(lirc_t timeout)
+{
+	lirc_t data;
+
+	return default_readdata_bulk(&data, 1, NULL, timeout) == 1 ? data : 0;
 }
 
 /*
@@ -451,6 +537,8 @@ int default_deinit(void)
 		close(drv.fd);
 		drv.fd = -1;
 	}
+	samples.head = 0;
+	samples.tail = 0;
 	return 1;
 }
 
@@ -534,6 +622,9 @@ static int drvctl(unsigned int cmd, void* arg)
 		return 0;
 	case LIRC_SET_TRANSMITTER_MASK:
 		return default_ioctl(LIRC_SET_TRANSMITTER_MASK, arg);
+	case DRVCTL_GET_PENDING:
+		*(int*)arg = (samples.tail - samples.head) / sizeof(int);
+		return 0;
 	default:
 		return DRV_ERR_NOT_IMPLEMENTED;
 	}
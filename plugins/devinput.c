@@ -26,6 +26,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/fcntl.h>
 #include <sys/types.h>
@@ -102,7 +103,20 @@ static ir_code code;
 static ir_code code_compat;
 static int exclusive = 0;
 static int uinputfd = -1;
-static struct timeval start, end, last;
+static struct timeval start, last;
+static int monotonic_events = 0;
+static uint64_t event_timestamp;
+
+/** Max number of events fetched by each read(). */
+#define EVENT_BATCH 64
+
+/* Events read but not yet handled, see read_events(). */
+static struct input_event events[EVENT_BATCH];
+static int event_count = 0;
+static int event_pos = 0;
+
+/* Keys forwarded to uinput, from EVIOCGBIT in setup_uinputfd(). */
+static long forward_keys[NBITS(KEY_MAX)];
 
 enum {
 	RPT_UNKNOWN = -1,
@@ -120,6 +134,7 @@ static int setup_uinputfd(const char* name, int source)
 	long events[NBITS(EV_MAX)];
 	long bits[NBITS(KEY_MAX)];
 
+	memset(forward_keys, 0, sizeof(forward_keys));
 	if (ioctl(source, EVIOCGBIT(0, EV_MAX), events) == -1)
 		return -1;
 	if (!test_bit(EV_REL, events) && !test_bit(EV_ABS, events))
@@ -163,6 +178,7 @@ static int setup_uinputfd(const char* name, int source)
 			if (test_bit(key, bits)) {
 				if (ioctl(fd, UI_SET_KEYBIT, key) == -1)
 					goto setup_error;
+				forward_keys[LONG(key)] |= BIT(key);
 			}
 		}
 	}
@@ -367,6 +383,8 @@ int devinput_init(void)
 		}
 	}
 	log_info("Using device: %s", drv.device);
+	event_count = 0;
+	event_pos = 0;
 	drv.fd = open(drv.device, O_RDONLY);
 	if (drv.fd < 0) {
 		log_error("unable to open '%s'", drv.device);
@@ -378,6 +396,14 @@ int devinput_init(void)
 		exclusive = 0;
 		log_warn("can't get exclusive access to events coming from `%s' interface", drv.device);
 	}
+#endif
+#ifdef EVIOCSCLOCKID
+	{
+		int clk = CLOCK_MONOTONIC;
+
+		/* Event times are then comparable to time_now_ns(). */
+		monotonic_events = ioctl(drv.fd, EVIOCSCLOCKID, &clk) == 0;
+	}
 #endif
 	return 1;
 }
@@ -403,6 +429,8 @@ int devinput_deinit(void)
 	}
 	close(drv.fd);
 	drv.fd = -1;
+	event_count = 0;
+	event_pos = 0;
 	return 1;
 }
 
@@ -424,6 +452,8 @@ int devinput_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 	}
 
 	map_gap(remote, ctx, &start, &last, 0);
+	ctx->timestamp = event_timestamp;
+	ctx->captured = event_timestamp;
 	/* override repeat */
 	switch (repeat_state) {
 	case RPT_NO:
@@ -439,43 +469,85 @@ int devinput_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 	return 1;
 }
 
-char* devinput_rec(struct ir_remote* remotes)
+/** Read all available events, at most EVENT_BATCH, into events. */
+static int read_events(void)
 {
-	struct input_event event;
-	int rd;
-	ir_code value;
-
-	log_trace("devinput_rec");
+	ssize_t rd;
 
-	last = end;
-	gettimeofday(&start, NULL);
-
-	rd = read(drv.fd, &event, sizeof(event));
-	if (rd != sizeof(event)) {
+	event_count = 0;
+	event_pos = 0;
+	rd = read(drv.fd, events, sizeof(events));
+	if (rd <= 0 || rd % sizeof(struct input_event) != 0) {
 		log_error("error reading '%s'", drv.device);
 		if (rd <= 0 && errno != EINTR)
 			devinput_deinit();
 		return 0;
 	}
+	event_count = rd / sizeof(struct input_event);
+	return 1;
+}
+
+
+static int is_forwarded(const struct input_event* event)
+{
+	if (uinputfd == -1)
+		return 0;
+	switch (event->type) {
+	case EV_REL:
+	case EV_ABS:
+	case EV_SYN:
+		return 1;
+	case EV_KEY:
+		return event->code <= KEY_MAX
+		       && test_bit(event->code, forward_keys);
+	default:
+		return 0;
+	}
+}
+
 
-	log_trace("time %ld.%06ld  type %d  code %d  value %d", event.time.tv_sec, event.time.tv_usec, event.type,
-		  event.code, event.value);
+/**
+ * Return 1 if event is an autorepeat followed by another one for the
+ * same key among the queued events, only separated by EV_SYN or EV_MSC.
+ * Such a burst has piled up while lircd was busy and is decoded once.
+ */
+static int is_stale_repeat(const struct input_event* event)
+{
+	int i;
 
-	value = (unsigned)event.value;
+	if (event->type != EV_KEY || event->value != 2)
+		return 0;
+	for (i = event_pos; i < event_count; i += 1) {
+		if (events[i].type == EV_SYN || events[i].type == EV_MSC)
+			continue;
+		return events[i].type == EV_KEY
+		       && events[i].code == event->code
+		       && events[i].value == 2;
+	}
+	return 0;
+}
+
+
+/** Update code, code_compat, repeat_state and timestamps from event. */
+static void set_code(const struct input_event* event)
+{
+	ir_code value;
+
+	value = (unsigned)event->value;
 #ifdef EV_SW
-	if (value == 2 && (event.type == EV_KEY || event.type == EV_SW))
+	if (value == 2 && (event->type == EV_KEY || event->type == EV_SW))
 		value = 1;
-	code_compat = ((event.type == EV_KEY || event.type == EV_SW) && event.value != 0) ? 0x80000000 : 0;
+	code_compat = ((event->type == EV_KEY || event->type == EV_SW) && event->value != 0) ? 0x80000000 : 0;
 #else
-	if (value == 2 && event.type == EV_KEY)
+	if (value == 2 && event->type == EV_KEY)
 		value = 1;
-	code_compat = ((event.type == EV_KEY) && event.value != 0) ? 0x80000000 : 0;
+	code_compat = ((event->type == EV_KEY) && event->value != 0) ? 0x80000000 : 0;
 #endif
-	code_compat |= ((event.type & 0x7fff) << 16);
-	code_compat |= event.code;
+	code_compat |= ((event->type & 0x7fff) << 16);
+	code_compat |= event->code;
 
-	if (event.type == EV_KEY) {
-		if (event.value == 2)
+	if (event->type == EV_KEY) {
+		if (event->value == 2)
 			repeat_state = RPT_YES;
 		else
 			repeat_state = RPT_NO;
@@ -483,27 +555,64 @@ char* devinput_rec(struct ir_remote* remotes)
 		repeat_state = RPT_UNKNOWN;
 	}
 
-	code = ((ir_code)(unsigned)event.type) << 48 | ((ir_code)(unsigned)event.code) << 32 | value;
+	/* Kernel event times: unaffected by batching and decode delays. */
+	last = start;
+	start.tv_sec = event->time.tv_sec;
+	start.tv_usec = event->time.tv_usec;
+	if (monotonic_events)
+		event_timestamp = (uint64_t)event->time.tv_sec * 1000000000
+				  + (uint64_t)event->time.tv_usec * 1000;
+	else
+		event_timestamp = 0;
+
+	code = ((ir_code)(unsigned)event->type) << 48 | ((ir_code)(unsigned)event->code) << 32 | value;
 
 	log_trace("code %.16llx", code);
+}
 
-	if (uinputfd != -1) {
-		if (event.type == EV_REL || event.type == EV_ABS
-		    || (event.type == EV_KEY && event.code >= BTN_MISC && event.code <= BTN_GEAR_UP)
-		    || event.type == EV_SYN) {
-			log_trace("forwarding: %04x %04x", event.type, event.code);
-			if (write(uinputfd, &event, sizeof(event)) != sizeof(event))
-				log_perror_err("writing to uinput failed");
-			return NULL;
-		}
-	}
 
-	/* ignore EV_SYN */
-	if (event.type == EV_SYN)
+char* devinput_rec(struct ir_remote* remotes)
+{
+	struct input_event forward[EVENT_BATCH];
+	const struct input_event* event;
+	int forwarded = 0;
+	char* message = NULL;
+	ssize_t size;
+
+	log_trace("devinput_rec");
+
+	if (event_pos >= event_count && !read_events())
 		return NULL;
 
-	gettimeofday(&end, NULL);
-	return decode_all(remotes);
+	while (message == NULL && event_pos < event_count) {
+		event = &events[event_pos++];
+		log_trace("time %ld.%06ld  type %d  code %d  value %d",
+			  (long)event->time.tv_sec, (long)event->time.tv_usec,
+			  event->type, event->code, event->value);
+		if (is_forwarded(event)) {
+			log_trace("forwarding: %04x %04x", event->type, event->code);
+			forward[forwarded++] = *event;
+			continue;
+		}
+		/* ignore EV_SYN */
+		if (event->type == EV_SYN)
+			continue;
+		if (is_stale_repeat(event)) {
+			log_trace("skipping queued repeat");
+			continue;
+		}
+		set_code(event);
+		message = decode_all(remotes);
+		/* Without remotes, e. g. irrecord, caller decodes code. */
+		if (remotes == NULL)
+			break;
+	}
+	if (forwarded > 0) {
+		size = forwarded * sizeof(struct input_event);
+		if (write(uinputfd, forward, size) != size)
+			log_perror_err("writing to uinput failed");
+	}
+	return message;
 }
 
 
@@ -518,6 +627,9 @@ static int drvctl(unsigned int cmd, void* arg)
 	case DRVCTL_GET_RAW_CODELENGTH:
 		*(unsigned int*)arg = sizeof(struct input_event) * 8;
 		return 0;
+	case DRVCTL_GET_PENDING:
+		*(int*)arg = event_count - event_pos;
+		return 0;
 	default:
 		return DRV_ERR_NOT_IMPLEMENTED;
 	}
@@ -26,17 +26,18 @@
 #endif
 
 #include <errno.h>
-#include <signal.h>
 #include <string.h>
 #include <unistd.h>
 #include <usb.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 
 #include "lirc_driver.h"
 
 #define CODE_BYTES 6
-#define USB_TIMEOUT (5000)
+/* Short, dfc_deinit() waits for a pending read to time out. */
+#define USB_TIMEOUT 250
+/* Size of each control message read. */
+#define USB_BUF_SIZE 16
 
 
 static const logchannel_t logchannel = LOG_DRIVER;
@@ -46,7 +47,7 @@ static char device_path[10000] = {0};
 static int dfc_init(void);
 static int dfc_deinit(void);
 static char* dfc_rec(struct ir_remote* remotes);
-static void usb_read_loop(int fd);
+static int usb_read(void* arg, void* buf, size_t size);
 static struct usb_device* find_usb_device(void);
 static int drvctl_func(unsigned int cmd, void* arg);
 
@@ -87,7 +88,10 @@ static usb_device_id usb_remote_id_table[] = {
 };
 
 static struct usb_dev_handle* dev_handle = NULL;
-static pid_t child = -1;
+static struct reader_thread reader;
+/* Partial code read by usb_read(). */
+static char rcv_code[CODE_BYTES];
+static int rcv_count = 0;
 
 /****/
 
@@ -109,7 +113,6 @@ static int drvctl_func(unsigned int cmd, void* arg)
 static int dfc_init(void)
 {
 	struct usb_device* usb_dev;
-	int pipe_fd[2] = { -1, -1 };
 
 	log_trace("initializing USB receiver");
 
@@ -125,15 +128,6 @@ static int dfc_init(void)
 		return 0;
 	}
 
-	/* A separate process will be forked to read data from the USB
-	 * receiver and write it to a pipe. drv.fd is set to the readable
-	 * end of this pipe. */
-	if (pipe(pipe_fd) != 0) {
-		log_perror_err("couldn't open pipe");
-		return 0;
-	}
-	drv.fd = pipe_fd[0];
-
 	dev_handle = usb_open(usb_dev);
 	if (dev_handle == NULL) {
 		log_perror_err("couldn't open USB receiver");
@@ -146,13 +140,13 @@ static int dfc_init(void)
 	drv.device = device_path;
 	log_debug("atilibusb: using device: %s", device_path);
 
-	child = fork();
-	if (child == -1) {
-		log_perror_err("couldn't fork child process");
+	/* A separate thread reads data from the USB receiver, drv.fd
+	 * is the readable end of its data stream. */
+	rcv_count = 0;
+	drv.fd = reader_thread_start(&reader, usb_read, NULL,
+				     USB_BUF_SIZE + CODE_BYTES);
+	if (drv.fd == -1)
 		goto fail;
-	} else if (child == 0) {
-		usb_read_loop(pipe_fd[1]);
-	}
 
 	log_trace("USB receiver initialized");
 	return 1;
@@ -162,10 +156,6 @@ fail:
 		usb_close(dev_handle);
 		dev_handle = NULL;
 	}
-	if (pipe_fd[0] >= 0)
-		close(pipe_fd[0]);
-	if (pipe_fd[1] >= 0)
-		close(pipe_fd[1]);
 	return 0;
 }
 
@@ -175,22 +165,15 @@ static int dfc_deinit(void)
 {
 	int err = 0;
 
+	reader_thread_stop(&reader);
+	drv.fd = -1;
+
 	if (dev_handle) {
 		if (usb_close(dev_handle) < 0)
 			err = 1;
 		dev_handle = NULL;
 	}
 
-	if (drv.fd >= 0) {
-		if (close(drv.fd) < 0)
-			err = 1;
-		drv.fd = -1;
-	}
-
-	if (child > 1)
-		if ((kill(child, SIGTERM) == -1) || (waitpid(child, NULL, 0) == 0))
-			err = 1;
-
 	return !err;
 }
 
@@ -237,64 +220,35 @@ static struct usb_device* find_usb_device(void)
 	return NULL;            /* no suitable device found */
 }
 
-/* this function is run in a forked process to read data from the USB
- * receiver and write it to the given fd. it calls exit() with result
- * code 0 on success, or 1 on failure. */
-static void usb_read_loop(int fd)
+/* this function is run on the reader thread to read data from the USB
+ * receiver. complete codes are copied to buf, returns number of bytes
+ * in buf or -1 on errors. */
+static int usb_read(void* arg, void* buf, size_t size)
 {
-	int err = 0;
-	char rcv_code[6];
-	int ptr = 0, count;
-
-	alarm(0);
-	signal(SIGTERM, SIG_DFL);
-	signal(SIGPIPE, SIG_DFL);
-	signal(SIGINT, SIG_DFL);
-	signal(SIGHUP, SIG_IGN);
-	signal(SIGALRM, SIG_IGN);
-
-	for (;; ) {
-		char buf[16];   // CODE_BYTES
-		int bytes_r, bytes_w, pos;
-
-		/* read from the USB device */
-		bytes_r =
-			usb_control_msg(dev_handle,
-					USB_TYPE_VENDOR | USB_RECIP_DEVICE | USB_ENDPOINT_IN, 3, 0, 0, &buf[0],
-					sizeof(buf), USB_TIMEOUT);
-
-		if (bytes_r < 0) {
-			if (errno == EAGAIN || errno == ETIMEDOUT)
-				continue;
-			log_error("can't read from USB device: %s", strerror(errno));
-			err = 1;
-			goto done;
-		}
+	char data[USB_BUF_SIZE];
+	char* out = (char*)buf;
+	int bytes_r;
+	int count;
+	int n = 0;
+
+	/* read from the USB device */
+	bytes_r = usb_control_msg(dev_handle,
+				  USB_TYPE_VENDOR | USB_RECIP_DEVICE | USB_ENDPOINT_IN,
+				  3, 0, 0, &data[0], sizeof(data), USB_TIMEOUT);
+	if (bytes_r < 0) {
+		if (errno == EAGAIN || errno == ETIMEDOUT)
+			return 0;
+		log_error("can't read from USB device: %s", strerror(errno));
+		return -1;
+	}
 
-		if (bytes_r > 1) {
-			for (count = 1; count < bytes_r; count++) {
-				rcv_code[ptr++] = buf[count];
-				if (ptr == 6) {
-					/* write to the pipe */
-					for (pos = 0; pos < ptr; pos += bytes_w) {
-						bytes_w = write(fd, rcv_code + pos, ptr - pos);
-						if (bytes_w < 0) {
-							log_error(
-								  "can't write to pipe: %s", strerror(errno));
-							err = 1;
-							goto done;
-						}
-					}
-
-					ptr = 0;
-				}
-			}
+	for (count = 1; count < bytes_r; count++) {
+		rcv_code[rcv_count++] = data[count];
+		if (rcv_count == CODE_BYTES) {
+			memcpy(out + n, rcv_code, CODE_BYTES);
+			n += CODE_BYTES;
+			rcv_count = 0;
 		}
 	}
-
-done:
-	close(fd);
-	if (!usb_close(dev_handle))
-		err = 1;
-	_exit(err);
+	return n;
 }
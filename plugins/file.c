@@ -7,7 +7,8 @@
 *
 *  Also, it supports the following drvctl options:
 *    - 'set-input <path>' which makes is read data  from disk file and
-*       deliver it as pulses from the remote.
+*       deliver it as pulses from the remote. The file is either
+*       mode2(1)-like text or a binary capture, see capture.h.
 *    - 'send-space <useconds>' which indeed sends a (typically long) space.
 *
 *  The exported file descriptor drv.fd reflects the input file, not the
@@ -48,6 +49,7 @@
 #include <errno.h>
 
 #include "lirc_driver.h"
+#include "lirc/capture.h"
 
 
 /* exported functions  */
@@ -95,6 +97,7 @@ static FILE* infile = NULL;
 static int outfile_fd = -1;
 static int lineno = 1;
 static int at_eof = 0;
+static int is_capture = 0;
 
 static int decode_func(struct ir_remote* remote, struct decode_ctx_t* ctx)
 {
@@ -107,31 +110,45 @@ static int decode_func(struct ir_remote* remote, struct decode_ctx_t* ctx)
 }
 
 
+static lirc_t input_eof(lirc_t timeout)
+{
+	char line[64];
+	const char* const close_msg =
+		"# Closing infile file after %d lines (data still pending...)\n";
+
+	log_trace("No more input, timeout: %d", timeout);
+	if (timeout > 0)
+		usleep(timeout);
+	if (infile != NULL) {
+		fclose(infile);
+		infile = NULL;
+	}
+	snprintf(line, sizeof(line), close_msg, lineno);
+	chk_write(outfile_fd, line, strlen(line));
+	drv.fd = -1;
+	at_eof = 1;
+	log_debug("Closing infile after  %d lines", lineno);
+	lineno = 0;
+	return LIRC_EOF | LIRC_MODE2_TIMEOUT | timeout;
+}
+
+
 static lirc_t readdata(lirc_t timeout)
 {
+	struct capture_record record;
 	char line[64];
 	char what[16];
 	int count;
 	int data;
-	const char* const close_msg =
-		"# Closing infile file after %d lines (data still pending...)\n";
 
-	if (infile == NULL || fgets(line, sizeof(line), infile) == NULL) {
-		log_trace("No more input, timeout: %d", timeout);
-		if (timeout > 0)
-			usleep(timeout);
-		if (infile != NULL) {
-			fclose(infile);
-			infile = NULL;
-		}
-		snprintf(line, sizeof(line), close_msg, lineno);
-		chk_write(outfile_fd, line, strlen(line));
-		drv.fd = -1;
-		at_eof = 1;
-		log_debug("Closing infile after  %d lines", lineno);
-		lineno = 0;
-		return LIRC_EOF | LIRC_MODE2_TIMEOUT | timeout;
+	if (infile != NULL && is_capture) {
+		if (!capture_read(infile, &record))
+			return input_eof(timeout);
+		lineno += 1;
+		return record.data;
 	}
+	if (infile == NULL || fgets(line, sizeof(line), infile) == NULL)
+		return input_eof(timeout);
 	count = sscanf(line, "%15s %d", what, &data);
 	if (count != 2)
 		return 0;
@@ -256,11 +273,17 @@ static int drvctl_func(unsigned int cmd, void* arg)
 			chk_write(outfile_fd, buff, strlen(buff));
 			return 0;
 		} else if (strcmp(opt->key, "set-infile") == 0) {
+			struct capture_header header;
+
 			if (outfile_fd < 0)
 				return DRV_ERR_BAD_STATE;
 			infile = fopen(opt->value, "r");
 			if (infile == NULL)
 				return DRV_ERR_BAD_OPTION;
+			is_capture = capture_read_header(infile, &header);
+			if (is_capture)
+				log_debug("Replaying capture from %s (%s)",
+					  header.driver, header.device);
 			drv.fd = fileno(infile);
 			lineno = 1;
 			snprintf(buff, sizeof(buff), open_msg, opt->value);
@@ -46,7 +46,6 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <sys/socket.h>
 #include <fcntl.h>
 #include <netinet/in.h>
@@ -55,7 +54,6 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include <signal.h>
 
 #include "lirc_driver.h"
 
@@ -72,8 +70,8 @@
 
 static const logchannel_t logchannel = LOG_DRIVER;
 
-/* PID of the child process */
-static pid_t child_pid = -1;
+/* Thread reading the device, also transmitting. */
+static struct reader_thread reader;
 
 #define RXBUFSZ         2048
 #define TXBUFSZ         65536
@@ -94,6 +92,15 @@ static int rx_baud_mult = 64;
 static int laststate = -1;
 static uint32_t rxctr = 0;
 
+/* Sample count -> us conversion, 32.32 fixed point, see set_rx_rate(). */
+static uint64_t rx_usecs_q32 = 0;
+/* Sample counts >= this are clamped to PULSE_MASK. */
+static uint64_t rx_max_ctr = 0;
+
+/* Device used by the reader thread, and if it is open. */
+static struct ftdi_context rx_ftdic;
+static int rx_open = 0;
+
 static int pipe_main2tx[2] = { -1, -1 };
 static int pipe_tx2main[2] = { -1, -1 };
 
@@ -112,9 +119,9 @@ static lirc_t time_left(struct timeval* current, struct timeval* last, lirc_t ga
 }
 #endif
 
-static int modulate_pulses(unsigned char* buf, size_t size,
-	const int* pulseptr, int n_pulses, uint32_t f_sample, uint32_t f_carrier,
-	unsigned int duty_cycle);
+/* Carrier samples and modulated codes, shared by ftdi and ftdix. */
+static struct carrier_table tx_carrier;
+static struct carrier_cache tx_cache;
 
 static void list_devices(glob_t *buff)
 {
@@ -159,139 +166,169 @@ static void list_devices(glob_t *buff)
 	drv_enum_add_udev_info(buff);
 }
 
-static void parsesamples(unsigned char* buf, int n, int pipe_rxir_w)
+/* Precompute the sample count -> us conversion for parsesamples(). */
+static void set_rx_rate(void)
 {
-	int i;
-	lirc_t usecs;
+	uint64_t rate = (uint64_t)rx_baud_rate * rx_baud_mult;
+
+	rx_usecs_q32 = ((1000000ULL << 32) + rate / 2) / rate;
+	rx_max_ctr = ((uint64_t)PULSE_MASK * rate + 999999) / 1000000;
+}
 
-	for (i = 0; i < n; i++) {
-		int curstate = (buf[i] & (1 << input_pin)) != 0;
+/* Convert number of samples to us.
+ *
+ * The datasheet indicates that the sample rate in bitbang mode is 16
+ * times the baud rate but 32 seems to be correct. */
+static inline lirc_t samples_to_usecs(uint32_t ctr)
+{
+	/* Clamp */
+	if (ctr >= rx_max_ctr)
+		return PULSE_MASK;
+	return (lirc_t)((ctr * rx_usecs_q32) >> 32);
+}
+
+/* Convert the bitbang samples in buf to lirc_t samples in out,
+ * return number of bytes in out. Bytes are tested eight at a time
+ * for a change of the input pin, only words containing an edge are
+ * scanned bytewise. */
+static int parsesamples(const unsigned char* buf, int n, lirc_t* out)
+{
+	const uint64_t ones = 0x0101010101010101ULL;
+	uint64_t word;
+	uint64_t diff;
+	int count = 0;
+	int i = 0;
+	int curstate;
+
+	while (i < n) {
+		/* Skip words where all pin bits equal laststate. */
+		while (laststate >= 0 && n - i >= 8) {
+			memcpy(&word, buf + i, sizeof(word));
+			diff = ((word >> input_pin) & ones)
+			       ^ (laststate ? ones : 0);
+			if (diff != 0) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+				/* Skip the bytes before the first edge. */
+				rxctr += __builtin_ctzll(diff) / 8;
+				i += __builtin_ctzll(diff) / 8;
+#endif
+				break;
+			}
+			rxctr += 8;
+			i += 8;
+		}
+		if (i >= n)
+			break;
 
+		curstate = (buf[i++] >> input_pin) & 1;
 		rxctr++;
 		if (curstate == laststate)
 			continue;
 
-		/* Convert number of samples to us.
-		 *
-		 * The datasheet indicates that the sample rate in
-		 * bitbang mode is 16 times the baud rate but 32 seems
-		 * to be correct. */
-		usecs = (rxctr * 1000000LL) / (rx_baud_rate * rx_baud_mult);
-
-		/* Clamp */
-		if (usecs > PULSE_MASK)
-			usecs = PULSE_MASK;
-
-		/* Indicate pulse or bit */
-		if (curstate)
-			usecs |= PULSE_BIT;
-
-		/* Send the sample */
-		chk_write(pipe_rxir_w, &usecs, sizeof(usecs));
+		/* Store the sample, indicate pulse or space */
+		out[count++] = samples_to_usecs(rxctr)
+			       | (curstate ? PULSE_BIT : 0);
 
 		/* Remember last state */
 		laststate = curstate;
 		rxctr = 0;
 	}
+	return count * sizeof(lirc_t);
 }
 
-static void child_process(int fd_rx2main, int fd_main2tx, int fd_tx2main)
+/* Open and set up rx_ftdic, return 1 on success. */
+static int rx_open_device(void)
 {
-	int ret = 0;
-	struct ftdi_context ftdic;
+	/* Open the USB device */
+	if (ftdi_usb_open_desc(&rx_ftdic, usb_vendor, usb_product, usb_desc, usb_serial) < 0) {
+		log_error("unable to open FTDI device (%s)", ftdi_get_error_string(&rx_ftdic));
+		return 0;
+	}
+	rx_open = 1;
 
-	alarm(0);
-	signal(SIGTERM, SIG_DFL);
-	signal(SIGPIPE, SIG_DFL);
-	signal(SIGINT, SIG_DFL);
-	signal(SIGHUP, SIG_IGN);
-	signal(SIGALRM, SIG_IGN);
+	/* Enable bit-bang mode, setting output & input pins
+	 * direction */
+	if (ftdi_set_bitmode(&rx_ftdic, 1 << output_pin, BITMODE_BITBANG) < 0) {
+		log_error("unable to enable bitbang mode (%s)", ftdi_get_error_string(&rx_ftdic));
+		return 0;
+	}
 
-	ftdi_init(&ftdic);
+	/* Set baud rate */
+	if (ftdi_set_baudrate(&rx_ftdic, rx_baud_rate) < 0) {
+		log_error("unable to set required baud rate (%s)", ftdi_get_error_string(&rx_ftdic));
+		return 0;
+	}
 
-	/* indicate we're started: */
-	ret = write(fd_tx2main, &ret, 1);
+	log_debug("opened FTDI device '%s' OK", drv.device);
+	return 1;
+}
 
-	while (1) {
-		/* Open the USB device */
-		if (ftdi_usb_open_desc(&ftdic, usb_vendor, usb_product, usb_desc, usb_serial) < 0) {
-			log_error("unable to open FTDI device (%s)", ftdi_get_error_string(&ftdic));
+/* Run on the reader thread: transmit pending data from the main thread,
+ * else receive IR into out. Return number of bytes in out, -1 when the
+ * main thread has closed the transmit pipe. */
+static int rx_read(void* arg, void* out, size_t size)
+{
+	static unsigned char buf[RXBUFSZ > TXBUFSZ ? RXBUFSZ : TXBUFSZ];
+	int ret;
+
+	if (!rx_open && !rx_open_device())
+		goto retry;
+
+	/* transmit IR */
+	ret = read(pipe_main2tx[0], buf, sizeof(buf));
+	if (ret > 0) {
+		/* select correct transmit baudrate */
+		if (ftdi_set_baudrate(&rx_ftdic, tx_baud_rate) < 0) {
+			log_error("unable to set required baud rate for transmission (%s)",
+				  ftdi_get_error_string(&rx_ftdic));
 			goto retry;
 		}
-
-		/* Enable bit-bang mode, setting output & input pins
-		 * direction */
-		if (ftdi_set_bitmode(&ftdic, 1 << output_pin, BITMODE_BITBANG) < 0) {
-			log_error("unable to enable bitbang mode (%s)", ftdi_get_error_string(&ftdic));
+		if (ftdi_write_data(&rx_ftdic, buf, ret) < 0)
+			log_error("enable to write ftdi buffer (%s)",
+				  ftdi_get_error_string(&rx_ftdic));
+		if (ftdi_usb_purge_tx_buffer(&rx_ftdic) < 0)
+			log_error("unable to purge ftdi buffer (%s)",
+				  ftdi_get_error_string(&rx_ftdic));
+
+		/* back to rx baudrate: */
+		if (ftdi_set_baudrate(&rx_ftdic, rx_baud_rate) < 0) {
+			log_error("unable to set restore baudrate for reception (%s)",
+				  ftdi_get_error_string(&rx_ftdic));
 			goto retry;
 		}
 
-		/* Set baud rate */
-		if (ftdi_set_baudrate(&ftdic, rx_baud_rate) < 0) {
-			log_error("unable to set required baud rate (%s)", ftdi_get_error_string(&ftdic));
+		/* signal transmission ready: */
+		ret = write(pipe_tx2main[1], &ret, 1);
+		if (ret <= 0) {
+			log_error("unable to post success to lircd (%s)",
+				  strerror(errno));
 			goto retry;
 		}
+		return 0;
+	} else if (ret == 0) {
+		/* EOF => The main thread has closed the pipe */
+		return -1;
+	}
 
-		log_debug("opened FTDI device '%s' OK", drv.device);
-
-		while (1) {
-			unsigned char buf[RXBUFSZ > TXBUFSZ ? RXBUFSZ : TXBUFSZ];
-
-			/* transmit IR */
-			ret = read(fd_main2tx, buf, sizeof(buf));
-			if (ret > 0) {
-				/* select correct transmit baudrate */
-				if (ftdi_set_baudrate(&ftdic, tx_baud_rate) < 0) {
-					log_error("unable to set required baud rate for transmission (%s)",
-						  ftdi_get_error_string(&ftdic));
-					goto retry;
-				}
-				if (ftdi_write_data(&ftdic, buf, ret) < 0)
-					log_error("enable to write ftdi buffer (%s)",
-						  ftdi_get_error_string(&ftdic));
-				if (ftdi_usb_purge_tx_buffer(&ftdic) < 0)
-					log_error("unable to purge ftdi buffer (%s)",
-						  ftdi_get_error_string(&ftdic));
-
-				/* back to rx baudrate: */
-				if (ftdi_set_baudrate(&ftdic, rx_baud_rate) < 0) {
-					log_error("unable to set restore baudrate for reception (%s)",
-						  ftdi_get_error_string(&ftdic));
-					goto retry;
-				}
-
-				/* signal transmission ready: */
-				ret = write(fd_tx2main, &ret, 1);
-				if (ret <= 0) {
-					log_error("unable to post success to lircd (%s)",
-						  strerror(errno));
-					goto retry;
-				}
-
-				continue;
-			} else if (ret == 0) {
-				/* EOF => The parent has died so the pipe has closed */
-				_exit(0);
-			}
-
-			/* receive IR */
-			ret = ftdi_read_data(&ftdic, buf, RXBUFSZ);
-			if (ret > 0) {
-				parsesamples(buf, ret, fd_rx2main);
-			} else if (ret < 0) {
-				log_error("ftdi: error reading data from device: %s",
-					  ftdi_get_error_string(&ftdic));
-				goto retry;
-			} else {
-				log_info("ftdi: no data available for reading from device");
-			}
-		};
+	/* receive IR */
+	ret = ftdi_read_data(&rx_ftdic, buf, RXBUFSZ);
+	if (ret > 0)
+		return parsesamples(buf, ret, (lirc_t*)out);
+	if (ret < 0) {
+		log_error("ftdi: error reading data from device: %s",
+			  ftdi_get_error_string(&rx_ftdic));
+		goto retry;
+	}
+	log_info("ftdi: no data available for reading from device");
+	return 0;
 
 retry:
-		/* Wait a while and try again */
-		ftdi_usb_close(&ftdic);
-		usleep(500000);
-	}
+	/* Wait a while and try again */
+	if (rx_open)
+		ftdi_usb_close(&rx_ftdic);
+	rx_open = 0;
+	usleep(500000);
+	return 0;
 }
 
 
@@ -322,12 +359,10 @@ static int drvctl_func(unsigned int cmd, void* arg)
 static int hwftdi_init(void)
 {
 	int flags;
-	int pipe_rx2main[2] = { -1, -1 };
-	unsigned char buf[1];
 
 	char* p;
 
-	if (child_pid > 0) {
+	if (reader.running) {
 		log_info("hwftdi_init: Already initialised");
 		return 1;
 	}
@@ -391,33 +426,19 @@ next:
 		tx_baud_mult = 16;
 		rx_baud_mult = 64;       /* hardware *16, libftdi *4 */
 	}
+	set_rx_rate();
 
 	rec_buffer_init();
 
-	/* Allocate a pipe for lircd to read from */
-	if (pipe(pipe_rx2main) == -1) {
-		log_error("unable to create pipe_rx2main");
-		goto fail_start;
-	}
 	if (pipe(pipe_main2tx) == -1) {
 		log_error("unable to create pipe_main2tx");
-		goto fail_main2tx;
+		goto fail_start;
 	}
 	if (pipe(pipe_tx2main) == -1) {
 		log_error("unable to create pipe_tx2main");
 		goto fail_tx2main;
 	}
 
-	drv.fd = pipe_rx2main[0];
-
-	flags = fcntl(drv.fd, F_GETFL);
-
-	/* make the read end of the pipe non-blocking: */
-	if (fcntl(drv.fd, F_SETFL, flags | O_NONBLOCK) == -1) {
-		log_error("unable to make pipe read end non-blocking");
-		goto fail;
-	}
-
 	/* Make the read end of the send pipe non-blocking */
 	flags = fcntl(pipe_main2tx[0], F_GETFL);
 	if (fcntl(pipe_main2tx[0], F_SETFL, flags | O_NONBLOCK) == -1) {
@@ -425,28 +446,22 @@ next:
 		goto fail;
 	}
 
-	/* Spawn the child process */
-	child_pid = fork();
-	if (child_pid == -1) {
-		log_error("unable to fork child process");
+	/* Start the thread reading and writing the device, lircd
+	 * reads the samples from drv.fd. */
+	ftdi_init(&rx_ftdic);
+	rx_open = 0;
+	drv.fd = reader_thread_start(&reader, rx_read, NULL,
+				     RXBUFSZ * sizeof(lirc_t));
+	if (drv.fd == -1) {
+		ftdi_deinit(&rx_ftdic);
 		goto fail;
-	} else if (child_pid == 0) {
-		/* we're the child: */
-		close(pipe_rx2main[0]);
-		close(pipe_main2tx[1]);
-		close(pipe_tx2main[0]);
-		child_process(pipe_rx2main[1], pipe_main2tx[0], pipe_tx2main[1]);
 	}
 
-	/* we're the parent: */
-	close(pipe_rx2main[1]);
-	close(pipe_main2tx[0]);
-	pipe_main2tx[0] = -1;
-	close(pipe_tx2main[1]);
-	pipe_tx2main[1] = -1;
+	flags = fcntl(drv.fd, F_GETFL);
 
-	/* wait for child to be started */
-	chk_read(pipe_tx2main[0], &buf, 1);
+	/* make the read end of the sample stream non-blocking: */
+	if (fcntl(drv.fd, F_SETFL, flags | O_NONBLOCK) == -1)
+		log_warn("unable to make sample stream non-blocking");
 
 	return 1;
 
@@ -464,10 +479,6 @@ fail_tx2main:
 	pipe_main2tx[0] = -1;
 	pipe_main2tx[1] = -1;
 
-fail_main2tx:
-	close(pipe_rx2main[0]);
-	close(pipe_rx2main[1]);
-
 fail_start:
 	if (device_config != NULL) {
 		free(device_config);
@@ -479,26 +490,31 @@ fail_start:
 
 static int hwftdi_close(void)
 {
-	if (child_pid != -1) {
-		/* Kill the child process, and wait for it to exit */
-		if (kill(child_pid, SIGTERM) == -1)
-			return 0;
-		if (waitpid(child_pid, NULL, 0) == 0)
-			return 0;
-		child_pid = -1;
+	if (reader.running) {
+		/* Stop the reader thread, and release the device */
+		reader_thread_stop(&reader);
+		if (rx_open)
+			ftdi_usb_close(&rx_ftdic);
+		rx_open = 0;
+		ftdi_deinit(&rx_ftdic);
 	}
-
-	close(drv.fd);
 	drv.fd = -1;
 
+	close(pipe_main2tx[0]);
+	pipe_main2tx[0] = -1;
 	close(pipe_main2tx[1]);
 	pipe_main2tx[1] = -1;
 	close(pipe_tx2main[0]);
 	pipe_tx2main[0] = -1;
+	close(pipe_tx2main[1]);
+	pipe_tx2main[1] = -1;
 
 	free(device_config);
 	device_config = NULL;
 
+	carrier_cache_free(&tx_cache);
+	carrier_table_free(&tx_carrier);
+
 	return 1;
 }
 
@@ -524,108 +540,47 @@ static lirc_t hwftdi_readdata(lirc_t timeout)
 	return res;
 }
 
-static ssize_t write_pulse(unsigned char* buf, size_t size,
-	struct ir_remote* remote, struct ir_ncode* code)
+/*
+ * Return the modulated samples for code, using the cached result if the
+ * same code has been sent using the same carrier before.
+ */
+static const unsigned char* modulate_code(struct ir_remote* remote,
+					  struct ir_ncode* code,
+					  uint32_t f_sample,
+					  uint32_t f_carrier,
+					  unsigned int duty_cycle,
+					  size_t* size)
 {
-	uint32_t f_sample = tx_baud_rate * tx_baud_mult;
-	uint32_t f_carrier = remote->freq == 0 ? DEFAULT_FREQ : remote->freq;
-	const lirc_t* pulseptr;
-	int n_pulses;
-
-	log_debug("hwftdi_send() carrier=%dHz f_sample=%dHz ", f_carrier, f_sample);
-
 	/* initialize decoded buffer: */
 	if (!send_buffer_put(remote, code))
-		return -1;
-
-	/* init vars: */
-	n_pulses = send_buffer_length();
-	pulseptr = send_buffer_data();
-
-	return modulate_pulses(buf, size, pulseptr, n_pulses, f_sample, f_carrier,
-	    get_duty_cycle(remote));
-}
-
-static int modulate_pulses(unsigned char* buf, size_t size,
-	const int* pulseptr, int n_pulses, uint32_t f_sample, uint32_t f_carrier,
-	unsigned int duty_cycle)
-{
-	uint32_t div_carrier;
-	uint32_t duty;
-	lirc_t pulse;
-	int pulsewidth;
-	int val_carrier;
-	int bufidx;
-	int sendpulse;
-
-	bufidx = 0;
-	div_carrier = 0;
-	val_carrier = 0;
-	sendpulse = 0;
-
-	/* Calculate the carrier on time (in # samples) */
-	duty = f_sample * duty_cycle / 100;  /* duty_cycle is 1-100 */
-	if (duty <= 1)
-		duty = 1;
-	else if (duty >= f_sample)
-		duty = f_sample - 1;
-
-	while (n_pulses--) {
-		/* take pulse from buffer */
-		pulse = *pulseptr++;
-
-		/* compute the pulsewidth (in # samples) */
-		pulsewidth =
-		    ((uint64_t)f_sample) * ((uint32_t)(pulse & PULSE_MASK))
-			/ 1000000ul;
-
-		/* toggle pulse / space */
-		sendpulse = sendpulse ? 0 : 1;
-
-		while (pulsewidth--) {
-			/* carrier generator (generates a carrier
-			 * continously, will be modulated by the
-			 * requested signal): */
-			div_carrier += f_carrier;
-			if (div_carrier >= f_sample) {
-				div_carrier -= f_sample;
-			}
-			val_carrier = div_carrier < duty ? 255 : 0;
-
-			/* send carrier or send space ? */
-			if (sendpulse)
-				buf[bufidx++] = val_carrier;
-			else
-				buf[bufidx++] = 0;
-
-			/* flush txbuffer? */
-			/* note: be sure to have room for last '0' */
-			if (bufidx >= (size - 1)) {
-				log_error("buffer overflow while generating IR pattern");
-				return -1;
-			}
-		}
-	}
-
-	/* always end with 0 to turn off transmitter: */
-	buf[bufidx++] = 0;
-	return bufidx;
+		return NULL;
+	if (!carrier_table_square(&tx_carrier, f_sample, f_carrier, duty_cycle))
+		return NULL;
+	return carrier_cache_get(&tx_cache, &tx_carrier,
+				 send_buffer_data(), send_buffer_length(),
+				 TXBUFSZ, size);
 }
 
 static int hwftdi_send(struct ir_remote* remote, struct ir_ncode* code)
 {
-	unsigned char buf[TXBUFSZ];
-	ssize_t pulse_len;
+	uint32_t f_sample = tx_baud_rate * tx_baud_mult;
+	uint32_t f_carrier = remote->freq == 0 ? DEFAULT_FREQ : remote->freq;
+	const unsigned char* buf;
+	size_t buf_len;
+	char ack;
+
+	log_debug("hwftdi_send() carrier=%dHz f_sample=%dHz ", f_carrier, f_sample);
 
-	pulse_len = write_pulse(buf, sizeof(buf), remote, code);
-	if (pulse_len == -1)
+	buf = modulate_code(remote, code, f_sample, f_carrier,
+			    get_duty_cycle(remote), &buf_len);
+	if (buf == NULL)
 		return 0;
 
-	/* let the child process transmit the pattern */
-	chk_write(pipe_main2tx[1], buf, pulse_len);
+	/* let the reader thread transmit the pattern */
+	chk_write(pipe_main2tx[1], buf, buf_len);
 
-	/* wait for child process to be ready with it */
-	chk_read(pipe_tx2main[0], buf, 1);
+	/* wait for reader thread to be ready with it */
+	chk_read(pipe_tx2main[0], &ack, 1);
 
 	return 1;
 }
@@ -727,6 +682,8 @@ static int hwftdix_close(void)
 	}
 	ftdi_deinit(&ftdic);
 	is_open = 0;
+	carrier_cache_free(&tx_cache);
+	carrier_table_free(&tx_carrier);
 	return 0;
 }
 
@@ -849,8 +806,8 @@ static void hwftdix_clear_config(struct ftdix_config* config)
 static int hwftdix_send(struct ir_remote* remote, struct ir_ncode* code)
 {
 	int success = 1;
-	unsigned char buf[TXBUFSZ];
-	ssize_t buf_len;
+	const unsigned char* buf;
+	size_t buf_len;
 	int orig_scheduler;
 	uint32_t f_carrier = remote->freq == 0 ? DEFAULT_FREQ : remote->freq;
 
@@ -859,23 +816,13 @@ static int hwftdix_send(struct ir_remote* remote, struct ir_ncode* code)
 	uint32_t f_sample = f_carrier * 2;
 	uint32_t tx_baud = f_carrier * 2 / 64;
 
-	const lirc_t* pulseptr;
-	int n_pulses;
-
 	log_debug("hwftdix_send() carrier=%dHz f_sample=%dHz tx_baud=%d",
 		  f_carrier, f_sample, tx_baud);
 
-	/* initialize decoded buffer: */
-	if (!send_buffer_put(remote, code))
+	buf = modulate_code(remote, code, f_sample, f_carrier, 50, &buf_len);
+	if (buf == NULL)
 		return -1;
 
-	/* init vars: */
-	n_pulses = send_buffer_length();
-	pulseptr = send_buffer_data();
-
-	buf_len = modulate_pulses(buf, sizeof(buf), pulseptr, n_pulses, f_sample,
-				  f_carrier, 50);
-
 	/* select correct transmit baudrate */
 	if (ftdi_set_baudrate(&ftdic, tx_baud) < 0) {
 		log_error("unable to set required baud rate for transmission "
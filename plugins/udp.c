@@ -39,21 +39,40 @@
  *
  * to use port 8766 and 1 microsecond timing resolution.
  *
+ * The socket receive buffer size can be set using
+ * `--driver-option=rcvbuf:bytes`, which might be needed to avoid drops
+ * when many senders are active.
+ *
+ * Several senders can use the same port. Datagrams are read in batches,
+ * each sender has its own decoding state. A sender's samples are held
+ * until its frame ends with a space of at least FRAME_GAP, or the sender
+ * has been silent that long, and are then queued as a whole so frames
+ * from different senders are never interleaved. A long space is inserted
+ * between frames from different senders if needed. The number of
+ * dropped and malformed datagrams is available using the DRVCTL_GET_STATS
+ * drvctl.
+ *
  * \note Little endian is not conventional network byte order.
  */
 
+#define _GNU_SOURCE 1
+
 #ifdef HAVE_CONFIG_H
 # include <config.h>
 #endif
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/fcntl.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
 #include <errno.h>
 
 #include "lirc_driver.h"
@@ -66,8 +85,100 @@ static const int FIRST_PORT = 6000;
 /** Last port checked in --list-devices/DRVCTL_GET_DEVIVES. */
 static const int LAST_PORT = 6006;
 
-static int zerofd;              /* /dev/zero */
-static int sockfd;              /* the socket */
+/** Max number of datagrams read by each recvmmsg(). */
+#define BATCH_SIZE      16
+
+/** Max size of a datagram, larger ones are truncated. */
+#define DATAGRAM_SIZE   8192
+
+/** Max number of senders with separate state. */
+#define MAX_SOURCES     16
+
+/** Max number of samples held for a sender until its frame ends. */
+#define FRAME_SIZE      512
+
+/** Space (us) ending a frame, also silence after which a frame ends. */
+#define FRAME_GAP       10000
+
+/** Max number of samples queued from one batch and the held frames. */
+#define QUEUE_SIZE      (BATCH_SIZE * (DATAGRAM_SIZE / 2 + 2) \
+			 + 2 * MAX_SOURCES * FRAME_SIZE)
+
+static int zerofd = -1;         /* /dev/zero */
+static int sockfd = -1;         /* the socket */
+static int rcvbuf = 0;          /* SO_RCVBUF, 0 for system default */
+
+/** Decoding state for a sender. */
+struct source {
+	struct sockaddr_in	addr;
+	unsigned long		used;           /**< Sequence nr of last datagram. */
+	unsigned long		datagrams;      /**< Datagrams received. */
+	int			ext_count;      /**< Bytes of pending long value, -1 if none. */
+	lirc_t			ext_pulse;      /**< PULSE_BIT of pending long value. */
+	u_int8_t		ext[4];         /**< Pending long value. */
+	uint64_t		received;       /**< Time of last datagram. */
+	int			frame_len;      /**< Samples held in frame. */
+	lirc_t			frame[FRAME_SIZE];      /**< Incomplete frame. */
+	uint64_t		frame_ts[FRAME_SIZE];   /**< Time each sample was received. */
+};
+
+static struct source sources[MAX_SOURCES];
+static int source_count = 0;
+static unsigned long sequence = 0;
+
+/** Source of last queued frame, NULL if none. */
+static struct source* last_source = NULL;
+
+/** Last queued sample. */
+static lirc_t last_sample = 0;
+
+/** Complete frames, not yet returned. */
+static lirc_t queue[QUEUE_SIZE];
+static uint64_t queue_ts[QUEUE_SIZE];   /* time each sample was received */
+static int queue_len = 0;
+static int queue_pos = 0;
+
+/** Counters reported by DRVCTL_GET_STATS. */
+static struct {
+	unsigned long	datagrams;
+	unsigned long	samples;
+	unsigned long	truncated;      /**< Larger than DATAGRAM_SIZE. */
+	unsigned long	odd;            /**< Odd number of bytes. */
+	unsigned long	dropped;        /**< Dropped by kernel, full buffer. */
+	unsigned long	evicted;        /**< Sources replaced by new ones. */
+} stats;
+
+#ifndef HAVE_RECVMMSG
+struct mmsghdr {
+	struct msghdr	msg_hdr;
+	unsigned int	msg_len;
+};
+
+/** Fallback using recvmsg(), flags must include MSG_DONTWAIT. */
+static int recvmmsg(int fd, struct mmsghdr* msgvec, unsigned int vlen,
+		    int flags, struct timespec* timeout)
+{
+	unsigned int i;
+	ssize_t r;
+
+	for (i = 0; i < vlen; i++) {
+		r = recvmsg(fd, &msgvec[i].msg_hdr, flags);
+		if (r < 0)
+			return i > 0 ? (int)i : -1;
+		msgvec[i].msg_len = r;
+	}
+	return i;
+}
+#endif
+
+/** recvmmsg() buffers. */
+static u_int8_t buffers[BATCH_SIZE][DATAGRAM_SIZE];
+static struct sockaddr_in addrs[BATCH_SIZE];
+static struct iovec iovecs[BATCH_SIZE];
+static struct mmsghdr msgs[BATCH_SIZE];
+#ifdef SO_RXQ_OVFL
+static char controls[BATCH_SIZE][CMSG_SPACE(sizeof(u_int32_t))];
+#endif
 
 
 /** List available udp devices starting at 6000. */
@@ -107,6 +218,58 @@ static int list_devices(glob_t* glob)
 }
 
 
+/** Apply the rcvbuf option to the socket, if set. */
+static void set_rcvbuf(void)
+{
+	int size;
+	socklen_t len = sizeof(size);
+
+	if (sockfd < 0 || rcvbuf == 0)
+		return;
+	if (setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF,
+		       &rcvbuf, sizeof(rcvbuf)) != 0) {
+		log_perror_warn("Cannot set UDP receive buffer size");
+		return;
+	}
+	if (getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &size, &len) == 0)
+		log_info("UDP receive buffer size: %d", size);
+}
+
+
+/** Add a "name value" line to glob. */
+static void add_stat(glob_t* glob, const char* name, unsigned long value)
+{
+	char buff[128];
+
+	snprintf(buff, sizeof(buff), "%s %lu", name, value);
+	glob_t_add_path(glob, buff);
+}
+
+
+/** Report counters and active senders, see DRVCTL_GET_STATS. */
+static int get_stats(glob_t* glob)
+{
+	char buff[128];
+	int i;
+
+	glob_t_init(glob);
+	add_stat(glob, "datagrams", stats.datagrams);
+	add_stat(glob, "samples", stats.samples);
+	add_stat(glob, "dropped", stats.dropped);
+	add_stat(glob, "truncated", stats.truncated);
+	add_stat(glob, "odd_length", stats.odd);
+	add_stat(glob, "senders_evicted", stats.evicted);
+	for (i = 0; i < source_count; i++) {
+		snprintf(buff, sizeof(buff), "sender %s:%d datagrams %lu",
+			 inet_ntoa(sources[i].addr.sin_addr),
+			 ntohs(sources[i].addr.sin_port),
+			 sources[i].datagrams);
+		glob_t_add_path(glob, buff);
+	}
+	return 0;
+}
+
+
 /**
  * Driver control.
  *
@@ -115,6 +278,9 @@ static int list_devices(glob_t* glob)
  *  clocktick:value
  *	Set the timing resolution to specified value.
  *
+ *  rcvbuf:value
+ *	Set the socket receive buffer size (bytes).
+ *
  * \retval 0	Success.
  * \retval !=0	drvctl error.
  */
@@ -126,9 +292,14 @@ static int udp_drvctl_func(unsigned int cmd, void* arg)
 	switch (cmd) {
 	case DRVCTL_GET_DEVICES:
 		return list_devices((glob_t*) arg);
+	case DRVCTL_GET_STATS:
+		return get_stats((glob_t*) arg);
 	case DRVCTL_FREE_DEVICES:
 		drv_enum_free((glob_t*) arg);
 		return 0;
+	case DRVCTL_GET_PENDING:
+		*(int*)arg = queue_len - queue_pos;
+		return 0;
 	case DRVCTL_SET_OPTION:
 		opt = (struct option_t*)arg;
 		if (strcmp(opt->key, "clocktick") == 0) {
@@ -140,6 +311,16 @@ static int udp_drvctl_func(unsigned int cmd, void* arg)
 			}
 			drv.resolution = value;
 			return 0;
+		} else if (strcmp(opt->key, "rcvbuf") == 0) {
+			value = strtol(opt->value, NULL, 10);
+			if (value < 1024 || INT_MAX / 2 < value) {
+				log_error("invalid receive buffer size: %s",
+					  opt->value);
+				return DRV_ERR_BAD_VALUE;
+			}
+			rcvbuf = value;
+			set_rcvbuf();
+			return 0;
 		} else {
 			return DRV_ERR_BAD_OPTION;
 		}
@@ -165,10 +346,17 @@ int udp_init(void)
 	int count;
 	unsigned int port;
 	struct sockaddr_in addr;
+	int i;
 
 	log_info("Initializing UDP: %s", drv.device);
 
 	rec_buffer_init();
+	memset(&stats, 0, sizeof(stats));
+	source_count = 0;
+	last_source = NULL;
+	last_sample = 0;
+	queue_len = 0;
+	queue_pos = 0;
 
 	/* device string is "port" */
 	count = sscanf(drv.device, "%u", &port);
@@ -204,6 +392,20 @@ int udp_init(void)
 		return 0;
 	}
 
+	set_rcvbuf();
+#ifdef SO_RXQ_OVFL
+	i = 1;
+	if (setsockopt(sockfd, SOL_SOCKET, SO_RXQ_OVFL, &i, sizeof(i)) != 0)
+		log_perror_debug("Cannot enable UDP drop counter");
+#endif
+	for (i = 0; i < BATCH_SIZE; i++) {
+		iovecs[i].iov_base = buffers[i];
+		iovecs[i].iov_len = DATAGRAM_SIZE;
+		msgs[i].msg_hdr.msg_name = &addrs[i];
+		msgs[i].msg_hdr.msg_iov = &iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
 	log_info("Listening on port %d/udp", port);
 
 	drv.fd = sockfd;
@@ -220,6 +422,8 @@ int udp_deinit(void)
 {
 	close(sockfd);
 	close(zerofd);
+	sockfd = -1;
+	zerofd = -1;
 	drv.fd = -1;
 	return 1;
 }
@@ -236,82 +440,9 @@ char* udp_rec(struct ir_remote* remotes)
 	return decode_all(remotes);
 }
 
-/**
- * Read data from the UDP port.
- *
- * Data read from the UDP port is converted to lirc mode2 format and returned
- * one measured time interval at a time.
- * \param timeout  Time to wait for data.
- * \return         IR timing data in lirc mode2 format.
- */
-lirc_t udp_readdata(lirc_t timeout)
+/** Convert a time in clockticks to mode2 format. */
+static lirc_t scale(u_int64_t tmp)
 {
-	static u_int8_t buffer[8192];
-	static int buflen = 0;
-	static int bufptr = 0;
-	lirc_t data;
-	u_int8_t packed[4];
-	u_int64_t tmp;
-
-	/* Assume buffer is empty; LIRC should select on the socket */
-	drv.fd = sockfd;
-
-	/* If buffer is empty, get data into it */
-	if ((bufptr + 2) > buflen) {
-		if (!waitfordata(timeout))
-			return 0;
-		buflen = recv(sockfd, &buffer, sizeof(buffer), 0);
-		if (buflen < 0) {
-			log_info("Error reading from UDP socket");
-			return 0;
-		}
-		if (buflen & 1)
-			buflen--;
-		if (buflen == 0)
-			return 0;
-		bufptr = 0;
-	}
-
-	/* Read as 2 bytes to avoid endian-ness issues */
-	packed[0] = buffer[bufptr++];
-	packed[1] = buffer[bufptr++];
-
-	/* Low indicates that the receiver has detected the marking state
-	 * i.e. is receiving IR pulses.
-	 */
-	data = (packed[1] & 0x80) ? 0 : PULSE_BIT;
-
-	tmp = (((u_int32_t) packed[1]) << 8) | packed[0];
-	tmp &= 0x7FFF;
-	if (tmp == 0) {
-		/*
-		 * A zero flags the following  bytes as an extended time value.
-		 * If buffer is empty, get data into it.
-		 */
-		if ((bufptr + 4) > buflen) {
-			if (!waitfordata(timeout))
-				return 0;
-			buflen = recv(sockfd, &buffer, sizeof(buffer), 0);
-			if (buflen < 0) {
-				log_info("Error reading from UDP socket");
-				return 0;
-			}
-			if (buflen & 1)
-				buflen--;
-			if (buflen == 0)
-				return 0;
-			bufptr = 0;
-		}
-		/* Read as 4 bytes to avoid endian-ness issues. */
-		packed[0] = buffer[bufptr++];
-		packed[1] = buffer[bufptr++];
-		packed[2] = buffer[bufptr++];
-		packed[3] = buffer[bufptr++];
-		tmp = (((u_int64_t) packed[3]) << 24)
-		    | (((u_int64_t) packed[2]) << 16)
-		    | (((u_int64_t) packed[1]) << 8)
-		    | packed[0];
-	}
 	switch (drv.resolution) {
 	case 1:
 		break;
@@ -333,14 +464,331 @@ lirc_t udp_readdata(lirc_t timeout)
 	}
 	if (tmp > PULSE_MASK)
 		tmp = PULSE_MASK;
+	return tmp;
+}
+
+
+static uint64_t now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+static void queue_put(lirc_t data, uint64_t ts)
+{
+	/* Cannot happen given QUEUE_SIZE, but never write out of bounds. */
+	if (queue_len >= QUEUE_SIZE)
+		return;
+	queue[queue_len] = data;
+	queue_ts[queue_len++] = ts;
+	last_sample = data;
+}
 
-	data |= tmp;
 
-	/* If our buffer still has data, give LIRC /dev/zero to select on */
-	if ((bufptr + 2) <= buflen)
+/** Move the samples held for src to the queue. */
+static void flush_frame(struct source* src)
+{
+	int i;
+
+	if (src->frame_len == 0)
+		return;
+	/* Separate frames from different senders by a long space. */
+	if (src != last_source && is_pulse(last_sample))
+		queue_put(PULSE_MASK, src->frame_ts[0]);
+	last_source = src;
+	for (i = 0; i < src->frame_len; i++)
+		queue_put(src->frame[i], src->frame_ts[i]);
+	src->frame_len = 0;
+}
+
+
+/** Queue frames of senders which have been silent for FRAME_GAP. */
+static void flush_silent(uint64_t now)
+{
+	int i;
+
+	for (i = 0; i < source_count; i++)
+		if (sources[i].frame_len > 0
+		    && now - sources[i].received >= FRAME_GAP * 1000ULL)
+			flush_frame(&sources[i]);
+}
+
+
+/** Return time when flush_silent() queues the next frame, 0 if none. */
+static uint64_t next_deadline(void)
+{
+	uint64_t deadline = 0;
+	uint64_t t;
+	int i;
+
+	for (i = 0; i < source_count; i++) {
+		if (sources[i].frame_len == 0)
+			continue;
+		t = sources[i].received + FRAME_GAP * 1000ULL;
+		if (deadline == 0 || t < deadline)
+			deadline = t;
+	}
+	return deadline;
+}
+
+
+/** Add a sample to the frame held for src, queue it when complete. */
+static void put_sample(struct source* src, lirc_t data, uint64_t ts)
+{
+	/* A zero sample would be taken as timeout by readdata() callers. */
+	if (data == 0)
+		return;
+	src->frame[src->frame_len] = data;
+	src->frame_ts[src->frame_len++] = ts;
+	stats.samples += 1;
+	if ((!is_pulse(data) && (data & PULSE_MASK) >= FRAME_GAP)
+	    || src->frame_len == FRAME_SIZE)
+		flush_frame(src);
+}
+
+
+/** Return state for sender addr, replacing least recently used if full. */
+static struct source* find_source(const struct sockaddr_in* addr,
+				  uint64_t ts)
+{
+	struct source* src = NULL;
+	int i;
+
+	for (i = 0; i < source_count; i++) {
+		if (sources[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr
+		    && sources[i].addr.sin_port == addr->sin_port) {
+			src = &sources[i];
+			break;
+		}
+	}
+	if (src == NULL) {
+		if (source_count < MAX_SOURCES) {
+			src = &sources[source_count++];
+		} else {
+			src = &sources[0];
+			for (i = 1; i < MAX_SOURCES; i++)
+				if (sources[i].used < src->used)
+					src = &sources[i];
+			stats.evicted += 1;
+			flush_frame(src);
+			if (src == last_source)
+				last_source = NULL;
+		}
+		memset(src, 0, sizeof(struct source));
+		src->addr = *addr;
+		src->ext_count = -1;
+		log_debug("udp: new sender %s:%d",
+			  inet_ntoa(addr->sin_addr), ntohs(addr->sin_port));
+	}
+	src->used = ++sequence;
+	src->datagrams += 1;
+	src->received = ts;
+	return src;
+}
+
+
+/** Decode a datagram from src received at ts. */
+static void decode_datagram(struct source* src, const u_int8_t* buf, int len,
+			    uint64_t ts)
+{
+	u_int64_t tmp;
+	lirc_t data;
+	int i = 0;
+
+	while (i < len) {
+		if (src->ext_count >= 0) {
+			/* Long value, possibly split between datagrams. */
+			src->ext[src->ext_count++] = buf[i++];
+			if (src->ext_count < 4)
+				continue;
+			tmp = (((u_int64_t) src->ext[3]) << 24)
+			      | (((u_int64_t) src->ext[2]) << 16)
+			      | (((u_int64_t) src->ext[1]) << 8)
+			      | src->ext[0];
+			put_sample(src, src->ext_pulse | scale(tmp), ts);
+			src->ext_count = -1;
+			continue;
+		}
+		if (i + 2 > len) {
+			stats.odd += 1;
+			break;
+		}
+		/* Low indicates that the receiver has detected the marking
+		 * state i.e. is receiving IR pulses.
+		 */
+		data = (buf[i + 1] & 0x80) ? 0 : PULSE_BIT;
+		tmp = ((((u_int32_t) buf[i + 1]) << 8) | buf[i]) & 0x7FFF;
+		i += 2;
+		if (tmp == 0) {
+			/* A zero flags the following bytes as a long value. */
+			src->ext_pulse = data;
+			src->ext_count = 0;
+			continue;
+		}
+		put_sample(src, data | scale(tmp), ts);
+	}
+}
+
+
+/** Update stats.dropped from the SO_RXQ_OVFL control message, if any. */
+static void check_dropped(struct msghdr* hdr)
+{
+#ifdef SO_RXQ_OVFL
+	struct cmsghdr* cmsg;
+	u_int32_t dropped;
+
+	for (cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL;
+	     cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET
+		    && cmsg->cmsg_type == SO_RXQ_OVFL) {
+			memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+			if (dropped > stats.dropped)
+				log_warn("udp: %lu datagrams dropped",
+					 dropped - stats.dropped);
+			stats.dropped = dropped;
+		}
+	}
+#endif
+}
+
+
+/**
+ * Read all available datagrams, at most BATCH_SIZE, and decode them.
+ * Frames completed by them are added to the queue.
+ * \return Number of datagrams read, 0 if none available or on errors.
+ */
+static int receive_batch(void)
+{
+	uint64_t ts;
+	int count;
+	int i;
+
+	for (i = 0; i < BATCH_SIZE; i++) {
+		msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+#ifdef SO_RXQ_OVFL
+		msgs[i].msg_hdr.msg_control = controls[i];
+		msgs[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+#endif
+		msgs[i].msg_hdr.msg_flags = 0;
+	}
+	count = recvmmsg(sockfd, msgs, BATCH_SIZE, MSG_DONTWAIT, NULL);
+	if (count < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			log_perror_warn("Error reading from UDP socket");
+		return 0;
+	}
+	ts = now_ns();
+	for (i = 0; i < count; i++) {
+		stats.datagrams += 1;
+		check_dropped(&msgs[i].msg_hdr);
+		if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+			stats.truncated += 1;
+		decode_datagram(find_source(&addrs[i], ts),
+				buffers[i], msgs[i].msg_len, ts);
+	}
+	return count;
+}
+
+
+/**
+ * Refill the empty queue with frames completed by available datagrams
+ * or by senders being silent for FRAME_GAP.
+ * \param timeout  If wait is set, max time to wait for a frame, 0 for
+ *                 no limit.
+ * \param wait     If zero, only use datagrams already received.
+ */
+static void fill_queue(lirc_t timeout, int wait)
+{
+	uint64_t start = now_ns();
+	uint64_t now;
+	uint64_t deadline;
+	lirc_t wait_us;
+	lirc_t gap_us;
+
+	queue_len = 0;
+	queue_pos = 0;
+	while (1) {
+		receive_batch();
+		now = now_ns();
+		flush_silent(now);
+		if (queue_len > 0 || !wait)
+			return;
+		if (timeout > 0 && now - start >= timeout * 1000ULL)
+			return;
+		wait_us = timeout > 0 ? timeout - (now - start) / 1000 : 0;
+		deadline = next_deadline();
+		if (deadline != 0) {
+			/* Whole ms, waitfordata() polls with ms resolution. */
+			gap_us = ((deadline - now) / 1000000 + 1) * 1000;
+			if (wait_us == 0 || gap_us < wait_us)
+				wait_us = gap_us;
+		}
+		waitfordata(wait_us);
+	}
+}
+
+
+/**
+ * Read data from the UDP port.
+ *
+ * Data read from the UDP port is converted to lirc mode2 format and returned
+ * up to n measured time intervals at a time. Waits for the first one, the
+ * remaining ones are only returned if already received. Only complete
+ * frames are returned, see FRAME_GAP.
+ * \param buf      Updated with IR timing data in lirc mode2 format.
+ * \param n        Size of buf and ts.
+ * \param ts       If non-NULL, updated with the time the datagram holding
+ *                 each sample was received.
+ * \param timeout  Time to wait for data.
+ * \return         Number of samples in buf.
+ */
+static int udp_readdata_bulk(lirc_t* buf, size_t n, uint64_t* ts,
+			     lirc_t timeout)
+{
+	size_t count = 0;
+
+	/* Assume queue is empty; LIRC should select on the socket */
+	drv.fd = sockfd;
+
+	while (count < n) {
+		if (queue_pos >= queue_len) {
+			fill_queue(timeout, count == 0);
+			if (queue_len == 0)
+				break;
+		}
+		if (ts != NULL)
+			ts[count] = queue_ts[queue_pos];
+		buf[count++] = queue[queue_pos++];
+	}
+
+	/*
+	 * If our queue still has data, or a frame waits for its end, give
+	 * LIRC /dev/zero to select on. In the latter case the next read
+	 * waits at most FRAME_GAP.
+	 */
+	if (queue_pos < queue_len || next_deadline() != 0)
 		drv.fd = zerofd;
 
-	return data;
+	return count;
+}
+
+
+/**
+ * Read data from the UDP port.
+ *
+ * Data read from the UDP port is converted to lirc mode2 format and returned
+ * one measured time interval at a time.
+ * \param timeout  Time to wait for data.
+ * \return         IR timing data in lirc mode2 format.
+ */
+lirc_t udp_readdata(lirc_t timeout)
+{
+	lirc_t data;
+
+	return udp_readdata_bulk(&data, 1, NULL, timeout) == 1 ? data : 0;
 }
 
 const struct driver hw_udp = {
@@ -360,10 +808,11 @@ const struct driver hw_udp = {
 	.drvctl_func	=	udp_drvctl_func,
 	.readdata	=	udp_readdata,
 	.resolution	=	61,
-	.api_version	=	3,
+	.api_version	=	4,
 	.driver_version =	"0.10.0",
 	.info		=	"See file://" PLUGINDOCS "/udp.html",
 	.device_hint    =       "drvctl",
+	.readdata_bulk	=	udp_readdata_bulk,
 };
 
 const struct driver* hardwares[] = { &hw_udp, (const struct driver*)NULL };
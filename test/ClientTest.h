@@ -54,6 +54,8 @@ class ClientTest : public CppUnit::TestFixture
             ADD_TEST("testReadConfigOnly", testReadConfigOnly);
             ADD_TEST("testReadConfigNew", testReadConfigNew);
             ADD_TEST("testCode2Char", testCode2Char);
+            ADD_TEST("testCode2CharIndex", testCode2CharIndex);
+            ADD_TEST("testReader", testReader);
             ADD_TEST("testSetMode", testSetMode);
             ADD_TEST("testGetMode", testSetMode);
             return testSuite;
@@ -257,6 +259,54 @@ class ClientTest : public CppUnit::TestFixture
         }
 
 
+        void testCode2CharIndex()
+        {
+            char* right =
+                (char*) "0000000000001bde 00 KEY_RIGHT Acer_Aspire_6530G_MCE";
+            char* unknown =
+                (char*) "0000000000001bde 00 KEY_NONE Acer_Aspire_6530G_MCE";
+            struct lirc_config* config;
+            char* chars = NULL;
+
+            CPPUNIT_ASSERT(
+                lirc_readconfig_only("etc/mythtv.lircrc", &config, NULL) == 0);
+            lirc_code2char(config, unknown, &chars);
+            CPPUNIT_ASSERT(chars == NULL);
+            lirc_code2char(config, right, &chars);
+            CPPUNIT_ASSERT(chars != NULL && string(chars) == "Right");
+            lirc_code2char(config, right, &chars);
+            CPPUNIT_ASSERT(chars == NULL);
+            lirc_code2char(config, right, &chars);
+            CPPUNIT_ASSERT(chars != NULL && string(chars) == "Right");
+            lirc_freeconfig(config);
+        }
+
+
+        void testReader()
+        {
+            lirc_reader* reader;
+            const char* lines[2];
+            int pipefd[2];
+
+            CPPUNIT_ASSERT(pipe(pipefd) == 0);
+            reader = lirc_reader_new(pipefd[0]);
+            CPPUNIT_ASSERT(reader != NULL);
+            CPPUNIT_ASSERT(write(pipefd[1], "a 1\nb 2\nc 3\nd", 13) == 13);
+            CPPUNIT_ASSERT(lirc_reader_read(reader, lines, 2) == 2);
+            CPPUNIT_ASSERT(string(lines[0]) == "a 1");
+            CPPUNIT_ASSERT(string(lines[1]) == "b 2");
+            CPPUNIT_ASSERT(lirc_reader_read(reader, lines, 2) == 1);
+            CPPUNIT_ASSERT(string(lines[0]) == "c 3");
+            CPPUNIT_ASSERT(write(pipefd[1], " 4\n", 3) == 3);
+            CPPUNIT_ASSERT(lirc_reader_read(reader, lines, 2) == 1);
+            CPPUNIT_ASSERT(string(lines[0]) == "d 4");
+            close(pipefd[1]);
+            CPPUNIT_ASSERT(lirc_reader_read(reader, lines, 2) == -1);
+            lirc_reader_free(reader);
+            close(pipefd[0]);
+        }
+
+
         void testSetMode()
         {
             struct lirc_config* config;
@@ -0,0 +1,268 @@
+#ifndef  LIRCRCD_TEST
+#define  LIRCRCD_TEST
+
+#include	<errno.h>
+#include	<fcntl.h>
+#include	<poll.h>
+#include	<signal.h>
+#include	<stdio.h>
+#include	<sys/socket.h>
+#include	<sys/types.h>
+#include	<sys/un.h>
+
+#include    <fstream>
+#include    <iostream>
+#include    <string>
+#include    <cppunit/TestFixture.h>
+#include    <cppunit/TestSuite.h>
+#include    <cppunit/TestCaller.h>
+
+#include	"../lib/lirc_client.h"
+#include	"Util.h"
+
+#undef      ADD_TEST
+#define     ADD_TEST(id, func) \
+    testSuite->addTest(new CppUnit::TestCaller<LircrcdTest>( \
+                       id,  &LircrcdTest::func))
+
+#define     LIRCRCD_SOCKET  "var/lircrcd-push.socket"
+#define     FAKE_LIRCD      "var/lircrcd-push-lircd.socket"
+#define     PUSH_LIRCRC     "var/push.lircrc"
+
+#define     RUN_PUSH_LIRCRCD "../daemons/lircrcd -o " LIRCRCD_SOCKET \
+                             " " PUSH_LIRCRC
+
+/* Pushed strings, large enough to fill a stalled client's socket. */
+static const int PUSH_COUNT = 300;
+static const int PUSH_SIZE  = 3000;
+
+/* Events sent before reading, well below a socket's buffer size. */
+static const int PUSH_BATCH = 10;
+
+using namespace std;
+
+/*
+ * Drive lircrcd's SUBSCRIBE push mode. lircrcd is connected to a fake
+ * lircd socket owned by the test, which writes decoded events and thus
+ * controls exactly what lircrcd pushes to its subscribers.
+ */
+class LircrcdTest : public CppUnit::TestFixture
+{
+    private:
+        int server;        // Fake lircd listening socket.
+        int lircd;         // lircrcd's connection to fake lircd, or -1.
+        pid_t pid;         // Daemonized lircrcd, 0 if not known.
+
+    public:
+        static CppUnit::Test* suite()
+        {
+            CppUnit::TestSuite* testSuite =
+                 new CppUnit::TestSuite( "LircrcdTest" );
+            ADD_TEST("testSubscribe", testSubscribe);
+            ADD_TEST("testPushOrder", testPushOrder);
+            ADD_TEST("testSlowSubscriber", testSlowSubscriber);
+            return testSuite;
+        };
+
+        static string pushString(int i)
+        {
+            return string(1, i % 2 ? 'B' : 'A') + string(PUSH_SIZE - 1, 'x');
+        }
+
+        void writeLircrc()
+        {
+            ofstream lircrc(PUSH_LIRCRC);
+
+            lircrc << "begin\n  prog = irexec\n  button = KEY_A\n"
+                   << "  config = " << pushString(0) << "\nend\n"
+                   << "begin\n  prog = irexec\n  button = KEY_B\n"
+                   << "  config = " << pushString(1) << "\nend\n";
+        }
+
+        void setUp()
+        {
+            struct sockaddr_un addr;
+
+            lircd = -1;
+            pid = 0;
+            writeLircrc();
+            unlink(FAKE_LIRCD);
+            server = socket(AF_UNIX, SOCK_STREAM, 0);
+            CPPUNIT_ASSERT(server != -1);
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path, abspath(FAKE_LIRCD),
+                    sizeof(addr.sun_path) - 1);
+            CPPUNIT_ASSERT(bind(server, (struct sockaddr*)&addr,
+                                sizeof(addr)) == 0);
+            CPPUNIT_ASSERT(listen(server, 1) == 0);
+
+            // lircrcd connects after daemon() has done chdir("/").
+            setenv("LIRC_SOCKET_PATH", abspath(FAKE_LIRCD), 1);
+            CPPUNIT_ASSERT(system(RUN_PUSH_LIRCRCD) == 0);
+        };
+
+        void tearDown()
+        {
+            if (pid > 0)
+                kill(pid, SIGTERM);
+            if (lircd != -1)
+                close(lircd);
+            close(server);
+            unlink(FAKE_LIRCD);
+            usleep(10000);
+        };
+
+        // Accept lircrcd's connection to fake lircd, made on the first
+        // SUBSCRIBE. Its credentials identify the daemonized lircrcd.
+        void acceptLircd()
+        {
+            struct pollfd pfd = { server, POLLIN, 0 };
+            struct ucred cred;
+            socklen_t len = sizeof(cred);
+
+            CPPUNIT_ASSERT(poll(&pfd, 1, 2000) == 1);
+            lircd = accept(server, NULL, NULL);
+            CPPUNIT_ASSERT(lircd != -1);
+            if (getsockopt(lircd, SOL_SOCKET, SO_PEERCRED,
+                           &cred, &len) == 0)
+                pid = cred.pid;
+        }
+
+        // Read from fd until buff ends with tail or timeout.
+        bool readUntil(int fd, string& buff, const string& tail,
+                       int timeout = 2000)
+        {
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            char chunk[8192];
+            ssize_t r;
+
+            while (buff.size() < tail.size()
+                   || buff.compare(buff.size() - tail.size(),
+                                   tail.size(), tail) != 0) {
+                if (poll(&pfd, 1, timeout) != 1)
+                    return false;
+                r = read(fd, chunk, sizeof(chunk));
+                if (r <= 0)
+                    return false;
+                buff.append(chunk, r);
+            }
+            return true;
+        }
+
+        int connectClient()
+        {
+            int fd = lirc_get_local_socket(LIRCRCD_SOCKET, 1);
+
+            CPPUNIT_ASSERT(fd >= 0);
+            return fd;
+        }
+
+        void subscribe(int fd)
+        {
+            string reply;
+
+            CPPUNIT_ASSERT(write(fd, "IDENT irexec\n", 13) == 13);
+            CPPUNIT_ASSERT(readUntil(fd, reply, "END\n"));
+            CPPUNIT_ASSERT(reply == "BEGIN\nIDENT irexec\nSUCCESS\nEND\n");
+            reply.clear();
+            CPPUNIT_ASSERT(write(fd, "SUBSCRIBE\n", 10) == 10);
+            CPPUNIT_ASSERT(readUntil(fd, reply, "END\n"));
+            CPPUNIT_ASSERT(reply == "BEGIN\nSUBSCRIBE\nSUCCESS\nEND\n");
+        }
+
+        void sendEvent(int i)
+        {
+            char line[64];
+            int len;
+
+            len = snprintf(line, sizeof(line), "%016x 00 %s test\n",
+                           i, i % 2 ? "KEY_B" : "KEY_A");
+            CPPUNIT_ASSERT(write(lircd, line, len) == len);
+        }
+
+        // Check that the next string pushed to fd is the one for event i.
+        void checkPushed(int fd, string& buff, int i)
+        {
+            string expected = pushString(i) + "\n";
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            char chunk[8192];
+            ssize_t r;
+
+            while (buff.size() < expected.size()) {
+                CPPUNIT_ASSERT(poll(&pfd, 1, 2000) == 1);
+                r = read(fd, chunk, sizeof(chunk));
+                CPPUNIT_ASSERT(r > 0);
+                buff.append(chunk, r);
+            }
+            CPPUNIT_ASSERT(buff.compare(0, expected.size(), expected) == 0);
+            buff.erase(0, expected.size());
+        }
+
+        void testSubscribe()
+        {
+            string reply;
+            int fd = connectClient();
+
+            CPPUNIT_ASSERT(write(fd, "SUBSCRIBE\n", 10) == 10);
+            CPPUNIT_ASSERT(readUntil(fd, reply, "END\n"));
+            CPPUNIT_ASSERT(reply.find("ERROR") != string::npos);
+            subscribe(fd);
+            acceptLircd();
+            close(fd);
+        }
+
+        void testPushOrder()
+        {
+            int fd = connectClient();
+            string buff;
+
+            subscribe(fd);
+            acceptLircd();
+            for (int i = 0; i < PUSH_COUNT; i += PUSH_BATCH) {
+                for (int j = i; j < i + PUSH_BATCH; j += 1)
+                    sendEvent(j);
+                for (int j = i; j < i + PUSH_BATCH; j += 1)
+                    checkPushed(fd, buff, j);
+            }
+            CPPUNIT_ASSERT(buff.empty());
+            close(fd);
+        }
+
+        // A subscriber which never reads is disconnected once its push
+        // buffer overflows, without stalling the other subscriber.
+        void testSlowSubscriber()
+        {
+            int reader = connectClient();
+            int stalled = connectClient();
+            string buff;
+            char chunk[8192];
+            ssize_t r;
+            size_t received = 0;
+
+            subscribe(reader);
+            subscribe(stalled);
+            acceptLircd();
+            for (int i = 0; i < PUSH_COUNT; i += 1) {
+                sendEvent(i);
+                checkPushed(reader, buff, i);
+            }
+            fcntl(stalled, F_SETFL, O_NONBLOCK);
+            do {
+                struct pollfd pfd = { stalled, POLLIN, 0 };
+
+                CPPUNIT_ASSERT(poll(&pfd, 1, 2000) == 1);
+                r = read(stalled, chunk, sizeof(chunk));
+                if (r > 0)
+                    received += r;
+            } while (r > 0);
+            CPPUNIT_ASSERT(r == 0 || errno == ECONNRESET);
+            CPPUNIT_ASSERT(received < (size_t)PUSH_COUNT * (PUSH_SIZE + 1));
+            close(stalled);
+            close(reader);
+        }
+};
+
+#endif
+
+// vim: set expandtab ts=4 sw=4:
@@ -0,0 +1,207 @@
+/****************************************************************************
+** cfgbench.c **************************************************************
+****************************************************************************
+*
+* cfgbench - config parser scaling benchmark.
+*
+* Writes synthetic remotes with a growing number of codes (a few of
+* them duplicated names and values so the duplicate checks are hit)
+* and times read_config() on each. The parse time per code should be
+* roughly constant; the exit code is non-zero if the time per code for
+* the largest remote exceeds the one for the smallest by more than
+* the given factor.
+*
+* Usage (from the test directory, after building lib):
+*
+*     make cfgbench
+*     ./cfgbench -r 5 1000 2000 5000 10000
+*
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "lirc_private.h"
+
+static const char* const USAGE =
+	"Usage: cfgbench [options] [codes...]\n\n"
+	"Time parsing of synthetic remotes with given number of codes\n"
+	"[1000 2000 5000 10000].\n\n"
+	"Options:\n"
+	"    -r, --reps <count>         Parse each remote <count> times,\n"
+	"                               report fastest [5]\n"
+	"    -f, --factor <factor>      Max allowed growth of time per\n"
+	"                               code, largest vs smallest [3.0]\n"
+	"    -o, --outfile <path>       Synthetic config [cfgbench.conf]\n"
+	"    -h, --help                 Print this message.\n";
+
+static const struct option options[] = {
+	{ "reps",	required_argument, NULL, 'r' },
+	{ "factor",	required_argument, NULL, 'f' },
+	{ "outfile",	required_argument, NULL, 'o' },
+	{ "help",	no_argument,	   NULL, 'h' },
+	{ 0,		0,		   0,	 0   }
+};
+
+static const int DEFAULT_SIZES[] = { 1000, 2000, 5000, 10000 };
+
+/** Every DUP_INTERVAL code reuses the name or value of an earlier one. */
+#define DUP_INTERVAL 500
+
+static int opt_reps = 5;
+static double opt_factor = 3.0;
+static const char* opt_outfile = "cfgbench.conf";
+
+
+static void write_remote(const char* path, int codes)
+{
+	FILE* f;
+	int i;
+
+	f = fopen(path, "w");
+	if (f == NULL) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	fputs("begin remote\n"
+	      "  name  cfgbench\n"
+	      "  bits           32\n"
+	      "  flags SPACE_ENC|CONST_LENGTH\n"
+	      "  eps            30\n"
+	      "  aeps          100\n"
+	      "  header       9000  4500\n"
+	      "  one           560  1690\n"
+	      "  zero          560   560\n"
+	      "  ptrail        560\n"
+	      "  repeat       9000  2250\n"
+	      "  gap          108000\n"
+	      "  toggle_bit_mask 0x0\n"
+	      "\n"
+	      "  begin codes\n", f);
+	for (i = 0; i < codes; i += 1) {
+		if (i > 0 && i % DUP_INTERVAL == 0)
+			fprintf(f, "    KEY_%05d 0x%08X\n", i - 1, i);
+		else if (i > 0 && i % DUP_INTERVAL == 1)
+			fprintf(f, "    KEY_%05d 0x%08X\n", i, i - 1);
+		else
+			fprintf(f, "    KEY_%05d 0x%08X\n", i, i);
+	}
+	fputs("  end codes\n"
+	      "end remote\n", f);
+	fclose(f);
+}
+
+
+/** Return fastest read_config() time for path in seconds. */
+static double time_parse(const char* path)
+{
+	struct ir_remote* remotes;
+	struct timespec t0;
+	struct timespec t1;
+	double best = -1.0;
+	double t;
+	FILE* f;
+	int i;
+
+	for (i = 0; i < opt_reps; i += 1) {
+		f = fopen(path, "r");
+		if (f == NULL) {
+			perror(path);
+			exit(EXIT_FAILURE);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		remotes = read_config(f, path);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		fclose(f);
+		if (remotes == NULL || remotes == (void*)-1) {
+			fprintf(stderr, "Cannot parse %s\n", path);
+			exit(EXIT_FAILURE);
+		}
+		free_config(remotes);
+		t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+		if (best < 0 || t < best)
+			best = t;
+	}
+	return best;
+}
+
+
+static void parse_options(int argc, char** argv)
+{
+	int c;
+
+	while ((c = getopt_long(argc, argv, "f:ho:r:", options, NULL))
+	       != EOF) {
+		switch (c) {
+		case 'f':
+			opt_factor = atof(optarg);
+			break;
+		case 'h':
+			fputs(USAGE, stdout);
+			exit(EXIT_SUCCESS);
+		case 'o':
+			opt_outfile = optarg;
+			break;
+		case 'r':
+			opt_reps = atoi(optarg);
+			break;
+		default:
+			fputs(USAGE, stderr);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (opt_reps <= 0 || opt_factor <= 0) {
+		fputs(USAGE, stderr);
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	double first = -1.0;
+	double per_code = 0.0;
+	double t;
+	int count;
+	int codes;
+	int i;
+
+	parse_options(argc, argv);
+	lirc_log_set_file("cfgbench.log");
+	lirc_log_open("cfgbench", 0, LIRC_NOTICE);
+
+	count = argc - optind;
+	if (count == 0)
+		count = sizeof(DEFAULT_SIZES) / sizeof(DEFAULT_SIZES[0]);
+	printf("%8s %12s %12s\n", "codes", "ms", "us/code");
+	for (i = 0; i < count; i += 1) {
+		codes = optind < argc ?
+			atoi(argv[optind + i]) : DEFAULT_SIZES[i];
+		if (codes <= 0) {
+			fprintf(stderr, "Bad code count: %s\n", argv[optind + i]);
+			return EXIT_FAILURE;
+		}
+		write_remote(opt_outfile, codes);
+		t = time_parse(opt_outfile);
+		per_code = t / codes;
+		if (first < 0)
+			first = per_code;
+		printf("%8d %12.3f %12.3f\n", codes, t * 1e3, per_code * 1e6);
+	}
+	unlink(opt_outfile);
+	lirc_log_close();
+	if (per_code > first * opt_factor) {
+		printf("Time per code grew %.1fx, max allowed %.1fx\n",
+		       per_code / first, opt_factor);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
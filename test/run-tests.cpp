@@ -9,6 +9,7 @@
 #include        "ClientTest.h"
 #include        "DrvAdminTest.h"
 #include        "DecodeTest.h"
+#include        "LircrcdTest.h"
 
 
 int main()
@@ -20,6 +21,7 @@ int main()
         runner.addTest(ClientTest::suite());
         runner.addTest(DrvAdminTest::suite());
         runner.addTest(DecodeTest::suite());
+        runner.addTest(LircrcdTest::suite());
         runner.run();
         system("pkill lircd");
         unlink("var/lircd.pid");
@@ -0,0 +1,281 @@
+/****************************************************************************
+** rxbench.c ***************************************************************
+****************************************************************************
+*
+* rxbench - receive path syscall benchmark.
+*
+* Feeds synthetic NEC frames as mode2 samples through a fifo to the
+* default driver and reads them back using readdata() or, with --bulk,
+* drv_readdata_bulk(), counting the read() and poll() or select() calls
+* made on the way. The calls are counted by interposing the libc
+* functions, so the program must be linked with -rdynamic.
+*
+* Usage (from the test directory, after building lib and plugins):
+*
+*     make rxbench
+*     ./rxbench -f 1000 -i 0
+*
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "lirc_private.h"
+
+static const char* const USAGE =
+	"Usage: rxbench [options]\n\n"
+	"Count syscalls used by the default driver to read NEC frames.\n\n"
+	"Options:\n"
+	"    -b, --bulk                 Read using drv_readdata_bulk()\n"
+	"    -f, --frames <count>       Number of frames [1000]\n"
+	"    -i, --interval <us>        Delay between written frames [0]\n"
+	"    -o, --fifo <path>          Fifo to create [rxbench.fifo]\n"
+	"    -U, --plugindir <path>     Load drivers from <path>\n"
+	"    -h, --help                 Print this message.\n";
+
+static const struct option options[] = {
+	{ "bulk",	no_argument,	   NULL, 'b' },
+	{ "frames",	required_argument, NULL, 'f' },
+	{ "interval",	required_argument, NULL, 'i' },
+	{ "fifo",	required_argument, NULL, 'o' },
+	{ "plugindir",	required_argument, NULL, 'U' },
+	{ "help",	no_argument,	   NULL, 'h' },
+	{ 0,		0,		   0,	 0   }
+};
+
+/** Samples in a NEC frame: header, 32 bits, trailing pulse and gap. */
+#define FRAME_SAMPLES   (2 + 2 * 32 + 2)
+
+static int opt_bulk = 0;
+static int opt_frames = 1000;
+static int opt_interval = 0;
+static const char* opt_fifo = "rxbench.fifo";
+
+static unsigned long read_calls = 0;
+static unsigned long wait_calls = 0;
+
+
+ssize_t read(int fd, void* buf, size_t count)
+{
+	static ssize_t (*libc_read)(int, void*, size_t) = NULL;
+
+	if (libc_read == NULL)
+		libc_read = (ssize_t (*)(int, void*, size_t))
+			    dlsym(RTLD_NEXT, "read");
+	read_calls += 1;
+	return libc_read(fd, buf, count);
+}
+
+
+int poll(struct pollfd* fds, nfds_t nfds, int timeout)
+{
+	static int (*libc_poll)(struct pollfd*, nfds_t, int) = NULL;
+
+	if (libc_poll == NULL)
+		libc_poll = (int (*)(struct pollfd*, nfds_t, int))
+			    dlsym(RTLD_NEXT, "poll");
+	wait_calls += 1;
+	return libc_poll(fds, nfds, timeout);
+}
+
+
+/* curl_poll() uses select() unless poll() is known to work. */
+int select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds,
+	   struct timeval* timeout)
+{
+	static int (*libc_select)(int, fd_set*, fd_set*, fd_set*,
+				  struct timeval*) = NULL;
+
+	if (libc_select == NULL)
+		libc_select = (int (*)(int, fd_set*, fd_set*, fd_set*,
+				       struct timeval*))
+			      dlsym(RTLD_NEXT, "select");
+	wait_calls += 1;
+	return libc_select(nfds, readfds, writefds, exceptfds, timeout);
+}
+
+
+static void make_frame(int frame, int* samples)
+{
+	unsigned int code = 0x20df0000 | (frame & 0xffff);
+	int i;
+	int n = 0;
+
+	samples[n++] = PULSE_BIT | 9000;
+	samples[n++] = 4500;
+	for (i = 31; i >= 0; i -= 1) {
+		samples[n++] = PULSE_BIT | 560;
+		samples[n++] = (code >> i) & 1 ? 1690 : 560;
+	}
+	samples[n++] = PULSE_BIT | 560;
+	samples[n++] = 40000;
+}
+
+
+/** Return next sample using readdata() or drv_readdata_bulk(). */
+static lirc_t next_sample(void)
+{
+	static lirc_t buf[FRAME_SAMPLES];
+	static int head = 0;
+	static int tail = 0;
+
+	if (!opt_bulk)
+		return curr_driver->readdata(0);
+	if (head >= tail) {
+		head = 0;
+		tail = drv_readdata_bulk(buf, FRAME_SAMPLES, NULL, 0);
+		if (tail == 0)
+			return 0;
+	}
+	return buf[head++];
+}
+
+
+/** Write all frames to the fifo, in a child process. */
+static pid_t start_writer(void)
+{
+	int samples[FRAME_SAMPLES];
+	FILE* f;
+	pid_t pid;
+	int i;
+
+	pid = fork();
+	if (pid != 0)
+		return pid;
+	f = fopen(opt_fifo, "w");
+	if (f == NULL) {
+		perror(opt_fifo);
+		_exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < opt_frames; i += 1) {
+		make_frame(i, samples);
+		fwrite(samples, sizeof(samples), 1, f);
+		if (opt_interval > 0) {
+			fflush(f);
+			usleep(opt_interval);
+		}
+	}
+	fclose(f);
+	_exit(EXIT_SUCCESS);
+}
+
+
+static void parse_options(int argc, char** argv)
+{
+	int c;
+
+	if (getenv("LIRC_PLUGIN_PATH") == NULL)
+		options_set_opt("lircd:plugindir", "../plugins/.libs");
+	while ((c = getopt_long(argc, argv, "bf:hi:o:U:", options, NULL))
+	       != EOF) {
+		switch (c) {
+		case 'b':
+			opt_bulk = 1;
+			break;
+		case 'f':
+			opt_frames = atoi(optarg);
+			break;
+		case 'h':
+			fputs(USAGE, stdout);
+			exit(EXIT_SUCCESS);
+		case 'i':
+			opt_interval = atoi(optarg);
+			break;
+		case 'o':
+			opt_fifo = optarg;
+			break;
+		case 'U':
+			options_set_opt("lircd:plugindir", optarg);
+			break;
+		default:
+			fputs(USAGE, stderr);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (opt_frames <= 0 || opt_interval < 0) {
+		fputs(USAGE, stderr);
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	int expected[FRAME_SAMPLES];
+	struct timespec t0;
+	struct timespec t1;
+	double t;
+	lirc_t data;
+	int errors = 0;
+	pid_t pid;
+	int status;
+	int i;
+	int j;
+
+	lirc_log_set_file("rxbench.log");
+	lirc_log_open("rxbench", 0, LIRC_NOTICE);
+	options_load(argc, argv, "etc/empty_options.conf", parse_options);
+
+	unlink(opt_fifo);
+	if (mkfifo(opt_fifo, 0600) == -1) {
+		perror(opt_fifo);
+		return EXIT_FAILURE;
+	}
+	if (hw_choose_driver("default") == -1) {
+		fputs("Cannot load default driver (bad plugin path?)\n", stderr);
+		return EXIT_FAILURE;
+	}
+	if (curr_driver->open_func(opt_fifo) != 0
+	    || !curr_driver->init_func()) {
+		fputs("Cannot open default driver\n", stderr);
+		return EXIT_FAILURE;
+	}
+	pid = start_writer();
+	read_calls = 0;
+	wait_calls = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < opt_frames; i += 1) {
+		make_frame(i, expected);
+		for (j = 0; j < FRAME_SAMPLES; j += 1) {
+			data = next_sample();
+			if (data != (lirc_t)expected[j])
+				errors += 1;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	waitpid(pid, &status, 0);
+	curr_driver->deinit_func();
+	unlink(opt_fifo);
+	lirc_log_close();
+
+	t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	printf("%8s %10s %10s %10s %12s\n",
+	       "frames", "read()", "wait()", "calls/frm", "us/frame");
+	printf("%8d %10lu %10lu %10.2f %12.3f\n",
+	       opt_frames, read_calls, wait_calls,
+	       (double)(read_calls + wait_calls) / opt_frames,
+	       t * 1e6 / opt_frames);
+	if (errors > 0) {
+		printf("%d bad samples\n", errors);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,562 @@
+/****************************************************************************
+** txtiming.c **************************************************************
+****************************************************************************
+*
+* txtiming - transmit timing accuracy harness.
+*
+* Runs the lircd transmit logic (send_core() + the repeat timer in
+* dosigalrm()) in-process against the file driver. For each frame the
+* send buffer lircd asked for is recorded together with a monotonic
+* timestamp. When done, the pulse/space lines emitted by the file driver
+* are read back and compared with the recorded send_buffer_data(), the
+* trailing gaps are checked against remote->gap and the measured
+* inter-frame intervals against the intervals lircd scheduled.
+*
+* Usage (from the test directory, after building lib and plugins):
+*
+*     make txtiming
+*     ./txtiming -r 3 etc/lircd.conf.d/<name>.conf etc/lircd.conf.Aspire_6530G
+*
+* Exit code is non-zero if any emitted train or trailing gap is wrong.
+*
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <errno.h>
+
+#include "lirc_private.h"
+
+static const logchannel_t logchannel = LOG_APP;
+
+static const char* const USAGE =
+	"Usage: txtiming [options] <lircd.conf> [lircd.conf...]\n\n"
+	"Send codes from all remotes in given files through the file driver\n"
+	"and report timing errors in the emitted data.\n\n"
+	"Options:\n"
+	"    -r, --reps <count>         SEND_ONCE with <count> repeats [1]\n"
+	"    -s, --start <count>        SEND_START, SEND_STOP after <count>\n"
+	"                               repeats instead of SEND_ONCE\n"
+	"    -k, --keys <count>         Max codes sent per remote [all]\n"
+	"    -n, --no-delay             Don't sleep between frames, skips\n"
+	"                               interval measurements\n"
+	"    -o, --outfile <path>       File driver output [txtiming.out]\n"
+	"    -U, --plugindir <path>     Load drivers from <path>\n"
+	"    -h, --help                 Print this message.\n";
+
+static const struct option options[] = {
+	{ "reps",	required_argument, NULL, 'r' },
+	{ "start",	required_argument, NULL, 's' },
+	{ "keys",	required_argument, NULL, 'k' },
+	{ "no-delay",	no_argument,	   NULL, 'n' },
+	{ "outfile",	required_argument, NULL, 'o' },
+	{ "plugindir",	required_argument, NULL, 'U' },
+	{ "help",	no_argument,	   NULL, 'h' },
+	{ 0,		0,		   0,	 0   }
+};
+
+/** Same as LIRCD_EXACT_GAP_THRESHOLD in transmit.c. */
+#define EXACT_GAP_THRESHOLD 10000
+
+#define MIN_TIMER_USEC 10
+
+/** Histogram bucket upper limits (us) of the absolute error. */
+static const long BUCKETS[] = { 0, 1, 10, 100, 1000, 10000, -1 };
+
+#define BUCKET_COUNT (sizeof(BUCKETS) / sizeof(BUCKETS[0]))
+
+struct histogram {
+	const char*	label;
+	unsigned long	count[BUCKET_COUNT];
+	unsigned long	samples;
+	long		min;
+	long		max;
+	long long	sum;
+};
+
+/** What lircd asked the driver to send, one per send_func() call. */
+struct frame {
+	const struct ir_remote* remote;
+	const char*		code_name;
+	lirc_t*			data;
+	int			length;
+	lirc_t			sum;
+	lirc_t			gap;            /**< min_remaining_gap after send. */
+	int			repeat;
+	int			sequence;       /**< Frame # in this workload. */
+	struct timespec		sent;           /**< When send_func() returned. */
+};
+
+static struct frame* frames = NULL;
+static int frame_count = 0;
+static int frame_size = 0;
+
+static int opt_reps = 1;
+static int opt_start = -1;
+static int opt_keys = -1;
+static int opt_delay = 1;
+static const char* opt_outfile = "txtiming.out";
+
+static struct histogram train_error = { "Pulse/space error" };
+static struct histogram gap_error = { "Trailing gap vs remote->gap" };
+static struct histogram interval_error = { "Inter-frame interval error" };
+static struct histogram drift = { "Accumulated repeat drift" };
+
+static unsigned long train_mismatches = 0;
+static unsigned long length_mismatches = 0;
+static unsigned long gap_mismatches = 0;
+
+
+static void histogram_add(struct histogram* h, long value)
+{
+	long abs_value = value < 0 ? -value : value;
+	int i;
+
+	for (i = 0; BUCKETS[i] != -1 && abs_value > BUCKETS[i]; i += 1)
+		;
+	h->count[i] += 1;
+	if (h->samples == 0 || value < h->min)
+		h->min = value;
+	if (h->samples == 0 || value > h->max)
+		h->max = value;
+	h->sum += value;
+	h->samples += 1;
+}
+
+
+static void histogram_print(const struct histogram* h)
+{
+	int i;
+
+	printf("%s (us), %lu samples", h->label, h->samples);
+	if (h->samples == 0) {
+		printf("\n\n");
+		return;
+	}
+	printf(", min: %ld, max: %ld, mean: %.1f\n",
+	       h->min, h->max, (double)h->sum / h->samples);
+	for (i = 0; i < BUCKET_COUNT; i += 1) {
+		if (BUCKETS[i] == -1)
+			printf("    > %-6ld %8lu\n", BUCKETS[i - 1], h->count[i]);
+		else
+			printf("   <= %-6ld %8lu\n", BUCKETS[i], h->count[i]);
+	}
+	printf("\n");
+}
+
+
+static long timespec_diff_us(const struct timespec* last,
+			     const struct timespec* current)
+{
+	return (current->tv_sec - last->tv_sec) * 1000000L
+	       + (current->tv_nsec - last->tv_nsec) / 1000;
+}
+
+
+static void sleep_until(const struct timespec* last, lirc_t usecs)
+{
+	struct timespec deadline;
+
+	if (usecs < MIN_TIMER_USEC)
+		usecs = MIN_TIMER_USEC;
+	deadline.tv_sec = last->tv_sec + usecs / 1000000;
+	deadline.tv_nsec = last->tv_nsec + (usecs % 1000000) * 1000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec += 1;
+		deadline.tv_nsec -= 1000000000;
+	}
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL)
+	       == EINTR)
+		;
+}
+
+
+/** Store current send buffer + timing as a new frame. */
+static void record_frame(struct ir_remote* remote,
+			 struct ir_ncode* code,
+			 int sequence)
+{
+	struct frame* f;
+
+	if (frame_count >= frame_size) {
+		frame_size = frame_size == 0 ? 1024 : 2 * frame_size;
+		frames = realloc(frames, frame_size * sizeof(struct frame));
+		if (frames == NULL) {
+			fputs("Out of memory\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+	}
+	f = &frames[frame_count];
+	f->remote = remote;
+	f->code_name = code->name;
+	f->length = send_buffer_length();
+	f->data = malloc(f->length * sizeof(lirc_t));
+	memcpy(f->data, send_buffer_data(), f->length * sizeof(lirc_t));
+	f->sum = send_buffer_sum();
+	f->gap = remote->min_remaining_gap;
+	f->repeat = repeat_remote != NULL;
+	f->sequence = sequence;
+	clock_gettime(CLOCK_MONOTONIC, &f->sent);
+	frame_count += 1;
+}
+
+
+/** Send code once and possibly repeat it like lircd's dosigalrm() does. */
+static int send_workload(struct ir_remote* remote, struct ir_ncode* code)
+{
+	struct timespec before_send;
+	int sequence = 0;
+	int done;
+
+	if (has_toggle_mask(remote))
+		remote->toggle_mask_state = 0;
+	if (has_toggle_bit_mask(remote))
+		remote->toggle_bit_mask_state =
+			(remote->toggle_bit_mask_state
+			 ^ remote->toggle_bit_mask);
+	code->transmit_state = NULL;
+	repeat_remote = NULL;
+	clock_gettime(CLOCK_MONOTONIC, &before_send);
+	if (!send_ir_ncode(remote, code, opt_delay))
+		return 0;
+	record_frame(remote, code, sequence++);
+	if (opt_start == -1)
+		remote->repeat_countdown =
+			remote->repeat_countdown > opt_reps ?
+			remote->repeat_countdown : opt_reps;
+	else
+		remote->repeat_countdown = REPEAT_MAX_DEFAULT;
+	if (remote->repeat_countdown <= 0 && code->next == NULL)
+		return 1;
+
+	repeat_remote = remote;
+	repeat_code = code;
+	while (1) {
+		if (opt_delay)
+			sleep_until(&before_send,
+				    send_buffer_sum() + remote->min_remaining_gap);
+		if (opt_start != -1) {
+			/* SEND_STOP, honoring min_repeat as send_stop() */
+			done = REPEAT_MAX_DEFAULT - remote->repeat_countdown;
+			if (done >= opt_start && done >= remote->min_repeat)
+				break;
+		}
+		if (code->next == NULL
+		    || (code->transmit_state != NULL
+			&& code->transmit_state->next == NULL))
+			remote->repeat_countdown--;
+		clock_gettime(CLOCK_MONOTONIC, &before_send);
+		if (!send_ir_ncode(remote, code, opt_delay))
+			break;
+		record_frame(remote, code, sequence++);
+		if (remote->repeat_countdown <= 0)
+			break;
+	}
+	repeat_remote = NULL;
+	repeat_code = NULL;
+	return 1;
+}
+
+
+/** Return 1 if the file driver will output pulse/space data for remote. */
+static int is_timed(const struct ir_remote* remote)
+{
+	if (strcmp(remote->name, "lirc") == 0)
+		return 0;
+	if (is_grundig(remote) || is_serial(remote) || is_bo(remote))
+		return 0;
+	return !(remote->pzero == 0 && remote->szero == 0 && !is_raw(remote));
+}
+
+
+static void send_all(struct ir_remote* remotes)
+{
+	struct ir_remote* remote;
+	struct ir_ncode* code;
+	int keys;
+
+	for (remote = remotes; remote != NULL; remote = remote->next) {
+		if (!is_timed(remote)) {
+			log_info("Skipping remote %s (no timing data)",
+				 remote->name);
+			continue;
+		}
+		keys = 0;
+		for (code = remote->codes; code->name != NULL; code++) {
+			if (opt_keys != -1 && keys++ >= opt_keys)
+				break;
+			if (!send_workload(remote, code))
+				log_warn("Cannot send %s %s",
+					 remote->name, code->name);
+		}
+	}
+}
+
+
+/** Read next "pulse|space <duration>" from file driver output. */
+static int read_duration(FILE* f, lirc_t* duration, int* is_pulse)
+{
+	char line[64];
+	char what[16];
+	int value;
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%15s %d", what, &value) != 2)
+			continue;
+		*duration = value;
+		*is_pulse = strcmp(what, "pulse") == 0;
+		return 1;
+	}
+	return 0;
+}
+
+
+/** Compare frames with what the file driver wrote to path. */
+static void check_emitted(const char* path)
+{
+	FILE* f;
+	struct frame* frame;
+	lirc_t duration;
+	lirc_t expected;
+	int is_pulse;
+	int i;
+	int j;
+	int bad;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		perror("Cannot open driver output");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < frame_count; i += 1) {
+		frame = &frames[i];
+		bad = 0;
+		for (j = 0; j < frame->length; j += 1) {
+			if (!read_duration(f, &duration, &is_pulse)) {
+				fprintf(stderr, "Premature EOF in %s\n", path);
+				length_mismatches += 1;
+				fclose(f);
+				return;
+			}
+			if (is_pulse != (j % 2 == 0))
+				bad = 1;
+			histogram_add(&train_error,
+				      (long)duration - frame->data[j]);
+			if (duration != frame->data[j])
+				bad = 1;
+		}
+		if (!read_duration(f, &duration, &is_pulse) || is_pulse) {
+			length_mismatches += 1;
+			fclose(f);
+			return;
+		}
+		if (duration != frame->gap)
+			bad = 1;
+		if (bad) {
+			train_mismatches += 1;
+			log_notice("Train mismatch: %s %s, frame %d",
+				   frame->remote->name, frame->code_name,
+				   frame->sequence);
+		}
+		/*
+		 * Check trailing gap against the configured remote gap. Low
+		 * gap codes are concatenated by transmit.c, the last part
+		 * is then always a repeat.
+		 */
+		if ((frame->repeat || frame->gap < EXACT_GAP_THRESHOLD)
+		    && has_repeat_gap(frame->remote)
+		    && has_repeat(frame->remote))
+			expected = frame->remote->repeat_gap;
+		else if (is_const(frame->remote))
+			expected = min_gap(frame->remote) - frame->sum;
+		else
+			expected = min_gap(frame->remote);
+		histogram_add(&gap_error, (long)duration - (long)expected);
+		if (duration != expected) {
+			gap_mismatches += 1;
+			log_notice("Gap mismatch: %s %s, frame %d",
+				   frame->remote->name, frame->code_name,
+				   frame->sequence);
+		}
+	}
+	if (read_duration(f, &duration, &is_pulse))
+		length_mismatches += 1;
+	fclose(f);
+}
+
+
+/**
+ * Compare the times frames were handed to the driver with the intervals
+ * lircd scheduled. Note that lircd schedules repeats relative to the time
+ * before send_ir_ncode(), which might sleep before sending the first frame.
+ */
+static void check_intervals(void)
+{
+	const struct frame* prev;
+	const struct frame* frame;
+	long expected;
+	long measured;
+	long scheduled;
+	int i;
+
+	scheduled = 0;
+	for (i = 1; i < frame_count; i += 1) {
+		frame = &frames[i];
+		if (frame->sequence == 0) {
+			scheduled = 0;
+			continue;
+		}
+		prev = &frames[i - 1];
+		expected = prev->sum + prev->gap;
+		if (expected < MIN_TIMER_USEC)
+			expected = MIN_TIMER_USEC;
+		measured = timespec_diff_us(&prev->sent, &frame->sent);
+		histogram_add(&interval_error, measured - expected);
+		scheduled += expected;
+		measured = timespec_diff_us(&frames[i - frame->sequence].sent,
+					    &frame->sent);
+		histogram_add(&drift, measured - scheduled);
+	}
+}
+
+
+static struct ir_remote* read_remotes(int argc, char** argv)
+{
+	struct ir_remote* head = NULL;
+	struct ir_remote* remotes;
+	struct ir_remote* last;
+	FILE* f;
+	int i;
+
+	for (i = 0; i < argc; i += 1) {
+		f = fopen(argv[i], "r");
+		if (f == NULL) {
+			fprintf(stderr, "Cannot open %s\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+		remotes = read_config(f, argv[i]);
+		fclose(f);
+		if (remotes == NULL || remotes == (void*)-1) {
+			fprintf(stderr, "Cannot parse %s\n", argv[i]);
+			continue;
+		}
+		if (head == NULL) {
+			head = remotes;
+		} else {
+			for (last = head; last->next != NULL; last = last->next)
+				;
+			last->next = remotes;
+		}
+	}
+	return head;
+}
+
+
+static int parse_count(const char* arg)
+{
+	char* end;
+	long value;
+
+	value = strtol(arg, &end, 10);
+	if (*end != '\0' || value < 0 || value > REPEAT_MAX_DEFAULT) {
+		fprintf(stderr, "Bad count: %s\n", arg);
+		exit(EXIT_FAILURE);
+	}
+	return (int)value;
+}
+
+
+static void parse_options(int argc, char** argv)
+{
+	int c;
+
+	if (getenv("LIRC_PLUGIN_PATH") == NULL)
+		options_set_opt("lircd:plugindir", "../plugins/.libs");
+	while ((c = getopt_long(argc, argv, "hk:no:r:s:U:", options, NULL))
+	       != EOF) {
+		switch (c) {
+		case 'h':
+			fputs(USAGE, stdout);
+			exit(EXIT_SUCCESS);
+		case 'k':
+			opt_keys = parse_count(optarg);
+			break;
+		case 'n':
+			opt_delay = 0;
+			break;
+		case 'o':
+			opt_outfile = optarg;
+			break;
+		case 'r':
+			opt_reps = parse_count(optarg);
+			break;
+		case 's':
+			opt_start = parse_count(optarg);
+			break;
+		case 'U':
+			options_set_opt("lircd:plugindir", optarg);
+			break;
+		default:
+			fputs(USAGE, stderr);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (optind >= argc) {
+		fputs(USAGE, stderr);
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	struct ir_remote* remotes;
+
+	lirc_log_set_file("txtiming.log");
+	lirc_log_open("txtiming", 0, LIRC_NOTICE);
+	options_load(argc, argv, "etc/empty_options.conf", parse_options);
+
+	if (hw_choose_driver("file") == -1) {
+		fputs("Cannot load file driver (bad plugin path?)\n", stderr);
+		return EXIT_FAILURE;
+	}
+	unlink(opt_outfile);
+	if (!curr_driver->open_func(opt_outfile)
+	    || !curr_driver->init_func()) {
+		fputs("Cannot open file driver\n", stderr);
+		return EXIT_FAILURE;
+	}
+	remotes = read_remotes(argc - optind, argv + optind);
+	if (remotes == NULL) {
+		fputs("No remotes to send\n", stderr);
+		return EXIT_FAILURE;
+	}
+	send_all(remotes);
+	curr_driver->deinit_func();
+
+	check_emitted(opt_outfile);
+	if (opt_delay)
+		check_intervals();
+
+	printf("Frames sent: %d\n", frame_count);
+	printf("Train mismatches: %lu\n", train_mismatches);
+	printf("Length mismatches: %lu\n", length_mismatches);
+	printf("Gap mismatches: %lu\n\n", gap_mismatches);
+	histogram_print(&train_error);
+	histogram_print(&gap_error);
+	if (opt_delay) {
+		histogram_print(&interval_error);
+		histogram_print(&drift);
+	}
+	return train_mismatches + length_mismatches + gap_mismatches == 0 ?
+	       EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -18,6 +18,9 @@
 #endif
 
 #include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
 #include <unistd.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -37,6 +40,8 @@ static const char* const USAGE =
 	"\t-d --daemon\t\tRun in background\n"
 	"\t-D --loglevel=level\t'error', 'info', 'notice',... or 0..10\n"
 	"\t-n --name=progname\tUse this program name for lircrc matching\n"
+	"\t-j --jobs=count\t\tRun at most count commands at a time\n"
+	"\t-s --no-shell\t\tRun commands without shell syntax directly\n"
 	"\t-h --help\t\tDisplay usage summary\n"
 	"\t-v --version\t\tDisplay version\n";
 
@@ -45,6 +50,8 @@ static const struct option options[] = {
 	{ "version",  no_argument,	 NULL, 'v' },
 	{ "daemon",   no_argument,	 NULL, 'd' },
 	{ "name",     required_argument, NULL, 'n' },
+	{ "jobs",     required_argument, NULL, 'j' },
+	{ "no-shell", no_argument,	 NULL, 's' },
 	{ "loglevel", required_argument, NULL, 'D' },
 	{ 0,          0,		 0,    0   }
 };
@@ -52,68 +59,243 @@ static const struct option options[] = {
 static int opt_daemonize	= 0;
 static loglevel_t opt_loglevel	= LIRC_NOLOG;
 static const char* opt_progname	= "irexec";
+static int opt_jobs		= 0;
+static int opt_no_shell		= 0;
 
 static char path[256] = {0};
 
+/** Max number of codes handled after each read from lircd. */
+#define CODE_BATCH	32
 
-/** Run shell command line in isolated process using double fork(). */
-static void run_command(const char* cmd)
+
+/** Max number of commands waiting for a worker, see --jobs. */
+#define QUEUE_SIZE	64
+
+/** Max number of arguments in commands run without shell. */
+#define MAX_ARGS	32
+
+/** Characters making a command line require a shell, see --no-shell. */
+static const char* const SHELL_CHARS = "|&;<>()$`\\\"'*?[]#~=%{}!\n";
+
+extern char** environ;
+
+/** Commands waiting for a worker thread, used with --jobs. */
+static struct {
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	char*		commands[QUEUE_SIZE];
+	int		head;
+	int		count;
+} queue = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, {0}, 0, 0 };
+
+
+/** Split cmd in place into argv on blanks, return argc or 0 if too many. */
+static int split_args(char* cmd, char** argv)
 {
-	pid_t pid1;
-	pid_t pid2;
-
-	pid1 = fork();
-	if (pid1 < 0) {
-		log_perror_err("Cannot fork");
-		perror("Cannot fork()");
-		exit(EXIT_FAILURE);
-	}
-	if (pid1 == 0) {
-		pid2 = fork();
-		if (pid2 < 0) {
-			log_perror_err("Cannot do secondary fork()");
-			exit(EXIT_FAILURE);
-		}
-		if (pid2 == 0) {
-			log_debug("Execing command \"%s\"", cmd);
-			char* const vp[] = {strdup(SH_PATH),
-			      strdup("-c"),
-			      strdup(cmd),
-			      NULL
-			};
-			execvp(SH_PATH, vp);
-			/* not reached, unless there was an error */
-			log_perror_err("execvp failed");
-			fputs("execvp failed\n", stderr);
-			exit(EXIT_FAILURE);
-		} else {
-			waitpid(pid2, NULL, WNOHANG);
-			exit(0);
-		}
+	char* saveptr;
+	char* s;
+	int argc = 0;
+
+	for (s = strtok_r(cmd, " \t", &saveptr);
+	     s != NULL;
+	     s = strtok_r(NULL, " \t", &saveptr)) {
+		if (argc >= MAX_ARGS)
+			return 0;
+		argv[argc++] = s;
+	}
+	argv[argc] = NULL;
+	return argc;
+}
+
+
+/**
+ * Start cmd using posix_spawn(), without waiting for it. With
+ * --no-shell a command without shell syntax is run directly, else (and
+ * if that fails e. g., for shell builtins) using SH_PATH -c cmd.
+ * @return pid of started process, or -1 on errors.
+ */
+static pid_t spawn_command(const char* cmd)
+{
+	posix_spawnattr_t attr;
+	sigset_t sigs;
+	char* argv[MAX_ARGS + 1];
+	char* buf;
+	pid_t pid = -1;
+	short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+	int r = -1;
+
+	posix_spawnattr_init(&attr);
+	sigemptyset(&sigs);
+	posix_spawnattr_setsigmask(&attr, &sigs);
+	sigaddset(&sigs, SIGCHLD);
+	posix_spawnattr_setsigdefault(&attr, &sigs);
+#ifdef POSIX_SPAWN_USEVFORK
+	flags |= POSIX_SPAWN_USEVFORK;
+#endif
+	posix_spawnattr_setflags(&attr, flags);
+	if (opt_no_shell && strpbrk(cmd, SHELL_CHARS) == NULL) {
+		buf = strdupa(cmd);
+		if (split_args(buf, argv) > 0)
+			r = posix_spawnp(&pid, argv[0], NULL, &attr,
+					 argv, environ);
+	}
+	if (r != 0) {
+		char* const sh_argv[] = { (char*)SH_PATH,
+					  (char*)"-c",
+					  (char*)cmd,
+					  NULL };
+
+		r = posix_spawn(&pid, SH_PATH, NULL, &attr, sh_argv, environ);
+	}
+	posix_spawnattr_destroy(&attr);
+	if (r != 0) {
+		errno = r;
+		log_perror_err("Cannot run \"%s\"", cmd);
+		return -1;
+	}
+	log_debug("Started \"%s\", pid %d", cmd, pid);
+	return pid;
+}
+
+
+/**
+ * Queue cmd for a worker, unless the same command already is waiting.
+ * This coalesces repeats piling up while the workers are busy.
+ */
+static void queue_command(const char* cmd)
+{
+	int i;
+
+	pthread_mutex_lock(&queue.lock);
+	for (i = 0; i < queue.count; i += 1) {
+		if (strcmp(queue.commands[(queue.head + i) % QUEUE_SIZE],
+			   cmd) == 0)
+			break;
+	}
+	if (i < queue.count) {
+		log_debug("Coalescing queued command \"%s\"", cmd);
+	} else if (queue.count >= QUEUE_SIZE) {
+		log_warn("Command queue full, dropping \"%s\"", cmd);
 	} else {
-		waitpid(pid1, NULL, 0);
+		queue.commands[(queue.head + queue.count) % QUEUE_SIZE] =
+			strdup(cmd);
+		queue.count += 1;
+		pthread_cond_signal(&queue.cond);
 	}
+	pthread_mutex_unlock(&queue.lock);
+}
+
+
+/** Worker thread: run queued commands one at a time. */
+static void* worker(void* arg)
+{
+	char* cmd;
+	pid_t pid;
+
+	while (1) {
+		pthread_mutex_lock(&queue.lock);
+		while (queue.count == 0)
+			pthread_cond_wait(&queue.cond, &queue.lock);
+		cmd = queue.commands[queue.head];
+		queue.head = (queue.head + 1) % QUEUE_SIZE;
+		queue.count -= 1;
+		pthread_mutex_unlock(&queue.lock);
+
+		pid = spawn_command(cmd);
+		free(cmd);
+		if (pid == -1)
+			continue;
+		while (waitpid(pid, NULL, 0) == -1 && errno == EINTR)
+			;
+	}
+	return NULL;
+}
+
+
+/**
+ * Prepare for run_command(). Without --jobs commands are started
+ * directly and reaped by the kernel, else start the worker threads.
+ * Must run after lirc_readconfig(), which waits for a child.
+ */
+static int start_executor(void)
+{
+	sigset_t all;
+	sigset_t old;
+	pthread_t thread;
+	int r = 0;
+	int i;
+
+	if (opt_jobs == 0) {
+		signal(SIGCHLD, SIG_IGN);
+		return 0;
+	}
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for (i = 0; i < opt_jobs && r == 0; i += 1) {
+		r = pthread_create(&thread, NULL, worker, NULL);
+		if (r == 0)
+			pthread_detach(thread);
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (r != 0) {
+		log_error("Cannot create worker thread: %s", strerror(r));
+		return -1;
+	}
+	return 0;
+}
+
+
+/** Run shell command line asynchronously, see start_executor(). */
+static void run_command(const char* cmd)
+{
+	if (opt_jobs > 0)
+		queue_command(cmd);
+	else
+		spawn_command(cmd);
+}
+
+
+/** Run commands pushed by lircrcd on fd, see lirc_subscribe(). */
+static void process_pushed(int fd)
+{
+	lirc_reader* reader;
+	const char* commands[CODE_BATCH];
+	int count;
+	int i;
+
+	reader = lirc_reader_new(fd);
+	if (reader == NULL) {
+		log_error("Out of memory");
+		close(fd);
+		return;
+	}
+	while ((count = lirc_reader_read(reader, commands, CODE_BATCH)) >= 0)
+		for (i = 0; i < count; i += 1)
+			run_command(commands[i]);
+	lirc_reader_free(reader);
+	close(fd);
 }
 
 
 /** Get buttonclick messages from lircd socket and process them. */
 static void process_input(struct lirc_config* config)
 {
-	char* code;
+	const char* codes[CODE_BATCH];
 	char* c;
-	int r;
+	int count;
+	int i;
+	int r = 0;
 
-	while (lirc_nextcode(&code) == 0) {
-		if (code == NULL)
-			continue;
-		r = lirc_code2char(config, code, &c);
-		while (r == 0 && c != NULL) {
-			run_command(c);
-			r = lirc_code2char(config, code, &c);
+	while ((count = lirc_nextcodes(codes, CODE_BATCH)) >= 0) {
+		for (i = 0; i < count; i += 1) {
+			r = lirc_code2char(config, (char*)codes[i], &c);
+			while (r == 0 && c != NULL) {
+				run_command(c);
+				r = lirc_code2char(config, (char*)codes[i], &c);
+			}
+			if (r == -1)
+				return;
 		}
-		free(code);
-		if (r == -1)
-			break;
 	}
 }
 
@@ -121,6 +303,7 @@ static void process_input(struct lirc_config* config)
 int irexec(const char* configfile)
 {
 	struct lirc_config* config;
+	int fd;
 
 	if (opt_daemonize) {
 		if (daemon(0, 0) == -1) {
@@ -139,9 +322,17 @@ int irexec(const char* configfile)
 	unlink(path);
 	lirc_log_set_file(path);
 	lirc_log_open("irexec", 1, opt_loglevel);
+	if (start_executor() != 0)
+		return EXIT_FAILURE;
 
-	process_input(config);
-	lirc_deinit();
+	if (config->sockfd != -1 && (fd = lirc_subscribe(config)) != -1) {
+		/* Unread lircd data would pile up until lircd drops us. */
+		lirc_deinit();
+		process_pushed(fd);
+	} else {
+		process_input(config);
+		lirc_deinit();
+	}
 
 	lirc_freeconfig(config);
 	return EXIT_SUCCESS;
@@ -152,7 +343,7 @@ int main(int argc, char* argv[])
 {
 	int c;
 
-	while ((c = getopt_long(argc, argv, "D:hvdn:", options, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "D:hvdj:n:s", options, NULL)) != -1) {
 		switch (c) {
 		case 'h':
 			puts(USAGE);
@@ -166,6 +357,16 @@ int main(int argc, char* argv[])
 		case 'n':
 			opt_progname = optarg;
 			break;
+		case 'j':
+			opt_jobs = atoi(optarg);
+			if (opt_jobs <= 0) {
+				fprintf(stderr, "Bad job count: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 's':
+			opt_no_shell = 1;
+			break;
 		case 'D':
 			opt_loglevel = string2loglevel(optarg);
 			break;
@@ -33,7 +33,8 @@ static void add_defaults(void)
 static const char* const USAGE =
 	"Usage: irsimreceive [options]  <configfile>  <datafile>\n\n"
 	"<configfile> is a lircd.conf type configuration.\n"
-	"<datafile> is a list of pulse/space durations.\n\n"
+	"<datafile> is a list of pulse/space durations or a binary\n"
+	"capture from lircd's SET_INPUTLOG.\n\n"
 	"Options:\n"
 	"    -U, --plugindir <path>:     Load drivers from <path>.\n"
 	"    -v, --version               Print version.\n"
@@ -0,0 +1,184 @@
+/****************************************************************************
+** irtrace.cpp *************************************************************
+****************************************************************************
+*
+* irtrace - render binary trace files written by lircd SET_TRACE.
+*
+*/
+
+#include <config.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lirc_private.h"
+
+static const char* const USAGE =
+	"Usage: irtrace [options] <tracefile...>\n\n"
+	"Render binary trace files from lircd, see SET_TRACE in lircd(8).\n"
+	"Records from all files are merged in time order.\n\n"
+	"Options:\n"
+	"    -a, --absolute      Print CLOCK_MONOTONIC time in ns.\n"
+	"    -v, --version       Print version.\n"
+	"    -h, --help          Print this message.\n";
+
+static struct option options[] = {
+	{ "help",     no_argument, NULL, 'h' },
+	{ "version",  no_argument, NULL, 'v' },
+	{ "absolute", no_argument, NULL, 'a' },
+	{ 0,	      0,	   0,	 0   }
+};
+
+/** A record together with the thread which wrote it. */
+struct item {
+	struct trace_record	record;
+	uint32_t		tid;
+};
+
+static struct item* items = NULL;
+static size_t item_count = 0;
+
+static int opt_absolute = 0;
+
+
+static void parse_options(int argc, char** const argv)
+{
+	long c;
+
+	while ((c = getopt_long(argc, argv, "ahv", options, NULL)) != EOF) {
+		switch (c) {
+		case 'a':
+			opt_absolute = 1;
+			break;
+		case 'h':
+			fputs(USAGE, stdout);
+			exit(EXIT_SUCCESS);
+		case 'v':
+			printf("%s\n", "irtrace " VERSION);
+			exit(EXIT_SUCCESS);
+		default:
+			fputs(USAGE, stderr);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (optind >= argc) {
+		fputs(USAGE, stderr);
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+/** Append all valid records in path to items. */
+static int load(const char* path)
+{
+	struct trace_header header;
+	struct trace_record* records;
+	uint64_t first;
+	uint64_t count;
+	uint64_t i;
+	FILE* f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+		return 0;
+	}
+	if (fread(&header, sizeof(header), 1, f) != 1
+	    || memcmp(header.magic, LIRC_TRACE_MAGIC, 8) != 0
+	    || header.record_size != sizeof(struct trace_record)
+	    || header.capacity == 0) {
+		fprintf(stderr, "%s: Not a trace file\n", path);
+		fclose(f);
+		return 0;
+	}
+	records = (struct trace_record*)
+		  calloc(header.capacity, sizeof(struct trace_record));
+	if (records == NULL
+	    || fread(records, sizeof(struct trace_record),
+		     header.capacity, f) != header.capacity) {
+		fprintf(stderr, "%s: Truncated trace file\n", path);
+		free(records);
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+
+	count = header.head < header.capacity ? header.head : header.capacity;
+	first = header.head - count;
+	if (header.head > header.capacity)
+		fprintf(stderr, "%s: ring wrapped, %llu oldest records lost\n",
+			path, (unsigned long long)(header.head - count));
+	items = (struct item*)realloc(items,
+				      (item_count + count) * sizeof(struct item));
+	if (items == NULL) {
+		fputs("Out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	for (i = first; i < header.head; i += 1) {
+		items[item_count].record = records[i % header.capacity];
+		items[item_count].tid = header.tid;
+		item_count += 1;
+	}
+	free(records);
+	return 1;
+}
+
+
+static int by_time(const void* a, const void* b)
+{
+	const struct item* ia = (const struct item*)a;
+	const struct item* ib = (const struct item*)b;
+
+	if (ia->record.ns == ib->record.ns)
+		return 0;
+	return ia->record.ns < ib->record.ns ? -1 : 1;
+}
+
+
+static void render(void)
+{
+	const struct trace_record* r;
+	const char* fmt;
+	uint64_t start;
+	uint64_t prev;
+	size_t i;
+
+	if (item_count == 0)
+		return;
+	start = items[0].record.ns;
+	prev = start;
+	for (i = 0; i < item_count; i += 1) {
+		r = &items[i].record;
+		if (opt_absolute)
+			printf("%llu ", (unsigned long long)r->ns);
+		else
+			printf("%12.3f ", (r->ns - start) / 1000.0);
+		printf("%+10.3f %6u  ", (r->ns - prev) / 1000.0, items[i].tid);
+		prev = r->ns;
+		fmt = lirc_trace_format(r->id);
+		if (fmt == NULL)
+			printf("unknown(%u) %u %u %u",
+			       r->id, r->arg[0], r->arg[1], r->arg[2]);
+		else
+			printf(fmt, r->arg[0], r->arg[1], r->arg[2]);
+		putchar('\n');
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	int i;
+	int errors = 0;
+
+	parse_options(argc, argv);
+	for (i = optind; i < argc; i += 1)
+		errors += load(argv[i]) ? 0 : 1;
+	qsort(items, item_count, sizeof(struct item), by_time);
+	render();
+	free(items);
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -23,10 +23,15 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/un.h>
+#include <sys/uio.h>
 #include <errno.h>
 #include <getopt.h>
 
 #include "lirc_log.h"
+#include "lirc_client.h"
+
+/** Max number of lines printed after each read from lircd. */
+#define LINE_BATCH	32
 
 static struct option long_options[] = {
 	{ "help",    no_argument, NULL, 'h' },
@@ -41,12 +46,41 @@ void sigusr1(int sig)
 }
 
 
+/** Write all of iov to fd, retrying after short writes. */
+static int writev_all(int fd, struct iovec* iov, int iovcnt)
+{
+	ssize_t done;
+
+	while (iovcnt > 0) {
+		done = writev(fd, iov, iovcnt);
+		if (done == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		while (iovcnt > 0 && (size_t)done >= iov->iov_len) {
+			done -= iov->iov_len;
+			iov += 1;
+			iovcnt -= 1;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (char*)iov->iov_base + done;
+			iov->iov_len -= done;
+		}
+	}
+	return 0;
+}
+
+
 
 int main(int argc, char* argv[])
 {
 	struct sigaction act;
 	int fd, i;
-	char buf[128];
+	int count;
+	lirc_reader* reader;
+	const char* lines[LINE_BATCH];
+	struct iovec iov[2 * LINE_BATCH];
 	struct sockaddr_un addr;
 	int c;
 	const char* progname;
@@ -97,14 +131,31 @@ int main(int argc, char* argv[])
 		perrorf("Cannot connect to socket %s", addr.sun_path);
 		exit(errno);
 	}
+	reader = lirc_reader_new(fd);
+	if (reader == NULL) {
+		fputs("Out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	}
 	for (;; ) {
-		i = read(fd, buf, 128);
-		if (i == -1) {
-			perror("read");
+		errno = 0;
+		count = lirc_reader_read(reader, lines, LINE_BATCH);
+		if (count == -1) {
+			if (errno != 0) {
+				perror("read");
+				exit(errno);
+			}
+			exit(0);
+		}
+		/* Print all lines from this read in one write. */
+		for (i = 0; i < count; i += 1) {
+			iov[2 * i].iov_base = (void*)lines[i];
+			iov[2 * i].iov_len = strlen(lines[i]);
+			iov[2 * i + 1].iov_base = (void*)"\n";
+			iov[2 * i + 1].iov_len = 1;
+		}
+		if (count > 0 && writev_all(STDOUT_FILENO, iov, 2 * count) == -1) {
+			perror("write");
 			exit(errno);
 		}
-		if (!i)
-			exit(0);
-		chk_write(STDOUT_FILENO, buf, i);
 	}
 }
@@ -26,6 +26,7 @@
 	"\nSynopsis:\n" \
 	"    lirc-lsplugins [-l] [-q] [-U plugindir] [drivers]\n" \
 	"    lirc-lsplugins -e [-q] [-U plugindir]\n" \
+	"    lirc-lsplugins -i [-U plugindir]\n" \
 	"    lirc-lsplugins [-s|-p|-h|-v]\n\n" \
 	"If [drivers] is given list matching plugins, else list all.\n\n" \
 	"Options:\n" \
@@ -34,6 +35,7 @@
 	"    -l, --long\t\tLots of info (a. k. a. long listing).\n" \
 	"    -y, --yaml\t\tGenerate a YAML plugins config file.\n" \
 	"    -e, --errors\tList plugins which can't load driver(s).\n" \
+	"    -i, --index\t\tWrite plugin index(es) used to find drivers.\n" \
 	"    -s, --summary\tPrint summary on plugins status.\n" \
 	"    -q, --quiet\t\tBe less verbose.\n" \
 	"    -p, --default-path\tPrint default search path and exit.\n" \
@@ -64,6 +66,7 @@ const struct option options[] = {
 	{ "quiet",	  no_argument,	     NULL, 'q' },
 	{ "long",	  no_argument,	     NULL, 'l' },
 	{ "errors",	  no_argument,	     NULL, 'e' },
+	{ "index",	  no_argument,	     NULL, 'i' },
 	{ "summary",	  no_argument,	     NULL, 's' },
 	{ "yaml",	  no_argument,	     NULL, 'y' },
 	{ "default-path", no_argument,	     NULL, 'p' },
@@ -100,6 +103,7 @@ static int opt_long = 0;                /**< --long option */
 static int opt_summary = 0;             /**< --summary option */
 static int opt_listerrors = 0;          /**< --errors option */
 static int opt_yaml = 0;                /**< --yaml option */
+static int opt_index = 0;               /**< --index option */
 
 static int sum_drivers = 0;
 static int sum_plugins = 0;
@@ -468,7 +472,7 @@ int main(int argc, char** argv)
 	if (getenv(PLUGINDIR_VAR) != NULL)
 		pluginpath = getenv(PLUGINDIR_VAR);
 	while ((c = getopt_long(argc, argv,
-				"selpqvhU:y", options, NULL)) != -1) {
+				"seilpqvhU:y", options, NULL)) != -1) {
 		switch (c) {
 		case 'U':
 			pluginpath = optarg;
@@ -485,6 +489,9 @@ int main(int argc, char** argv)
 		case 'e':
 			opt_listerrors = 1;
 			break;
+		case 'i':
+			opt_index = 1;
+			break;
 		case 's':
 			opt_summary = 1;
 			break;
@@ -515,6 +522,8 @@ int main(int argc, char** argv)
 	lirc_log_set_file(path);
 	lirc_log_open("lirc-lsplugins", 1, level);
 
+	if (opt_index)
+		return plugin_index_update(pluginpath) == 0 ? 0 : 1;
 	lsplugins(pluginpath, which);
 	return sum_errors == 0 ? 0 : 1;
 }
@@ -52,6 +52,10 @@ static int t_div = 500;
 static unsigned int opt_gap = 10000;
 static int opt_raw_access = 0;
 static int opt_list_devices = 0;
+static const char* opt_infile = NULL;
+
+/** Max number of samples printed for each drv_readdata_bulk(). */
+static const int SAMPLE_BATCH = 64;
 
 static const char* const help =
 	"Usage: mode2 [options]\n"
@@ -61,6 +65,7 @@ static const char* const help =
 	"\t -k --keep-root\t\tKeep root privileges\n"
 	"\t -m --mode\t\tEnable column display mode\n"
 	"\t -l --list-devices\tList available devices\n"
+	"\t -i --infile=file\tPrint data in binary capture file\n"
 	"\t -r --raw\t\tAccess device directly without driver\n"
 	"\t -g --gap=time\t\tTreat spaces longer than time as the gap\n"
 	"\t -s --scope=time\t'Scope' like display with time us per char\n"
@@ -80,6 +85,7 @@ static const struct option options[] = {
 	{"driver",         required_argument, NULL, 'H'},
 	{"keep-root",      no_argument,       NULL, 'k'},
 	{"list-devices",   no_argument,       NULL, 'l'},
+	{"infile",         required_argument, NULL, 'i'},
 	{"mode",           no_argument,       NULL, 'm'},
 	{"raw",            no_argument,       NULL, 'r'},
 	{"gap",            required_argument, NULL, 'g'},
@@ -153,7 +159,7 @@ static void add_defaults(void)
 static void parse_options(int argc, char** argv)
 {
 	int c;
-	static const char* const optstring = "hvD:d:H:mklrg:s:U:A:";
+	static const char* const optstring = "hvD:d:H:mkli:rg:s:U:A:";
 
 	add_defaults();
 	while ((c = getopt_long(argc, argv, optstring, options, NULL)) != -1) {
@@ -183,6 +189,9 @@ static void parse_options(int argc, char** argv)
 		case 'l':
 			opt_list_devices = 1;
 			break;
+		case 'i':
+			opt_infile = optarg;
+			break;
 		case 'd':
 			options_set_opt("mode2:device", optarg);
 			break;
@@ -218,6 +227,9 @@ static void parse_options(int argc, char** argv)
 	}
 	options_set_opt("lircd:plugindir",
 			options_getstring("mode2:plugindir"));
+	if (opt_infile != NULL)
+		/* No driver needed. */
+		return;
 	opt_driver = options_getstring("mode2:driver");
 	if (hw_choose_driver(opt_driver) != 0) {
 		fprintf(stderr, "Driver `%s' not found.", opt_driver);
@@ -390,7 +402,6 @@ void print_mode2_data(unsigned int data)
 		}
 		break;
 	}
-	fflush(stdout);
 }
 
 
@@ -429,22 +440,57 @@ int next_press(int fd, int mode, int bytes)
 				r, opt_device);
 		if (r != (int)bytes)
 			return 0;
-		if (mode == LIRC_MODE_MODE2)
+		if (mode == LIRC_MODE_MODE2) {
 			print_mode2_data(input.data);
-		else
+			fflush(stdout);
+		} else {
 			print_lirccode_data(input.buffer, bytes);
+		}
 	} else {
-		input.data = curr_driver->readdata(0);
-		if (input.data == 0) {
+		lirc_t samples[SAMPLE_BATCH];
+
+		r = drv_readdata_bulk(samples, SAMPLE_BATCH, NULL, 0);
+		if (r == 0) {
 			fputs("readdata() failed\n", stderr);
 			return 0;
 		}
-		print_mode2_data(input.data);
+		for (int i = 0; i < r; i += 1)
+			print_mode2_data(samples[i]);
+		fflush(stdout);
 	}
 	return 1;
 }
 
 
+/** Print data in a binary capture from lircd's SET_INPUTLOG. */
+static int print_capture(const char* path)
+{
+	struct capture_header header;
+	struct capture_record record;
+	FILE* f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		perrorf("Cannot open %s", path);
+		return EXIT_FAILURE;
+	}
+	if (!capture_read_header(f, &header)) {
+		fprintf(stderr, "%s: Not a capture file\n", path);
+		fclose(f);
+		return EXIT_FAILURE;
+	}
+	fprintf(stderr, "Capture from driver %s on device %s",
+		header.driver, header.device);
+	if (header.resolution != 0)
+		fprintf(stderr, ", resolution %u us", header.resolution);
+	fputs("\n", stderr);
+	while (capture_read(f, &record))
+		print_mode2_data(record.data);
+	fclose(f);
+	return EXIT_SUCCESS;
+}
+
+
 static void list_devices(void)
 {
 	glob_t glob;
@@ -499,6 +545,8 @@ int main(int argc, char** argv)
 		list_devices();
 		return 0;
 	}
+	if (opt_infile != NULL)
+		return print_capture(opt_infile);
         if (opt_raw_access) {
 		fprintf(stderr, "Using raw access on device %s\n", opt_device);
 	} else {
@@ -510,7 +510,7 @@ int main(int argc, char** argv)
 				/*
 				 * Must use the driver read function, the UDP driver reformats the data!
 				 */
-				data = curr_driver->readdata(0);
+				data = drv_readdata(0, NULL);
 				if (data == 0) {
 					fprintf(stderr, "readdata() failed\n");
 					result = 0;